@@ -29,6 +29,8 @@
 #include <cmath>
 #include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <atomic>
 #include <type_traits>
 
 
@@ -54,6 +56,7 @@
         /*
          * Running in basic environment. Use stderr for printing overflows.
          */
+        #include <iostream>
         void _DEBUG_PRINT_FUNC(const char *str)
         {
             std::cerr << str << std::endl;
@@ -223,6 +226,17 @@ namespace detail
     }
 
 
+    /*
+     * Constexpr maximum of two word lengths. Used in the result types of the
+     * addition and subtraction operators, where std::max makes the friend
+     * declarations mismatch their definitions on newer GCC versions.
+     */
+    constexpr int max_bits(int a, int b)
+    {
+        return a > b ? a : b;
+    }
+
+
     /*
      * Fast integer log2(double) function.
      */
@@ -234,6 +248,90 @@ namespace detail
     }
 
 
+    /*
+     * Test if the bulk conversion doubles_to_raw() handles 'a' itself, that
+     * is, if |a| is less than about 2^62. The magic number is the one of
+     * construct_from_double(). Infinities and NaNs are not handled.
+     */
+    static inline bool raw_convertible(double a)
+    {
+        constexpr double MAGIC_CEIL = 0.9999999999999999;
+        return std::abs(a) + MAGIC_CEIL < 0x1p62;
+    }
+
+
+    /*
+     * Bulk conversion of 'n' doubles to raw fixed point numbers, that is, the
+     * number num >> (64-FRAC_BITS) wrapped to INT_BITS+FRAC_BITS bits. The
+     * rounding is exactly that of construct_from_double(): std::llround() at
+     * the scale given by the exponent of |a|+MAGIC_CEIL, followed by rounding
+     * half up to FRAC_BITS. The loop has neither branches nor 128-bit
+     * arithmetic, so the compiler is able to vectorize it. Returns false if
+     * some value is not raw_convertible(); those are written as 0 and are left
+     * to the caller.
+     */
+    template <int INT_BITS, int FRAC_BITS>
+    bool doubles_to_raw(const double *src, int64_t *dst, size_t n)
+    {
+        static_assert(INT_BITS >= 1 && FRAC_BITS >= 0 && FRAC_BITS <= 62 &&
+            INT_BITS+FRAC_BITS <= 64, "No raw representation of the format.");
+        constexpr int TOTAL_BITS = INT_BITS+FRAC_BITS;
+        constexpr double MAGIC_CEIL = 0.9999999999999999;
+        uint64_t all = 1;
+        for (size_t i=0; i<n; ++i)
+        {
+            // Values that are not convertible are replaced by zero, with a
+            // mask rather than a branch.
+            const uint64_t ok = raw_convertible(src[i]);
+            uint64_t a_bits;
+            std::memcpy(&a_bits, &src[i], sizeof(a_bits));
+            a_bits &= -ok;
+            double a;
+            std::memcpy(&a, &a_bits, sizeof(a));
+            all &= ok;
+
+            // Exponent of |a|+MAGIC_CEIL, see ilog2_fast(), and the scaling
+            // 2^(64-e) of std::llround() in construct_from_double().
+            const double x = std::abs(a) + MAGIC_CEIL;
+            uint64_t x_bits;
+            std::memcpy(&x_bits, &x, sizeof(x));
+            const int64_t e = int64_t(x_bits >> 52) - 1023 + 2;
+            const uint64_t scale_bits = uint64_t(1023 + 64 - e) << 52;
+            double scale;
+            std::memcpy(&scale, &scale_bits, sizeof(scale));
+
+            // std::llround(), rounding half away from zero. Both the product
+            // and the fractional part are exact.
+            const double v = a * scale;
+            int64_t num = int64_t(v);
+            const double frac = v - double(num);
+            num += int64_t(frac >= 0.5) - int64_t(frac <= -0.5);
+
+            // Round half up to FRAC_BITS of (num << e) with 64 fractional
+            // bits, i.e., shift right by s = 64-FRAC_BITS-e with rounding, or
+            // left by -s without. The rounding adds the last bit shifted out,
+            // s_up is 1 if there is one.
+            const int64_t s = 64-FRAC_BITS-e;
+            const int64_t s_right = std::max<int64_t>(s, 0);
+            const int64_t s_half = std::max<int64_t>(s-1, 0);
+            const int64_t s_up = s_right - s_half;
+            const int64_t s_left = std::max<int64_t>(-s, 0);
+            const int64_t shifted = int64_t(uint64_t(num) << s_left);
+            const int64_t raw = ((shifted >> s_half) + s_up) >> s_up;
+            if CONSTEXPR (TOTAL_BITS < 64)
+            {
+                dst[i] = int64_t(uint64_t(raw) << (64-TOTAL_BITS))
+                    >> (64-TOTAL_BITS);
+            }
+            else
+            {
+                dst[i] = raw;
+            }
+        }
+        return all != 0;
+    }
+
+
     /*
      * Constexpr function for generating a fpint 128 bit data type with the
      * value 1 << N, where: 0 <= N < 128. N outside of that range is undefined
@@ -352,6 +450,163 @@ namespace detail
     {
         return static_cast<typename extend_int<T>::type>(a) * b;
     }
+
+
+    /*
+     * Number of trailing zero bits of a non-zero 128 bit integer.
+     */
+    static inline int ctz_128(__uint128_t a)
+    {
+        return uint64_t(a) ? __builtin_ctzll(uint64_t(a)) :
+                             64 + __builtin_ctzll(uint64_t(a >> 64));
+    }
+
+
+    /*
+     * Sign helpers of floor_div(), without comparisons of unsigned types
+     * against zero.
+     */
+    template <typename T>
+    static inline bool is_negative(T a)
+    {
+        if CONSTEXPR (T(-1) < T(0))
+            return a < 0;
+        else
+            return false;
+    }
+
+    template <typename T>
+    static inline T floor_fixup(T q, T r, T d)
+    {
+        // Truncated quotient q and remainder r to quotient rounded towards
+        // minus infinity.
+        if CONSTEXPR (T(-1) < T(0))
+            return q - T((r != 0) & ((r ^ d) < 0));
+        else
+            return q;
+    }
+
+
+    /*
+     * Division n/d of the integers n and d, which are the fixed point numbers
+     * of a division scaled to integers, rounded towards minus infinity. The
+     * dividend fits in N_BITS and the divisor in D_BITS bits. Divisors that
+     * are powers of two are applied as shifts, and operands that fit in 64 bits
+     * use the 64-bit hardware division instead of the 128-bit software
+     * division.
+     */
+    template <int N_BITS, int D_BITS, typename T>
+    static inline T floor_div(T n, T d)
+    {
+        using short_int = typename std::conditional<
+            (T(-1) < T(0)), int64_t, uint64_t>::type;
+        const bool negative = is_negative(d);
+        const __uint128_t abs_d = negative ? -__uint128_t(d) : __uint128_t(d);
+        if (abs_d != 0 && (abs_d & (abs_d - 1)) == 0)
+        {
+            // Power of two divisor.
+            return (negative ? T(-n) : n) >> ctz_128(abs_d);
+        }
+
+        constexpr bool FITS = N_BITS < 64 && D_BITS <= 64;
+        if (FITS || (n == T(short_int(n)) && d == T(short_int(d))))
+        {
+            const short_int q = short_int(n) / short_int(d);
+            const short_int r = short_int(n) % short_int(d);
+            return floor_fixup(q, r, short_int(d));
+        }
+        return floor_fixup(T(n / d), T(n % d), d);
+    }
+}
+
+
+/*
+ * Overflow policies of SignedFixedPoint. The policy selects what happens when a
+ * value outside of the number range is assigned to a number with fewer integer
+ * bits: OverflowWrap keeps the low bits (two's complement wrap-around, the
+ * behaviour of the VHDL types), OverflowSaturate clamps the value to the
+ * closest representable number and OverflowTrap terminates the program. The
+ * policy does not affect conversion from double or the result types of the
+ * arithmetic operators, which are exact and always use the default policy.
+ */
+struct OverflowWrap {};
+struct OverflowSaturate {};
+struct OverflowTrap {};
+
+
+/*
+ * Rounding policies of SignedFixedPoint. The policy selects how fractional bits
+ * are dropped when a value is assigned to a number with fewer fractional bits,
+ * e.g., when the result of a multiplication is assigned: RoundTruncate rounds
+ * towards minus infinity (the default, and the behaviour of the VHDL types),
+ * RoundHalfUp rounds to nearest with ties towards plus infinity,
+ * RoundConvergent rounds to nearest with ties to even and RoundStochastic
+ * rounds up with a probability equal to the dropped fraction. The rounding
+ * offset is added to the number in the narrowing assignment itself, before
+ * the bits are masked.
+ */
+struct RoundTruncate {};
+struct RoundHalfUp {};
+struct RoundConvergent {};
+struct RoundStochastic {};
+
+template <
+    int INT_BITS, int FRAC_BITS,
+    typename OVERFLOW_POLICY = OverflowWrap,
+    typename ROUNDING_POLICY = RoundTruncate >
+class SignedFixedPoint;
+
+
+namespace detail
+{
+    /*
+     * Per thread xorshift64* generator of the random bits of stochastic
+     * rounding. Every thread starts on its own stream, and the stream of the
+     * calling thread can be reseeded with seed_stochastic_rounding().
+     */
+    static inline uint64_t &stochastic_state() noexcept
+    {
+        static std::atomic<uint64_t> streams{ 0 };
+        thread_local uint64_t state =
+            (0x9e3779b97f4a7c15ull * (streams.fetch_add(1) + 1)) | 1;
+        return state;
+    }
+
+    static inline uint64_t stochastic_bits() noexcept
+    {
+        uint64_t &x = stochastic_state();
+        x ^= x >> 12;
+        x ^= x << 25;
+        x ^= x >> 27;
+        return x * 0x2545f4914f6cdd1dull;
+    }
+}
+
+
+/*
+ * Seed the stochastic rounding generator of the calling thread. The sequence of
+ * rounding decisions following the call only depends on the seed.
+ */
+static inline void seed_stochastic_rounding(uint64_t seed) noexcept
+{
+    detail::stochastic_state() = seed ? seed : 0x9e3779b97f4a7c15ull;
+}
+
+
+/*
+ * Seed of the stochastic rounding stream of the work item 'item', e.g., a row
+ * or a tile, of a render seeded with 'seed'. Renders on several threads seed
+ * the stream of every work item, so that the rounding decisions do not depend
+ * on which thread picks up the item and in what order.
+ */
+static inline uint64_t stochastic_rounding_seed(
+        uint64_t seed, uint64_t item) noexcept
+{
+    // splitmix64 finalizer of the combined seed.
+    uint64_t x = seed + 0x9e3779b97f4a7c15ull * (item + 1);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
 }
 
 
@@ -382,26 +637,32 @@ public:
      * fixed point numbers.
      */
     template<
-        int LHS_INT_BITS, int LHS_FRAC_BITS, template<int,int> class LHS,
-        int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE >
-    LHS<std::max(LHS_INT_BITS,RHS_INT_BITS)+1,
-        std::max(LHS_FRAC_BITS,RHS_FRAC_BITS) >
+        int LHS_INT_BITS, int LHS_FRAC_BITS,
+        template<int,int,typename...> class LHS,
+        int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE,
+    typename... LHS_POLICY >
+    LHS<detail::max_bits(LHS_INT_BITS,RHS_INT_BITS)+1,
+        detail::max_bits(LHS_FRAC_BITS,RHS_FRAC_BITS) >
     friend operator+(
-        const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
+        const LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &lhs,
         const BaseFixedPoint<RHS_INT_BITS,RHS_FRAC_BITS,RHS_INT_TYPE> &rhs);
 
     template<
-        int LHS_INT_BITS, int LHS_FRAC_BITS, template<int,int> class LHS,
-        int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE >
-    LHS<std::max(LHS_INT_BITS,RHS_INT_BITS)+1,
-        std::max(LHS_FRAC_BITS,RHS_FRAC_BITS) >
+        int LHS_INT_BITS, int LHS_FRAC_BITS,
+        template<int,int,typename...> class LHS,
+        int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE,
+    typename... LHS_POLICY >
+    LHS<detail::max_bits(LHS_INT_BITS,RHS_INT_BITS)+1,
+        detail::max_bits(LHS_FRAC_BITS,RHS_FRAC_BITS) >
     friend operator-(
-        const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
+        const LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &lhs,
         const BaseFixedPoint<RHS_INT_BITS,RHS_FRAC_BITS,RHS_INT_TYPE> &rhs);
 
-    template<int _INT_BITS, int _FRAC_BITS, template<int,int> class RHS>
-    friend RHS<_INT_BITS,_FRAC_BITS> operator-(
-        const RHS<_INT_BITS,_FRAC_BITS> &rhs);
+    template<
+        int _INT_BITS, int _FRAC_BITS, template<int,int,typename...> class RHS,
+        typename... RHS_POLICY >
+    friend RHS<_INT_BITS,_FRAC_BITS,RHS_POLICY...> operator-(
+        const RHS<_INT_BITS,_FRAC_BITS,RHS_POLICY...> &rhs);
 
 
     /*
@@ -409,19 +670,23 @@ public:
      * fixed point numbers.
      */
     template<
-        int LHS_INT_BITS, int LHS_FRAC_BITS, template<int,int> class LHS,
-        int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE >
+        int LHS_INT_BITS, int LHS_FRAC_BITS,
+        template<int,int,typename...> class LHS,
+        int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE,
+    typename... LHS_POLICY >
     friend LHS<LHS_INT_BITS+RHS_INT_BITS,LHS_FRAC_BITS+RHS_FRAC_BITS>
     operator*(
-        const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
+        const LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &lhs,
         const BaseFixedPoint<RHS_INT_BITS,RHS_FRAC_BITS,RHS_INT_TYPE> &rhs);
 
     template<
-        int LHS_INT_BITS, int LHS_FRAC_BITS, template<int,int> class LHS,
-        int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE >
+        int LHS_INT_BITS, int LHS_FRAC_BITS,
+        template<int,int,typename...> class LHS,
+        int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE,
+    typename... LHS_POLICY >
     friend LHS<LHS_INT_BITS+RHS_FRAC_BITS,LHS_FRAC_BITS-RHS_FRAC_BITS>
     operator/(
-        const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
+        const LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &lhs,
         const BaseFixedPoint<RHS_INT_BITS,RHS_FRAC_BITS,RHS_INT_TYPE> &rhs);
 
 
@@ -430,9 +695,11 @@ public:
      */
     template<
         int LHS_INT_BITS, int LHS_FRAC_BITS,
-        int RHS_INT_BITS, int RHS_FRAC_BITS, template<int,int> class RHS>
+        int RHS_INT_BITS, int RHS_FRAC_BITS,
+        template<int,int,typename...> class RHS,
+        typename... RHS_POLICY >
     friend RHS<LHS_INT_BITS,LHS_FRAC_BITS> rnd(
-        const RHS<RHS_INT_BITS, RHS_FRAC_BITS> &rhs);
+        const RHS<RHS_INT_BITS, RHS_FRAC_BITS, RHS_POLICY...> &rhs);
 
 
     /*
@@ -443,6 +710,18 @@ public:
     virtual _128_INT_TYPE get_num_sign_extended() const noexcept = 0;
 
 
+    /*
+     * Function for setting the underlying data type. Bits outside of the
+     * number range are truncated (fractional side) and sign extended.
+     */
+    void set_num(const _128_INT_TYPE &n) noexcept
+    {
+        this->num = n;
+        this->apply_bit_mask_frac();
+        this->set_num_sign_extended();
+    }
+
+
     /*
      * Function for setting the underlying data type to its sign extended
      * representation. This could have performance benefits over using
@@ -602,7 +881,9 @@ protected:
      */
     template <int _INT_BITS, int _FRAC_BITS, typename __128_INT_TYPE>
     friend class BaseFixedPoint;
-    template <int _INT_BITS, int _FRAC_BITS>
+    template <
+        int _INT_BITS, int _FRAC_BITS,
+        typename _OVERFLOW_POLICY, typename _ROUNDING_POLICY >
     friend class SignedFixedPoint;
     template <int _INT_BITS, int _FRAC_BITS>
     friend class UnsignedFixedPoint;
@@ -652,10 +933,24 @@ protected:
 /*
  * Signed fixed point data type.
  */
-template <int INT_BITS, int FRAC_BITS>
+template <
+    int INT_BITS, int FRAC_BITS,
+    typename OVERFLOW_POLICY, typename ROUNDING_POLICY >
 class SignedFixedPoint :
     public BaseFixedPoint<INT_BITS,FRAC_BITS,detail::fpint128_t>
 {
+    static_assert(
+        std::is_same<OVERFLOW_POLICY, OverflowWrap>::value ||
+        std::is_same<OVERFLOW_POLICY, OverflowSaturate>::value ||
+        std::is_same<OVERFLOW_POLICY, OverflowTrap>::value,
+        "Unknown overflow policy.");
+    static_assert(
+        std::is_same<ROUNDING_POLICY, RoundTruncate>::value ||
+        std::is_same<ROUNDING_POLICY, RoundHalfUp>::value ||
+        std::is_same<ROUNDING_POLICY, RoundConvergent>::value ||
+        std::is_same<ROUNDING_POLICY, RoundStochastic>::value,
+        "Unknown rounding policy.");
+
 public:
     SignedFixedPoint() = default;
 
@@ -666,16 +961,93 @@ public:
     explicit SignedFixedPoint(double a) { this->construct_from_double(a); }
 
 
+    /*
+     * Bulk conversion of 'n' doubles to fixed point numbers and back. The
+     * results are identical to those of the conversion constructor and the
+     * conversion operator. Formats of at most 64 bits, with at most 62
+     * fractional bits, convert from double with the vectorizable raw
+     * conversion of the detail namespace, and to double by scaling the raw
+     * number of every element in place. The latter is no faster than the
+     * conversion operator, which compiles to the same loop once inlined
+     * (--bench convert); it is kept as the counterpart of from_doubles().
+     */
+    static void from_doubles(
+            const double *src, SignedFixedPoint *dst, size_t n) noexcept
+    {
+        if CONSTEXPR (RAW_CONVERSION)
+        {
+            constexpr size_t BLOCK = 256;
+            int64_t raw[BLOCK];
+            for (size_t i=0; i<n; i+=BLOCK)
+            {
+                const size_t m = std::min(BLOCK, n-i);
+                const bool all =
+                    detail::doubles_to_raw<INT_BITS,FRAC_BITS>(src+i, raw, m);
+                for (size_t j=0; j<m; ++j)
+                {
+                    dst[i+j].set_raw(raw[j]);
+                }
+                for (size_t j=0; !all && j<m; ++j)
+                {
+                    if (!detail::raw_convertible(src[i+j]))
+                    {
+                        dst[i+j] = SignedFixedPoint(src[i+j]);
+                    }
+                }
+            }
+        }
+        else
+        {
+            for (size_t i=0; i<n; ++i)
+            {
+                dst[i] = SignedFixedPoint(src[i]);
+            }
+        }
+    }
+
+    static void to_doubles(
+            const SignedFixedPoint *src, double *dst, size_t n) noexcept
+    {
+        if CONSTEXPR (RAW_CONVERSION)
+        {
+            const double scale = std::ldexp(1.0, -FRAC_BITS);
+            for (size_t i=0; i<n; ++i)
+            {
+                dst[i] = double(src[i].get_raw()) * scale;
+            }
+        }
+        else
+        {
+            for (size_t i=0; i<n; ++i)
+            {
+                dst[i] = double(src[i]);
+            }
+        }
+    }
+
+
     /*
      * Copy assignment operator for signed fixed point numbers.
      */
     template <int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_128_INT_TYPE>
-    SignedFixedPoint<INT_BITS, FRAC_BITS> &
+    SignedFixedPoint &
     operator=(const BaseFixedPoint<
         RHS_INT_BITS,RHS_FRAC_BITS, RHS_128_INT_TYPE > &rhs) noexcept
     {
+        // Rounding up may carry into one more integer bit, which is then
+        // handled as an overflow of a one bit wider right hand side.
+        constexpr bool ROUNDS = FRAC_BITS < RHS_FRAC_BITS &&
+            !std::is_same<ROUNDING_POLICY, RoundTruncate>::value;
         this->num = rhs.num;
-        this->template assignment_common<RHS_INT_BITS,RHS_FRAC_BITS>();
+        if CONSTEXPR (ROUNDS)
+        {
+            this->apply_rounding_policy();
+        }
+        if CONSTEXPR (INT_BITS < RHS_INT_BITS + ROUNDS)
+        {
+            this->apply_overflow_policy();
+        }
+        this->template assignment_common<RHS_INT_BITS+ROUNDS,RHS_FRAC_BITS>();
         return *this;
     }
 
@@ -696,7 +1068,7 @@ public:
      * Assignment from other fixed point number with proper rounding.
      */
     template <int RHS_INT_BITS,int RHS_FRAC_BITS, typename RHS_128_INT_TYPE>
-    SignedFixedPoint<INT_BITS, FRAC_BITS> &
+    SignedFixedPoint &
         rnd(const BaseFixedPoint<
             RHS_INT_BITS,RHS_FRAC_BITS,RHS_128_INT_TYPE > &rhs)
     {
@@ -712,9 +1084,11 @@ public:
      * Friend declaration for saturation function.
      */
     template <
-        int LHS_INT_BITS,int LHS_FRAC_BITS,int RHS_INT_BITS,int RHS_FRAC_BITS>
+        int LHS_INT_BITS,int LHS_FRAC_BITS,int RHS_INT_BITS,int RHS_FRAC_BITS,
+        typename... RHS_POLICY>
     friend SignedFixedPoint<LHS_INT_BITS, LHS_FRAC_BITS> sat(
-            const SignedFixedPoint<RHS_INT_BITS, RHS_FRAC_BITS> &rhs);
+            const SignedFixedPoint<
+                RHS_INT_BITS, RHS_FRAC_BITS, RHS_POLICY...> &rhs);
 
 
     /*
@@ -770,6 +1144,107 @@ public:
 
 
 private:
+    /*
+     * Formats with a 64-bit raw representation, num >> (64-FRAC_BITS), used by
+     * the bulk conversions.
+     */
+    static constexpr bool RAW_CONVERSION =
+        INT_BITS >= 1 && FRAC_BITS >= 0 && FRAC_BITS <= 62 &&
+        INT_BITS+FRAC_BITS <= 64;
+
+    int64_t get_raw() const noexcept
+    {
+        if CONSTEXPR (FRAC_BITS == 0)
+        {
+            return this->num.table[1];
+        }
+        else
+        {
+            return int64_t( uint64_t(this->num.table[1]) << FRAC_BITS |
+                            uint64_t(this->num.table[0]) >> (64-FRAC_BITS) );
+        }
+    }
+
+    void set_raw(int64_t raw) noexcept
+    {
+        if CONSTEXPR (FRAC_BITS == 0)
+        {
+            this->num.table[1] = raw;
+            this->num.table[0] = 0;
+        }
+        else
+        {
+            this->num.table[1] = raw >> FRAC_BITS;
+            this->num.table[0] = int64_t(uint64_t(raw) << (64-FRAC_BITS));
+        }
+    }
+
+
+    /*
+     * Add the rounding offset of the rounding policy to num, before the
+     * fractional bits are masked by the assignment. With 2^D the weight of the
+     * least significant bit kept, the offset is 2^(D-1) for round-half-up,
+     * 2^(D-1)-1 plus the least significant bit kept for convergent rounding and
+     * D random bits for stochastic rounding. Truncation adds nothing.
+     */
+    void apply_rounding_policy() noexcept
+    {
+        using detail::fpint128_t;
+        constexpr int D = 64-FRAC_BITS;
+        if CONSTEXPR (std::is_same<ROUNDING_POLICY, RoundHalfUp>::value)
+        {
+            this->round();
+        }
+        else if CONSTEXPR (
+                std::is_same<ROUNDING_POLICY, RoundConvergent>::value)
+        {
+            const uint64_t lsb = FRAC_BITS > 0 ?
+                (uint64_t(this->num.table[0]) >> (D % 64)) & 1 :
+                uint64_t(this->num.table[1]) & 1;
+            this->num += fpint128_t{
+                { int64_t((1ull << (D-1)) - 1 + lsb), 0 } };
+        }
+        else if CONSTEXPR (
+                std::is_same<ROUNDING_POLICY, RoundStochastic>::value)
+        {
+            this->num += fpint128_t{
+                { int64_t(detail::stochastic_bits() >> (64-D)), 0 } };
+        }
+    }
+
+
+    /*
+     * Apply the overflow policy to num before it is sign extended (wrapped) by
+     * the assignment. Saturation is branch-free: the saturated value is
+     * selected with a mask built from the bits above the sign bit, so that the
+     * policy costs a few logic instructions in the hot loops.
+     */
+    void apply_overflow_policy() noexcept
+    {
+        if CONSTEXPR (std::is_same<OVERFLOW_POLICY, OverflowSaturate>::value)
+        {
+            static_assert(INT_BITS > 0,
+                "Saturation requires at least one integer bit.");
+            const int64_t top = this->num.table[1] >> (INT_BITS-1);
+            const uint64_t ovf = -uint64_t((top != 0) & (top != -1));
+            const uint64_t neg = uint64_t(this->num.table[1] >> 63);
+            const uint64_t MAX_INT = (1ull << (INT_BITS-1)) - 1;
+            this->num.table[1] =
+                (this->num.table[1] & ~ovf) | ((MAX_INT ^ neg) & ovf);
+            this->num.table[0] =
+                (this->num.table[0] & ~ovf) | (~neg & ovf);
+            this->apply_bit_mask_frac();
+        }
+        else if CONSTEXPR (std::is_same<OVERFLOW_POLICY, OverflowTrap>::value)
+        {
+            if (SignedFixedPoint::test_overflow())
+            {
+                __builtin_trap();
+            }
+        }
+    }
+
+
     /*
      * Get the sign of the number.
      */
@@ -874,10 +1349,13 @@ public:
  * Addition operator for fixed point numbers.
  */
 template<
-    int LHS_INT_BITS, int LHS_FRAC_BITS, template<int,int> class LHS,
-    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE >
-LHS<std::max(LHS_INT_BITS,RHS_INT_BITS)+1,std::max(LHS_FRAC_BITS,RHS_FRAC_BITS)>
-operator+(const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
+    int LHS_INT_BITS, int LHS_FRAC_BITS,
+    template<int,int,typename...> class LHS,
+    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE,
+    typename... LHS_POLICY >
+LHS<detail::max_bits(LHS_INT_BITS,RHS_INT_BITS)+1,
+    detail::max_bits(LHS_FRAC_BITS,RHS_FRAC_BITS)>
+operator+(const LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &lhs,
           const BaseFixedPoint<RHS_INT_BITS,RHS_FRAC_BITS,RHS_INT_TYPE> &rhs)
 {
     // Disallow arithmetic between signed and unsigned numbers.
@@ -887,8 +1365,8 @@ operator+(const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
         "Use explicit type conversion and convert LHS or RHS to a common type."
     );
 
-    constexpr int RES_INT_BITS = std::max(LHS_INT_BITS,RHS_INT_BITS)+1;
-    constexpr int RES_FRAC_BITS = std::max(LHS_FRAC_BITS,RHS_FRAC_BITS);
+    constexpr int RES_INT_BITS = detail::max_bits(LHS_INT_BITS,RHS_INT_BITS)+1;
+    constexpr int RES_FRAC_BITS = detail::max_bits(LHS_FRAC_BITS,RHS_FRAC_BITS);
     LHS<RES_INT_BITS,RES_FRAC_BITS> res{};
 
     // No sign extension or masking needed due to correct word length. The
@@ -901,10 +1379,12 @@ operator+(const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
 }
 
 template<
-    int LHS_INT_BITS, int LHS_FRAC_BITS, template<int,int> class LHS,
-    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE >
-LHS<LHS_INT_BITS,LHS_FRAC_BITS> &
-operator+=(LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
+    int LHS_INT_BITS, int LHS_FRAC_BITS,
+    template<int,int,typename...> class LHS,
+    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE,
+    typename... LHS_POLICY >
+LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &
+operator+=(LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &lhs,
            const BaseFixedPoint<RHS_INT_BITS,RHS_FRAC_BITS,RHS_INT_TYPE> &rhs)
 {
     // Sign extension and masking is performed in assigment operator.
@@ -916,10 +1396,13 @@ operator+=(LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
  * Subtraction operator for fixed point numbers.
  */
 template<
-    int LHS_INT_BITS, int LHS_FRAC_BITS, template<int,int> class LHS,
-    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE >
-LHS<std::max(LHS_INT_BITS,RHS_INT_BITS)+1,std::max(LHS_FRAC_BITS,RHS_FRAC_BITS)>
-operator-(const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
+    int LHS_INT_BITS, int LHS_FRAC_BITS,
+    template<int,int,typename...> class LHS,
+    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE,
+    typename... LHS_POLICY >
+LHS<detail::max_bits(LHS_INT_BITS,RHS_INT_BITS)+1,
+    detail::max_bits(LHS_FRAC_BITS,RHS_FRAC_BITS)>
+operator-(const LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &lhs,
           const BaseFixedPoint<RHS_INT_BITS,RHS_FRAC_BITS,RHS_INT_TYPE> &rhs)
 {
     // Disallow arithmetic between signed and unsigned numbers.
@@ -929,8 +1412,8 @@ operator-(const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
         "Use explicit type conversion and convert LHS or RHS to a common type."
     );
 
-    constexpr int RES_INT_BITS = std::max(LHS_INT_BITS,RHS_INT_BITS)+1;
-    constexpr int RES_FRAC_BITS = std::max(LHS_FRAC_BITS,RHS_FRAC_BITS);
+    constexpr int RES_INT_BITS = detail::max_bits(LHS_INT_BITS,RHS_INT_BITS)+1;
+    constexpr int RES_FRAC_BITS = detail::max_bits(LHS_FRAC_BITS,RHS_FRAC_BITS);
     LHS<RES_INT_BITS,RES_FRAC_BITS> res{};
 
     // No sign extension or masking needed due to correct word length. The
@@ -943,10 +1426,12 @@ operator-(const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
 }
 
 template<
-    int LHS_INT_BITS, int LHS_FRAC_BITS, template<int,int> class LHS,
-    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE >
-LHS<LHS_INT_BITS,LHS_FRAC_BITS> &
-operator-=(LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
+    int LHS_INT_BITS, int LHS_FRAC_BITS,
+    template<int,int,typename...> class LHS,
+    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE,
+    typename... LHS_POLICY >
+LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &
+operator-=(LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &lhs,
            const BaseFixedPoint<RHS_INT_BITS,RHS_FRAC_BITS,RHS_INT_TYPE> &rhs)
 {
     // Sign extension and masking is performed in assigment operator.
@@ -958,10 +1443,12 @@ operator-=(LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
  * Multiplication operator for fixed point numbers.
  */
 template<
-    int LHS_INT_BITS, int LHS_FRAC_BITS, template<int,int> class LHS,
-    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE >
+    int LHS_INT_BITS, int LHS_FRAC_BITS,
+    template<int,int,typename...> class LHS,
+    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE,
+    typename... LHS_POLICY >
 LHS<LHS_INT_BITS+RHS_INT_BITS,LHS_FRAC_BITS+RHS_FRAC_BITS>
-operator*(const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
+operator*(const LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &lhs,
           const BaseFixedPoint<RHS_INT_BITS,RHS_FRAC_BITS,RHS_INT_TYPE> &rhs)
 {
     // Disallow arithmetic between signed and unsigned numbers.
@@ -1081,10 +1568,12 @@ operator*(const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
 
 
 template<
-    int LHS_INT_BITS, int LHS_FRAC_BITS, template<int,int> class LHS,
-    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE >
-LHS<LHS_INT_BITS,LHS_FRAC_BITS> &
-operator*=(LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
+    int LHS_INT_BITS, int LHS_FRAC_BITS,
+    template<int,int,typename...> class LHS,
+    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE,
+    typename... LHS_POLICY >
+LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &
+operator*=(LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &lhs,
            const BaseFixedPoint<RHS_INT_BITS,RHS_FRAC_BITS,RHS_INT_TYPE> &rhs)
 {
     // Sign extension and masking is performed in assigment operator.
@@ -1096,10 +1585,12 @@ operator*=(LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
  * Division operator for fixed point numbers.
  */
 template<
-    int LHS_INT_BITS, int LHS_FRAC_BITS, template<int,int> class LHS,
-    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE >
+    int LHS_INT_BITS, int LHS_FRAC_BITS,
+    template<int,int,typename...> class LHS,
+    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE,
+    typename... LHS_POLICY >
 LHS<LHS_INT_BITS+RHS_FRAC_BITS,LHS_FRAC_BITS-RHS_FRAC_BITS>
-operator/(const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
+operator/(const LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &lhs,
           const BaseFixedPoint<RHS_INT_BITS,RHS_FRAC_BITS,RHS_INT_TYPE> &rhs)
 {
     // Disallow arithmetic between signed and unsigned numbers.
@@ -1114,6 +1605,31 @@ operator/(const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
         typename detail::narrow_int<typename LHS<1,0>::int_type>::type >::type;
     LHS<LHS_INT_BITS+RHS_FRAC_BITS,LHS_FRAC_BITS-RHS_FRAC_BITS> res{};
 
+    /*
+     * When the operands have at most 128 bits together, no bits of the
+     * quotient below the result are needed and the division reduces to a
+     * division of the operands scaled to integers, rounded towards minus
+     * infinity, see detail::floor_div(). The result is identical to that of
+     * the general 128-bit division below.
+     */
+    constexpr int LHS_TOTAL_BITS = LHS_INT_BITS+LHS_FRAC_BITS;
+    constexpr int RHS_TOTAL_BITS = RHS_INT_BITS+RHS_FRAC_BITS;
+    constexpr int RES_FRAC_BITS = LHS_FRAC_BITS-RHS_FRAC_BITS;
+    if CONSTEXPR (LHS_TOTAL_BITS+RHS_TOTAL_BITS <= 128)
+    {
+        int_type lhs_int = lhs.num.table[1];
+        int_type lhs_long = lhs_int << 64 | uint64_t(lhs.num.table[0]);
+        int_type rhs_int = rhs.num.table[1];
+        int_type rhs_long = rhs_int << 64 | uint64_t(rhs.num.table[0]);
+        int_type res_long =
+            detail::floor_div<LHS_TOTAL_BITS,RHS_TOTAL_BITS>(
+                lhs_long >> (64-LHS_FRAC_BITS), rhs_long >> (64-RHS_FRAC_BITS));
+        res_long <<= 64-RES_FRAC_BITS;
+        res.num.table[1] = res_long >> 64;
+        res.num.table[0] = res_long;
+        return res;
+    }
+
     // Extract LHS num to 128-bit integer.
     int_type lhs_int = uint64_t(lhs.num.table[1]);
     int_type lhs_long = lhs_int << 64 | uint64_t(lhs.num.table[0]);
@@ -1146,10 +1662,12 @@ operator/(const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
 
 
 template<
-    int LHS_INT_BITS, int LHS_FRAC_BITS, template<int,int> class LHS,
-    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE >
-LHS<LHS_INT_BITS,LHS_FRAC_BITS> &
-operator/=(LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
+    int LHS_INT_BITS, int LHS_FRAC_BITS,
+    template<int,int,typename...> class LHS,
+    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE,
+    typename... LHS_POLICY >
+LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &
+operator/=(LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &lhs,
            const BaseFixedPoint<RHS_INT_BITS,RHS_FRAC_BITS,RHS_INT_TYPE> &rhs)
 {
     // Sign extension and masking is performed in assigment operator.
@@ -1157,64 +1675,207 @@ operator/=(LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
 }
 
 
+/*
+ * Divisor prepared for repeated division by the same fixed point number. The
+ * divisor is classified once: powers of two divide with a shift and other
+ * divisors with a multiplication by a precomputed reciprocal (round-up method
+ * of Granlund and Montgomery), falling back to detail::floor_div() for
+ * dividends that do not fit in 64 bits. The quotients are identical to those
+ * of operator/.
+ */
+template <int INT_BITS, int FRAC_BITS, typename _128_INT_TYPE>
+class FixedPointDivisor
+{
+public:
+    using int_type = typename detail::extend_int<
+        typename detail::narrow_int<_128_INT_TYPE>::type >::type;
+
+    explicit FixedPointDivisor(
+            const BaseFixedPoint<INT_BITS,FRAC_BITS,_128_INT_TYPE> &d) noexcept
+    {
+        _128_INT_TYPE num = d.get_num();
+        int_type num_int = num.table[1];
+        divisor = (num_int << 64 | uint64_t(num.table[0])) >> (64-FRAC_BITS);
+        negative = detail::is_negative(divisor);
+        abs_divisor = negative ? -__uint128_t(divisor) : __uint128_t(divisor);
+        pow2 = abs_divisor != 0 && (abs_divisor & (abs_divisor - 1)) == 0;
+        reciprocal = !pow2 && abs_divisor > 1 && (abs_divisor >> 63) == 0;
+        if (pow2)
+        {
+            shift = detail::ctz_128(abs_divisor);
+        }
+        else if (reciprocal)
+        {
+            // m = ceil(2^(63+l) / d), with l = ceil(log2(d)), fits 64 bits.
+            const int l = 64 - __builtin_clzll(uint64_t(abs_divisor - 1));
+            shift = 63 + l;
+            magic = uint64_t(
+                ((__uint128_t(1) << shift) - 1) / abs_divisor + 1);
+        }
+    }
+
+    /*
+     * Division of the integer n by the divisor scaled to an integer, rounded
+     * towards minus infinity, see detail::floor_div(). The dividend fits in
+     * N_BITS bits.
+     */
+    template <int N_BITS>
+    int_type divide(int_type n) const noexcept
+    {
+        constexpr int D_BITS = INT_BITS+FRAC_BITS;
+        if (pow2)
+        {
+            return (negative ? int_type(-n) : n) >> shift;
+        }
+        const bool n_negative = detail::is_negative(n);
+        const __uint128_t abs_n = n_negative ? -__uint128_t(n) : __uint128_t(n);
+        if (reciprocal && (abs_n >> 63) == 0)
+        {
+            const uint64_t q = uint64_t((abs_n * magic) >> shift);
+            const uint64_t r = uint64_t(abs_n) - q * uint64_t(abs_divisor);
+            if (n_negative != negative)
+            {
+                return -int_type(q) - int_type(r != 0);
+            }
+            return int_type(q);
+        }
+        return detail::floor_div<N_BITS,D_BITS>(n, divisor);
+    }
+
+private:
+    int_type divisor{};
+    __uint128_t abs_divisor{};
+    bool negative{};
+    bool pow2{};
+    bool reciprocal{};
+    int shift{};
+    uint64_t magic{};
+};
+
+
+/*
+ * Prepare the fixed point number 'd' for repeated division.
+ */
+template <int INT_BITS, int FRAC_BITS, typename _128_INT_TYPE>
+FixedPointDivisor<INT_BITS,FRAC_BITS,_128_INT_TYPE> make_divisor(
+        const BaseFixedPoint<INT_BITS,FRAC_BITS,_128_INT_TYPE> &d) noexcept
+{
+    return FixedPointDivisor<INT_BITS,FRAC_BITS,_128_INT_TYPE>{ d };
+}
+
+
+/*
+ * Division operator for fixed point numbers by a prepared divisor. The result
+ * is identical to that of the division by the fixed point number itself.
+ */
+template<
+    int LHS_INT_BITS, int LHS_FRAC_BITS,
+    template<int,int,typename...> class LHS,
+    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE,
+    typename... LHS_POLICY >
+LHS<LHS_INT_BITS+RHS_FRAC_BITS,LHS_FRAC_BITS-RHS_FRAC_BITS>
+operator/(const LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &lhs,
+          const FixedPointDivisor<RHS_INT_BITS,RHS_FRAC_BITS,RHS_INT_TYPE> &rhs)
+{
+    // Disallow arithmetic between signed and unsigned numbers.
+    static_assert(
+        std::is_same<RHS_INT_TYPE, decltype(lhs.get_num()) >::value,
+        "Arithmetic between signed and unsigned fixed point types disallowed. "
+        "Use explicit type conversion and convert LHS or RHS to a common type."
+    );
+    constexpr int LHS_TOTAL_BITS = LHS_INT_BITS+LHS_FRAC_BITS;
+    constexpr int RHS_TOTAL_BITS = RHS_INT_BITS+RHS_FRAC_BITS;
+    static_assert(LHS_TOTAL_BITS+RHS_TOTAL_BITS <= 128,
+        "Prepared divisors need operands of at most 128 bits together.");
+
+    using int_type = typename FixedPointDivisor<
+        RHS_INT_BITS,RHS_FRAC_BITS,RHS_INT_TYPE>::int_type;
+    const RHS_INT_TYPE num = lhs.get_num();
+    int_type lhs_int = num.table[1];
+    int_type lhs_long = lhs_int << 64 | uint64_t(num.table[0]);
+    int_type res_long = rhs.template divide<LHS_TOTAL_BITS>(
+        lhs_long >> (64-LHS_FRAC_BITS));
+    res_long <<= 64-(LHS_FRAC_BITS-RHS_FRAC_BITS);
+
+    RHS_INT_TYPE res_num{};
+    res_num.table[1] = res_long >> 64;
+    res_num.table[0] = res_long;
+    LHS<LHS_INT_BITS+RHS_FRAC_BITS,LHS_FRAC_BITS-RHS_FRAC_BITS> res{};
+    res.set_num(res_num);
+    return res;
+}
+
+
 /*
  * Comparison operators for fixed point numbers.
  */
 template<
-    int LHS_INT_BITS, int LHS_FRAC_BITS, template<int,int> class LHS,
-    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE >
+    int LHS_INT_BITS, int LHS_FRAC_BITS,
+    template<int,int,typename...> class LHS,
+    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE,
+    typename... LHS_POLICY >
 bool operator==(
-        const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
+        const LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &lhs,
         const BaseFixedPoint<RHS_INT_BITS, RHS_FRAC_BITS, RHS_INT_TYPE> &rhs)
 {
     return lhs.get_num() == rhs.get_num();
 }
 
 template<
-    int LHS_INT_BITS, int LHS_FRAC_BITS, template<int,int> class LHS,
-    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE >
+    int LHS_INT_BITS, int LHS_FRAC_BITS,
+    template<int,int,typename...> class LHS,
+    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE,
+    typename... LHS_POLICY >
 bool operator!=(
-        const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
+        const LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &lhs,
         const BaseFixedPoint<RHS_INT_BITS, RHS_FRAC_BITS, RHS_INT_TYPE> &rhs)
 {
     return lhs.get_num() != rhs.get_num();
 }
 
 template<
-    int LHS_INT_BITS, int LHS_FRAC_BITS, template<int,int> class LHS,
-    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE >
+    int LHS_INT_BITS, int LHS_FRAC_BITS,
+    template<int,int,typename...> class LHS,
+    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE,
+    typename... LHS_POLICY >
 bool operator<(
-        const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
+        const LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &lhs,
         const BaseFixedPoint<RHS_INT_BITS, RHS_FRAC_BITS, RHS_INT_TYPE> &rhs)
 {
     return lhs.get_num() < rhs.get_num();
 }
 
 template<
-    int LHS_INT_BITS, int LHS_FRAC_BITS, template<int,int> class LHS,
-    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE >
+    int LHS_INT_BITS, int LHS_FRAC_BITS,
+    template<int,int,typename...> class LHS,
+    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE,
+    typename... LHS_POLICY >
 bool operator<=(
-        const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
+        const LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &lhs,
         const BaseFixedPoint<RHS_INT_BITS, RHS_FRAC_BITS, RHS_INT_TYPE> &rhs)
 {
     return lhs.get_num() <= rhs.get_num();
 }
 
 template<
-    int LHS_INT_BITS, int LHS_FRAC_BITS, template<int,int> class LHS,
-    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE >
+    int LHS_INT_BITS, int LHS_FRAC_BITS,
+    template<int,int,typename...> class LHS,
+    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE,
+    typename... LHS_POLICY >
 bool operator>(
-        const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
+        const LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &lhs,
         const BaseFixedPoint<RHS_INT_BITS, RHS_FRAC_BITS, RHS_INT_TYPE> &rhs)
 {
     return lhs.get_num() > rhs.get_num();
 }
 
 template<
-    int LHS_INT_BITS, int LHS_FRAC_BITS, template<int,int> class LHS,
-    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE >
+    int LHS_INT_BITS, int LHS_FRAC_BITS,
+    template<int,int,typename...> class LHS,
+    int RHS_INT_BITS, int RHS_FRAC_BITS, typename RHS_INT_TYPE,
+    typename... LHS_POLICY >
 bool operator>=(
-        const LHS<LHS_INT_BITS,LHS_FRAC_BITS> &lhs,
+        const LHS<LHS_INT_BITS,LHS_FRAC_BITS,LHS_POLICY...> &lhs,
         const BaseFixedPoint<RHS_INT_BITS, RHS_FRAC_BITS, RHS_INT_TYPE> &rhs)
 {
     return lhs.get_num() >= rhs.get_num();
@@ -1224,10 +1885,13 @@ bool operator>=(
 /*
  * Unary negation of fixed point numbers.
  */
-template<int INT_BITS, int FRAC_BITS, template<int,int> class RHS>
-RHS<INT_BITS,FRAC_BITS> operator-(const RHS<INT_BITS,FRAC_BITS> &rhs)
+template<
+    int INT_BITS, int FRAC_BITS, template<int,int,typename...> class RHS,
+    typename... RHS_POLICY >
+RHS<INT_BITS,FRAC_BITS,RHS_POLICY...> operator-(
+        const RHS<INT_BITS,FRAC_BITS,RHS_POLICY...> &rhs)
 {
-    RHS<INT_BITS,FRAC_BITS> res{};
+    RHS<INT_BITS,FRAC_BITS,RHS_POLICY...> res{};
     res.num.table[1] = ~rhs.num.table[1];
     res.num.table[0] = ~rhs.num.table[0];
     res.num.table[0] += 1;
@@ -1243,8 +1907,11 @@ RHS<INT_BITS,FRAC_BITS> operator-(const RHS<INT_BITS,FRAC_BITS> &rhs)
  */
 template<
     int LHS_INT_BITS, int LHS_FRAC_BITS,
-    int RHS_INT_BITS, int RHS_FRAC_BITS, template<int,int> class RHS>
-RHS<LHS_INT_BITS,LHS_FRAC_BITS> rnd(const RHS<RHS_INT_BITS, RHS_FRAC_BITS> &rhs)
+    int RHS_INT_BITS, int RHS_FRAC_BITS,
+    template<int,int,typename...> class RHS,
+    typename... RHS_POLICY >
+RHS<LHS_INT_BITS,LHS_FRAC_BITS> rnd(
+        const RHS<RHS_INT_BITS, RHS_FRAC_BITS, RHS_POLICY...> &rhs)
 {
     RHS<LHS_INT_BITS, LHS_FRAC_BITS> res{};
     res.num = rhs.num;
@@ -1258,9 +1925,11 @@ RHS<LHS_INT_BITS,LHS_FRAC_BITS> rnd(const RHS<RHS_INT_BITS, RHS_FRAC_BITS> &rhs)
 /*
  * Saturation for signed fixed point numbers.
  */
-template <int LHS_INT_BITS,int LHS_FRAC_BITS,int RHS_INT_BITS,int RHS_FRAC_BITS>
+template <
+    int LHS_INT_BITS,int LHS_FRAC_BITS,int RHS_INT_BITS,int RHS_FRAC_BITS,
+    typename... RHS_POLICY>
 SignedFixedPoint<LHS_INT_BITS, LHS_FRAC_BITS> sat(
-        const SignedFixedPoint<RHS_INT_BITS, RHS_FRAC_BITS> &rhs)
+        const SignedFixedPoint<RHS_INT_BITS, RHS_FRAC_BITS, RHS_POLICY...> &rhs)
 {
     SignedFixedPoint<LHS_INT_BITS, LHS_FRAC_BITS> res{};
     res.num = rhs.get_num_sign_extended();
@@ -1294,9 +1963,11 @@ SignedFixedPoint<LHS_INT_BITS, LHS_FRAC_BITS> sat(
  * Print-out to C++ stream object on the form '<int> + <frac>/<2^<frac_bits>'.
  * Good for debuging'n'stuff.
  */
-template <int INT_BITS, int FRAC_BITS, template<int,int> class RHS>
+template <
+    int INT_BITS, int FRAC_BITS, template<int,int,typename...> class RHS,
+    typename... RHS_POLICY >
 std::ostream &operator<<(
-        std::ostream &os, const RHS<INT_BITS, FRAC_BITS> &rhs)
+        std::ostream &os, const RHS<INT_BITS, FRAC_BITS, RHS_POLICY...> &rhs)
 {
     return os << rhs.to_string();
 }
@@ -0,0 +1,273 @@
+#ifndef _ADAPTIVE_H
+#define _ADAPTIVE_H
+
+#include "render.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <SDL/SDL.h>
+
+
+/*
+ * Adaptive iteration limits. A single iteration limit is either wasted on
+ * interior pixels far from the boundary or too low for the pixels at the
+ * boundary of deep frames. Here every sample starts with a low limit, and
+ * only the samples of unresolved pixels next to escaped ones, the boundary,
+ * are continued from their saved z with twice the limit, until the set of
+ * unresolved boundary pixels stabilizes or the maximum limit is reached.
+ * Samples that are continued give the same escape results as with their
+ * final limit from the start, see escape_lanes().
+ */
+struct adaptive_config_t
+{
+    unsigned initial_iterations{ 64 };  // Iteration limit of the first pass
+    double tolerance{ 0.01 };           // Share of the boundary samples that
+                                        // must escape to raise the limit
+                                        // again
+};
+
+
+struct adaptive_stats_t
+{
+    unsigned iterations;        // Final iteration limit
+    int rounds;                 // Number of escalations
+    uint64_t boundary;          // Unresolved boundary pixels of the last round
+    uint64_t steps;             // Escape iterations performed
+    uint64_t samples;           // Samples that were iterated
+};
+
+
+/*
+ * Render a segment of the madelbrot set to the SDL_Surface pointed to by surf
+ * with adaptive iteration limits of at most ITERATIONS. The SDL_Surface object
+ * should have its surface locked with SDL_LockSurface before calling this
+ * function. The escape results and colors of all samples that escape within
+ * their final limit are identical to those of render(), and samples that did
+ * not escape are colored as within the set.
+ */
+template <int INT, int FRAC, typename POLICY, typename ROUNDING>
+void render_adaptive(
+        const segment_t<SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>> &seg,
+        const int WIDTH, const int HEIGHT, const bool SUPERSAMPLE,
+        const unsigned ITERATIONS, SDL_Surface *surf,
+        const adaptive_config_t &config, adaptive_stats_t &stats,
+        lane_stats_t *lane_stats = nullptr)
+{
+    using REAL_TYPE = SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>;
+    enum : uint8_t { ALIVE, ESCAPED, INTERIOR };
+
+    const pixel_grid<REAL_TYPE> grid{ seg, WIDTH, HEIGHT };
+    raw_sample_points<INT,FRAC,POLICY,ROUNDING> points{
+        grid, WIDTH, SUPERSAMPLE };
+    const int S = SUPERSAMPLE ? 4 : 1;
+    const int n = WIDTH * S;     // Samples per row
+    std::vector<int64_t> re(n), im(n);
+    std::vector<uint8_t> interior(n);
+    std::vector<int> queue(n);
+
+    // Escape state and status of every sample, in archive order.
+    std::vector<raw_escape_t> state(size_t(WIDTH) * HEIGHT * S);
+    std::vector<uint8_t> status(state.size(), ALIVE);
+
+    // First pass over all samples with the initial limit.
+    unsigned iterations = std::min(config.initial_iterations, ITERATIONS);
+    for (int y=0; y<HEIGHT; ++y)
+    {
+        points(0, WIDTH, y, re.data(), im.data());
+        filter_interior<INT,FRAC,POLICY,ROUNDING>(
+            re.data(), im.data(), n, interior.data(), FILTER_EXTRA_BULBS);
+        const int count = compact_lanes(interior.data(), n, queue.data());
+        raw_escape_t *row = &state[size_t(y)*n];
+        uint8_t *row_status = &status[size_t(y)*n];
+        escape_lanes<INT,FRAC,POLICY,ROUNDING>(
+            re.data(), im.data(), queue.data(), count, iterations, row,
+            lane_stats);
+        for (int i=0; i<n; ++i)
+        {
+            row_status[i] = interior[i] ? INTERIOR :
+                row[i].iteration < iterations ? ESCAPED : ALIVE;
+        }
+    }
+
+    // Pixel predicates on the status of its samples.
+    auto has = [&](int p, uint8_t st)
+    {
+        const uint8_t *s = &status[size_t(p)*S];
+        return std::find(s, s + S, st) != s + S;
+    };
+    auto near_escaped = [&](int p)
+    {
+        const int x = p % WIDTH, y = p / WIDTH;
+        for (int v=std::max(0, y-1); v<=std::min(HEIGHT-1, y+1); ++v)
+        {
+            for (int u=std::max(0, x-1); u<=std::min(WIDTH-1, x+1); ++u)
+            {
+                if (has(v*WIDTH + u, ESCAPED))
+                    return true;
+            }
+        }
+        return false;
+    };
+    auto pending = [&](int p)
+    {
+        for (int i=p*S; i<(p+1)*S; ++i)
+        {
+            if (status[i] == ALIVE && state[i].iteration < iterations)
+                return true;
+        }
+        return false;
+    };
+
+    // Continue the pending samples of the pixels 'pixels'. The samples are
+    // gathered into one queue, so the lanes stay busy across rows. Samples
+    // that escape are counted in 'resolved'.
+    int64_t resolved = 0;
+    std::vector<int64_t> c_re{}, c_im{};
+    std::vector<raw_escape_t> gathered{};
+    std::vector<size_t> index{};
+    std::vector<int> order{};
+    auto continue_pixels = [&](const std::vector<int> &pixels)
+    {
+        c_re.clear();
+        c_im.clear();
+        gathered.clear();
+        index.clear();
+        for (int p : pixels)
+        {
+            const int x = p % WIDTH, y = p / WIDTH;
+            points(x, 1, y, re.data(), im.data());
+            for (int s=0; s<S; ++s)
+            {
+                const size_t j = size_t(p)*S + s;
+                if (status[j] == ALIVE && state[j].iteration < iterations)
+                {
+                    c_re.push_back(re[s]);
+                    c_im.push_back(im[s]);
+                    gathered.push_back(state[j]);
+                    index.push_back(j);
+                }
+            }
+        }
+        order.resize(index.size());
+        for (size_t k=0; k<order.size(); ++k)
+        {
+            order[k] = int(k);
+        }
+        escape_lanes<INT,FRAC,POLICY,ROUNDING>(
+            c_re.data(), c_im.data(), order.data(), int(order.size()),
+            iterations, gathered.data(), lane_stats, gathered.data());
+        for (size_t k=0; k<index.size(); ++k)
+        {
+            state[index[k]] = gathered[k];
+            status[index[k]] =
+                gathered[k].iteration < iterations ? ESCAPED : ALIVE;
+            resolved += status[index[k]] == ESCAPED;
+        }
+    };
+
+    // Escalate the limit of the boundary pixels. At every limit the boundary
+    // is first continued until no further pixel escapes, since an escaped
+    // pixel makes its unresolved neighbors part of the boundary.
+    const int pixels = WIDTH * HEIGHT;
+    std::vector<uint32_t> queued_in(pixels, 0);
+    std::vector<int> frontier{}, next{};
+    uint32_t wave = 0;
+    int64_t previous = 0;
+    stats.rounds = 0;
+    while (true)
+    {
+        frontier.clear();
+        for (int p=0; p<pixels; ++p)
+        {
+            if (pending(p) && near_escaped(p))
+            {
+                frontier.push_back(p);
+            }
+        }
+        while (!frontier.empty())
+        {
+            continue_pixels(frontier);
+            ++wave;
+            next.clear();
+            for (int p : frontier)
+            {
+                if (!has(p, ESCAPED))
+                    continue;
+                const int x = p % WIDTH, y = p / WIDTH;
+                for (int v=std::max(0, y-1); v<=std::min(HEIGHT-1, y+1); ++v)
+                {
+                    for (int u=std::max(0, x-1); u<=std::min(WIDTH-1, x+1);
+                         ++u)
+                    {
+                        const int q = v*WIDTH + u;
+                        if (queued_in[q] != wave && pending(q))
+                        {
+                            queued_in[q] = wave;
+                            next.push_back(q);
+                        }
+                    }
+                }
+            }
+            frontier.swap(next);
+        }
+
+        // Unresolved boundary pixels and samples at this limit. The boundary
+        // is stable once raising the limit resolved only a small share of it.
+        int64_t count = 0, boundary_samples = 0;
+        for (int p=0; p<pixels; ++p)
+        {
+            if (has(p, ALIVE) && near_escaped(p))
+            {
+                ++count;
+                const uint8_t *s = &status[size_t(p)*S];
+                boundary_samples += std::count(s, s + S, ALIVE);
+            }
+        }
+        stats.boundary = count;
+        if (iterations == ITERATIONS || count == 0 || (stats.rounds > 0 &&
+                resolved <= config.tolerance*previous))
+        {
+            break;
+        }
+        previous = boundary_samples;
+        resolved = 0;
+        iterations = iterations > ITERATIONS/2 ? ITERATIONS : 2*iterations;
+        ++stats.rounds;
+    }
+    stats.iterations = iterations;
+
+    // Color the pixels from the escape results.
+    const escape_t IN_SET{ ITERATIONS, 0.0 };
+    stats.steps = 0;
+    stats.samples = 0;
+    for (int y=0; y<HEIGHT; ++y)
+    {
+        points(0, WIDTH, y, re.data(), im.data());
+        uint32_t *px = (uint32_t *)((uint8_t *)surf->pixels + y*surf->pitch);
+        for (int x=0; x<WIDTH; ++x)
+        {
+            escape_t res[4]{ IN_SET, IN_SET, IN_SET, IN_SET };
+            for (int s=0; s<S; ++s)
+            {
+                const int i = x*S + s;
+                const raw_escape_t &r = state[size_t(y)*n + i];
+                const uint8_t st = status[size_t(y)*n + i];
+                stats.steps += r.iteration;
+                stats.samples += st != INTERIOR;
+                if (st == ESCAPED)
+                {
+                    res[s].iteration = r.iteration;
+                    res[s].conv = get_convergence_value_raw<
+                        INT,FRAC,POLICY,ROUNDING>(
+                        r.iteration, r.z_re, r.z_im, re[i], im[i]);
+                }
+            }
+            SDL_Color c = SUPERSAMPLE ?
+                get_average_color(res, ITERATIONS) :
+                get_escape_color(res[0], ITERATIONS);
+            px[x] = SDL_MapRGB(surf->format, c.r, c.g, c.b);
+        }
+    }
+}
+
+#endif
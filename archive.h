@@ -0,0 +1,261 @@
+#ifndef _ARCHIVE_H
+#define _ARCHIVE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/*
+ * Iteration-count archive. An archive stores the escape results of a rendered
+ * frame, so that the frame can be re-colored without performing any escape
+ * iterations. The file consists of an archive_header_t followed by
+ * (width*height*samples) archive_sample_t records in row-major pixel order,
+ * with the super samples of a pixel stored consecutively.
+ */
+constexpr char ARCHIVE_MAGIC[8] = { 'M', 'F', 'P', 'A', 'R', 'C', 'H', '\0' };
+constexpr uint32_t ARCHIVE_VERSION = 1;
+
+
+/*
+ * Number format of the rendered frame.
+ */
+enum archive_format_t : uint32_t
+{
+    ARCHIVE_FORMAT_DOUBLE = 0,      // Double-precision floating-point
+    ARCHIVE_FORMAT_FIXED = 1,       // SignedFixedPoint<int_bits,frac_bits>
+};
+
+
+/*
+ * Archive file header. The viewport is stored in double precision, which is
+ * exact for all fixed point formats with less than 53 bits.
+ */
+struct archive_header_t
+{
+    char magic[8];          // ARCHIVE_MAGIC
+    uint32_t version;       // ARCHIVE_VERSION
+    uint32_t format;        // archive_format_t
+    int32_t int_bits;       // Fixed point integer bits
+    int32_t frac_bits;      // Fixed point fractional bits
+    uint32_t width;         // Image width in pixels
+    uint32_t height;        // Image height in pixels
+    uint32_t samples;       // Samples per pixel (1 or 4)
+    uint32_t iterations;    // Iteration limit of the render
+    double center_re;       // Segment center, real part
+    double center_im;       // Segment center, imaginary part
+    double w;               // Segment width
+    double h;               // Segment height
+};
+
+
+/*
+ * Archive sample record. The continuous convergence value of a sample is
+ * (iteration + smooth). Samples with 'iteration' equal to the iteration limit
+ * of the header did not escape.
+ */
+struct archive_sample_t
+{
+    uint32_t iteration;     // Escape iteration
+    float smooth;           // Convergence value relative to 'iteration'
+};
+
+
+/*
+ * Sequential archive writer. Samples must be written in archive order. An
+ * archive opened without a file name is kept in memory, see samples().
+ */
+class archive_writer
+{
+public:
+    archive_writer() = default;
+    archive_writer(const archive_writer &) = delete;
+    archive_writer &operator=(const archive_writer &) = delete;
+    ~archive_writer() { close(); }
+
+    /*
+     * Open the archive file 'filename' for writing and write the header. The
+     * function returns false on failure.
+     */
+    bool open(const char *filename, const archive_header_t &header)
+    {
+        close();
+        file = std::fopen(filename, "wb");
+        if (!file)
+        {
+            return false;
+        }
+        buffer_size = 0;
+        remaining = uint64_t(header.width) * header.height * header.samples;
+        return std::fwrite(&header, sizeof(header), 1, file) == 1;
+    }
+
+    /*
+     * Open an archive in memory, for coloring passes over the samples of the
+     * whole frame.
+     */
+    void open(const archive_header_t &header)
+    {
+        close();
+        in_memory = true;
+        buffer_size = 0;
+        remaining = uint64_t(header.width) * header.height * header.samples;
+        memory.clear();
+        memory.reserve(remaining);
+    }
+
+    /*
+     * Append a sample to the archive.
+     */
+    void write(unsigned iteration, double conv)
+    {
+        buffer[buffer_size++] = { iteration, float(conv - double(iteration)) };
+        if (buffer_size == BUFFER_SAMPLES)
+        {
+            flush();
+        }
+        --remaining;
+    }
+
+    /*
+     * Close the archive. The function returns false if the archive could not
+     * be written completely.
+     */
+    bool close()
+    {
+        if (in_memory)
+        {
+            flush();
+            in_memory = false;
+            return remaining == 0;
+        }
+        if (!file)
+        {
+            return true;
+        }
+        flush();
+        bool ok = !std::ferror(file) && remaining == 0;
+        ok = (std::fclose(file) == 0) && ok;
+        file = nullptr;
+        return ok;
+    }
+
+    /*
+     * Samples of an archive opened in memory, complete once it is closed.
+     */
+    const std::vector<archive_sample_t> &samples() const { return memory; }
+
+private:
+    void flush()
+    {
+        if (in_memory)
+        {
+            memory.insert(memory.end(), buffer, buffer + buffer_size);
+        }
+        else
+        {
+            std::fwrite(buffer, sizeof(archive_sample_t), buffer_size, file);
+        }
+        buffer_size = 0;
+    }
+
+    static constexpr size_t BUFFER_SAMPLES = 8192;
+    archive_sample_t buffer[BUFFER_SAMPLES]{};
+    size_t buffer_size{ 0 };
+    std::FILE *file{ nullptr };
+    uint64_t remaining{ 0 };
+    bool in_memory{ false };
+    std::vector<archive_sample_t> memory{};
+};
+
+
+/*
+ * Memory-mapped archive reader.
+ */
+class archive_reader
+{
+public:
+    archive_reader() = default;
+    archive_reader(const archive_reader &) = delete;
+    archive_reader &operator=(const archive_reader &) = delete;
+    ~archive_reader() { close(); }
+
+    /*
+     * Map the archive file 'filename' into memory and validate its header. The
+     * function returns false on failure.
+     */
+    bool open(const char *filename)
+    {
+        close();
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat st{};
+        if (fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(archive_header_t))
+        {
+            ::close(fd);
+            return false;
+        }
+        size = st.st_size;
+        void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED)
+        {
+            return false;
+        }
+        data = static_cast<const uint8_t *>(map);
+        madvise(map, size, MADV_SEQUENTIAL);
+
+        // Validate the header. The sample count is checked against the samples
+        // the file can hold first, since its size in bytes may overflow.
+        const archive_header_t &hdr = header();
+        const uint64_t pixels = uint64_t(hdr.width) * hdr.height;
+        const uint64_t capacity =
+            (size - sizeof(archive_header_t)) / sizeof(archive_sample_t);
+        if (std::memcmp(hdr.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) ||
+            hdr.version != ARCHIVE_VERSION ||
+            (hdr.samples != 1 && hdr.samples != 4) ||
+            pixels > capacity / hdr.samples ||
+            size != sizeof(archive_header_t) +
+                    pixels*hdr.samples*sizeof(archive_sample_t))
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (data)
+        {
+            munmap(const_cast<uint8_t *>(data), size);
+            data = nullptr;
+            size = 0;
+        }
+    }
+
+    const archive_header_t &header() const
+    {
+        return *reinterpret_cast<const archive_header_t *>(data);
+    }
+
+    const archive_sample_t *samples() const
+    {
+        return reinterpret_cast<const archive_sample_t *>(
+                data + sizeof(archive_header_t));
+    }
+
+private:
+    const uint8_t *data{ nullptr };
+    size_t size{ 0 };
+};
+
+#endif
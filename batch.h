@@ -0,0 +1,1135 @@
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include "FixedPoint.h"
+#include "formula.h"
+#include "overflow.h"
+#include <cmath>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <random>
+#include <type_traits>
+
+
+/*
+ * Batched escape time building blocks operating on the raw integer
+ * representation of SignedFixedPoint<INT,FRAC> numbers, that is, the value
+ * times 2^FRAC stored sign extended in an int64_t. Every operation models the
+ * corresponding fixed point expression of the scalar escape test exactly,
+ * including the truncation of fractional bits and the wrap-around of integer
+ * bits on assignment, so that results are bit-identical to the scalar path.
+ * The overflow policy POLICY and the rounding policy ROUNDING of the format are
+ * applied on assignment the same way as well, see fit() and round_shift().
+ */
+template <
+    int INT, int FRAC,
+    typename POLICY = OverflowWrap, typename ROUNDING = RoundTruncate >
+struct raw_format
+{
+    using real_type = SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>;
+    static constexpr int TOTAL = INT + FRAC;
+    static_assert(TOTAL <= 62, "Raw format needs headroom in 64 bits.");
+    static constexpr bool WRAP = std::is_same<POLICY, OverflowWrap>::value;
+    static constexpr bool SATURATE =
+        std::is_same<POLICY, OverflowSaturate>::value;
+    static constexpr bool STOCHASTIC =
+        std::is_same<ROUNDING, RoundStochastic>::value;
+
+    /*
+     * Integer type holding the exact product of two raw numbers, or the sum of
+     * two such products. Formats of at most 31 bits use 64-bit arithmetic,
+     * which the compiler is able to vectorize.
+     */
+    using wide_type = typename std::conditional<
+        2*TOTAL+1 <= 63, int64_t, __int128_t>::type;
+
+    /*
+     * Wrap the low TOTAL bits of 'v' to the number range, the same as the
+     * fixed point assignment does.
+     */
+    static constexpr int64_t wrap(int64_t v) noexcept
+    {
+        return int64_t(uint64_t(v) << (64-TOTAL)) >> (64-TOTAL);
+    }
+
+    /*
+     * Smallest and largest raw number of the format.
+     */
+    static constexpr int64_t MIN = -(int64_t(1) << (TOTAL-1));
+    static constexpr int64_t MAX = (int64_t(1) << (TOTAL-1)) - 1;
+
+    /*
+     * Assignment of the integer 't' (raw number with all bits kept) to the
+     * number format under the overflow policy: wrap, clamp to [MIN, MAX] with
+     * min/max (no branches) or trap if 't' is out of range.
+     */
+    static int64_t fit(wide_type t) noexcept
+    {
+        if CONSTEXPR (SATURATE)
+        {
+            const wide_type lo = std::max<wide_type>(t, MIN);
+            return int64_t(std::min<wide_type>(lo, MAX));
+        }
+        else if CONSTEXPR (!WRAP)
+        {
+            if (t != wrap(int64_t(t)))
+            {
+                __builtin_trap();
+            }
+            return int64_t(t);
+        }
+        else
+        {
+            return wrap(int64_t(t));
+        }
+    }
+
+    /*
+     * Raw representation of the constant num/2^shift, rounded and wrapped the
+     * same as SignedFixedPoint<INT,FRAC>(double(num)/(1 << shift)).
+     */
+    static constexpr int64_t constant(int64_t num, int shift) noexcept
+    {
+        return wrap( FRAC >= shift ?
+            int64_t(uint64_t(num) << (FRAC-shift)) :
+            (num + (int64_t(1) << (shift-FRAC-1))) >> (shift-FRAC) );
+    }
+
+    /*
+     * Rounding offset of the rounding policy, added to the exact value 'v'
+     * (2*FRAC fractional bits) plus the raw number 'a' before the FRAC least
+     * significant bits are dropped. Stochastic rounding draws FRAC random bits,
+     * the same bits the fixed point assignment draws.
+     */
+    static wide_type round_bias(wide_type v, int64_t a = 0) noexcept
+    {
+        if CONSTEXPR (FRAC == 0 || std::is_same<ROUNDING, RoundTruncate>::value)
+        {
+            return 0;
+        }
+        else if CONSTEXPR (std::is_same<ROUNDING, RoundHalfUp>::value)
+        {
+            return wide_type(1) << (FRAC-1);
+        }
+        else if CONSTEXPR (std::is_same<ROUNDING, RoundConvergent>::value)
+        {
+            return (wide_type(1) << (FRAC-1)) - 1 + (((v >> FRAC) ^ a) & 1);
+        }
+        else
+        {
+            return wide_type(detail::stochastic_bits() >> (64-FRAC));
+        }
+    }
+
+    /*
+     * The exact value 'v' plus the raw number 'a', rounded to FRAC fractional
+     * bits but not yet fit to the number range.
+     */
+    static wide_type round_shift(wide_type v, int64_t a = 0) noexcept
+    {
+        return ((v + round_bias(v, a)) >> FRAC) + a;
+    }
+
+    /*
+     * Assignment of an exact product or sum of products (2*FRAC fractional
+     * bits) to the number format: round FRAC bits and fit. When wrapping and
+     * all the bits kept are within the low 64 bits of 'v', the rounding
+     * shift and wrap fuse into one shift pair on 64 bits.
+     */
+    static int64_t narrow(wide_type v) noexcept
+    {
+        if CONSTEXPR (WRAP && TOTAL + FRAC <= 64)
+        {
+            uint64_t sum = uint64_t(int64_t(v)) + uint64_t(round_bias(v));
+            return int64_t(sum << (64-TOTAL-FRAC)) >> (64-TOTAL);
+        }
+        else
+        {
+            return fit(round_shift(v));
+        }
+    }
+
+    /*
+     * Test if the assignment of 'v', as in narrow(v), overflows. With
+     * stochastic rounding the truncated value is tested instead, so that the
+     * test does not draw random bits.
+     */
+    static bool overflows(wide_type v) noexcept
+    {
+        const wide_type t = STOCHASTIC ? v >> FRAC : round_shift(v);
+        return t != wrap(int64_t(t));
+    }
+
+    /*
+     * Assignment of the exact product 'v' plus the raw number 'a' to the
+     * number format, that is, narrow(v + a*2^FRAC).
+     */
+    static int64_t narrow_sum(wide_type v, int64_t a) noexcept
+    {
+        if CONSTEXPR (WRAP && TOTAL + FRAC <= 64)
+        {
+            uint64_t sum = uint64_t(int64_t(v)) + (uint64_t(a) << FRAC) +
+                uint64_t(round_bias(v, a));
+            return int64_t(sum << (64-TOTAL-FRAC)) >> (64-TOTAL);
+        }
+        else if CONSTEXPR (WRAP)
+        {
+            return wrap(int64_t(round_shift(v, a)));
+        }
+        else
+        {
+            return fit(round_shift(v, a));
+        }
+    }
+
+    static int64_t to_raw(const real_type &a) noexcept
+    {
+        detail::fpint128_t n = a.get_num();
+        if CONSTEXPR (FRAC == 0)
+        {
+            return n.table[1];
+        }
+        else
+        {
+            return int64_t( uint64_t(n.table[1]) << FRAC |
+                            uint64_t(n.table[0]) >> (64-FRAC) );
+        }
+    }
+
+    static int64_t to_raw(double a)
+    {
+        return to_raw(real_type(a));
+    }
+
+    /*
+     * Bulk conversion of 'n' doubles, identical to to_raw() of every element,
+     * see detail::doubles_to_raw().
+     */
+    static void to_raw(const double *src, int64_t *dst, int n)
+    {
+        if (!detail::doubles_to_raw<INT,FRAC>(src, dst, n))
+        {
+            for (int i=0; i<n; ++i)
+            {
+                if (!detail::raw_convertible(src[i]))
+                {
+                    dst[i] = to_raw(src[i]);
+                }
+            }
+        }
+    }
+
+    static real_type from_raw(int64_t raw) noexcept
+    {
+        detail::fpint128_t n{};
+        if CONSTEXPR (FRAC == 0)
+        {
+            n.table[1] = raw;
+        }
+        else
+        {
+            n.table[1] = raw >> FRAC;
+            n.table[0] = uint64_t(raw) << (64-FRAC);
+        }
+        real_type res{};
+        res.set_num(n);
+        return res;
+    }
+};
+
+
+/*
+ * Structure-of-arrays batch of N complex numbers of the format <INT,FRAC>, in
+ * raw representation with the real and imaginary parts in separate aligned
+ * arrays. The element-wise operations model the corresponding fixed point
+ * expressions on std::complex<SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>>
+ * exactly, with one rounding and fit per assigned component, and are written
+ * as plain loops over the lanes for the compiler to vectorize. The operands
+ * may alias the result.
+ */
+template <
+    int INT, int FRAC, int N,
+    typename POLICY = OverflowWrap, typename ROUNDING = RoundTruncate >
+struct ComplexFixedBatch
+{
+    using raw = raw_format<INT,FRAC,POLICY,ROUNDING>;
+    using wide_type = typename raw::wide_type;
+
+    alignas(64) int64_t re[N];
+    alignas(64) int64_t im[N];
+
+    /*
+     * Set every lane to the raw number (a_re, a_im).
+     */
+    void fill(int64_t a_re, int64_t a_im) noexcept
+    {
+        for (int l=0; l<N; ++l)
+        {
+            re[l] = a_re;
+            im[l] = a_im;
+        }
+    }
+
+    /*
+     * this = a + b and this = a - b.
+     */
+    void add(const ComplexFixedBatch &a, const ComplexFixedBatch &b) noexcept
+    {
+        for (int l=0; l<N; ++l)
+        {
+            re[l] = raw::fit(wide_type(a.re[l]) + b.re[l]);
+            im[l] = raw::fit(wide_type(a.im[l]) + b.im[l]);
+        }
+    }
+
+    void sub(const ComplexFixedBatch &a, const ComplexFixedBatch &b) noexcept
+    {
+        for (int l=0; l<N; ++l)
+        {
+            re[l] = raw::fit(wide_type(a.re[l]) - b.re[l]);
+            im[l] = raw::fit(wide_type(a.im[l]) - b.im[l]);
+        }
+    }
+
+    /*
+     * this = a * b, with the real part assigned before the imaginary part as
+     * in the std::complex multiplication.
+     */
+    void mul(const ComplexFixedBatch &a, const ComplexFixedBatch &b) noexcept
+    {
+        for (int l=0; l<N; ++l)
+        {
+            const wide_type a_re = a.re[l], a_im = a.im[l];
+            const int64_t res_re = raw::narrow(a_re*b.re[l] - a_im*b.im[l]);
+            im[l] = raw::narrow(a_re*b.im[l] + a_im*b.re[l]);
+            re[l] = res_re;
+        }
+    }
+
+    /*
+     * this = a * a.
+     */
+    void square(const ComplexFixedBatch &a) noexcept
+    {
+        for (int l=0; l<N; ++l)
+        {
+            const wide_type a_re = a.re[l], a_im = a.im[l];
+            re[l] = raw::narrow(a_re*a_re - a_im*a_im);
+            im[l] = raw::narrow(2*a_re*a_im);
+        }
+    }
+
+    /*
+     * Squares of the real and imaginary parts of 'a', as the escape loop keeps
+     * them: re = a.re * a.re and im = a.im * a.im.
+     */
+    void square_parts(const ComplexFixedBatch &a) noexcept
+    {
+        for (int l=0; l<N; ++l)
+        {
+            re[l] = raw::narrow(wide_type(a.re[l]) * a.re[l]);
+            im[l] = raw::narrow(wide_type(a.im[l]) * a.im[l]);
+        }
+    }
+
+    /*
+     * Magnitude squared compare, re*re + im*im > bound with the exact sum of
+     * products, as the fixed point expression compares it. The result of each
+     * lane is written to 'mask' and the number of set lanes is returned.
+     */
+    int norm_greater(int64_t bound, uint8_t *mask) const noexcept
+    {
+        const wide_type BOUND = wide_type(bound) << FRAC;
+        int count = 0;
+        for (int l=0; l<N; ++l)
+        {
+            const wide_type norm =
+                wide_type(re[l])*re[l] + wide_type(im[l])*im[l];
+            mask[l] = norm > BOUND;
+            count += mask[l];
+        }
+        return count;
+    }
+};
+
+
+namespace detail
+{
+    /*
+     * Discs inscribed in the period 3 and period 4 bulbs of the mandelbrot
+     * set, as center and radius. The radii have been verified numerically to
+     * have an attracting cycle (|multiplier| < 1) on the whole disc boundary.
+     */
+    struct bulb_disc_t
+    {
+        double re, im, r;
+    };
+
+    constexpr bulb_disc_t EXTRA_BULBS[] = {
+        { -0.12256116687665361,  0.74486176661974424, 0.090 },
+        { -0.12256116687665361, -0.74486176661974424, 0.090 },
+        { -1.31070264133683280,  0.0,                 0.055 },
+        {  0.28227139076691393,  0.53006061757852529, 0.040 },
+        {  0.28227139076691393, -0.53006061757852529, 0.040 },
+    };
+    constexpr int EXTRA_BULB_COUNT =
+        sizeof(EXTRA_BULBS) / sizeof(EXTRA_BULBS[0]);
+
+
+    /*
+     * The extra bulb discs in raw representation. The radius is reduced by the
+     * quantization error of the center, so that the quantized disc is always
+     * within the bulb. Discs that vanish get a squared radius of zero.
+     */
+    template <int INT, int FRAC>
+    struct raw_bulbs
+    {
+        using raw = raw_format<INT,FRAC>;
+        using wide_type = typename raw::wide_type;
+
+        raw_bulbs()
+        {
+            const double step = std::ldexp(1.0, -FRAC);
+            for (int i=0; i<EXTRA_BULB_COUNT; ++i)
+            {
+                const bulb_disc_t &b = EXTRA_BULBS[i];
+                re[i] = raw::to_raw(b.re);
+                im[i] = raw::to_raw(b.im);
+                double r = std::floor((b.r - step) / step);
+                r2[i] = r > 0.0 ? wide_type(int64_t(r)) * int64_t(r) : 0;
+            }
+        }
+
+        int64_t re[EXTRA_BULB_COUNT]{};
+        int64_t im[EXTRA_BULB_COUNT]{};
+        wide_type r2[EXTRA_BULB_COUNT]{};
+    };
+}
+
+
+/*
+ * Branch-free classification of 'n' points (re[i], im[i]), in raw
+ * representation, as interior points of the main cardioid or the period 2 bulb.
+ * The result is written to the mask 'interior' (1 for interior points) and the
+ * number of interior points is returned. The classification is identical to
+ * the checks at the top of the scalar get_escape(). If 'extra_bulbs' is set,
+ * points within the discs inscribed in the period 3 and 4 bulbs are classified
+ * as interior as well. Note that this changes the image of formats where the
+ * quantized orbit of such a point escapes.
+ */
+template <
+    int INT, int FRAC,
+    typename POLICY = OverflowWrap, typename ROUNDING = RoundTruncate >
+int filter_interior(
+        const int64_t *re, const int64_t *im, const int n, uint8_t *interior,
+        const bool extra_bulbs = false)
+{
+    using raw = raw_format<INT,FRAC,POLICY,ROUNDING>;
+    using wide_type = typename raw::wide_type;
+    constexpr int64_t QUARTER = raw::constant(1, 2);
+    constexpr int64_t ONE = raw::constant(1, 0);
+    constexpr wide_type BULB_R2 = wide_type(raw::constant(1, 4)) << FRAC;
+
+    int count = 0;
+    for (int i=0; i<n; ++i)
+    {
+        const int64_t x = re[i];
+        const int64_t y = im[i];
+        const wide_type y2 = wide_type(y)*y;
+
+        // Main cardioid: q*(q+x-1/4) < 1/4*y^2.
+        const wide_type dx = x - QUARTER;
+        const int64_t q = raw::narrow(dx*dx + y2);
+        const wide_type lhs = wide_type(q) * (q + x - QUARTER);
+        const wide_type rhs = wide_type(QUARTER) * raw::narrow(y2);
+
+        // Period 2 bulb: (x+1)^2 + y^2 < 1/16.
+        const wide_type x1 = x + ONE;
+        const wide_type bulb = x1*x1 + y2;
+
+        interior[i] = (lhs < rhs) | (bulb < BULB_R2);
+        count += interior[i];
+    }
+
+    if CONSTEXPR (COUNT_OVERFLOW)
+    {
+        overflow_counters_t &counters = thread_overflow_counters<INT,FRAC>();
+        for (int i=0; i<n; ++i)
+        {
+            const wide_type dx = re[i] - QUARTER;
+            const wide_type y2 = wide_type(im[i])*im[i];
+            counters.overflows[OVERFLOW_FILTER_Q] += raw::overflows(dx*dx + y2);
+            counters.overflows[OVERFLOW_FILTER_Y_SQR] += raw::overflows(y2);
+        }
+        counters.assignments[OVERFLOW_FILTER_Q] += n;
+        counters.assignments[OVERFLOW_FILTER_Y_SQR] += n;
+    }
+
+    if (extra_bulbs)
+    {
+        static const detail::raw_bulbs<INT,FRAC> bulbs{};
+        count = 0;
+        for (int i=0; i<n; ++i)
+        {
+            uint8_t in = interior[i];
+            for (int b=0; b<detail::EXTRA_BULB_COUNT; ++b)
+            {
+                const wide_type dx = re[i] - bulbs.re[b];
+                const wide_type dy = im[i] - bulbs.im[b];
+                in |= dx*dx + dy*dy < bulbs.r2[b];
+            }
+            interior[i] = in;
+            count += in;
+        }
+    }
+    return count;
+}
+
+
+/*
+ * Compact the indices of the points not marked in 'interior' to the dense
+ * lane index list 'lanes'. Returns the number of survivors.
+ */
+static inline int compact_lanes(const uint8_t *interior, const int n, int *lanes)
+{
+    int k = 0;
+    for (int i=0; i<n; ++i)
+    {
+        lanes[k] = i;
+        k += !interior[i];
+    }
+    return k;
+}
+
+
+/*
+ * Lane utilization of a batched escape loop: the number of lane steps executed
+ * and the number of those steps that iterated an actual point.
+ */
+struct lane_stats_t
+{
+    uint64_t lane_steps;
+    uint64_t active_steps;
+
+    double utilization() const
+    {
+        return lane_steps ? double(active_steps) / lane_steps : 1.0;
+    }
+
+    lane_stats_t &operator+=(const lane_stats_t &rhs)
+    {
+        lane_steps += rhs.lane_steps;
+        active_steps += rhs.active_steps;
+        return *this;
+    }
+};
+
+
+/*
+ * Result of a raw escape loop: the escape iteration ('iterations' if the point
+ * did not escape) and the raw z at that iteration. With _COUNT_OVERFLOW the
+ * iteration of the first overflowing step is recorded, UINT_MAX otherwise.
+ */
+struct raw_escape_t
+{
+    unsigned iteration;
+    unsigned first_overflow;
+    int64_t z_re, z_im;
+};
+
+
+namespace detail
+{
+    /*
+     * Members common to the raw escape kernels of all formulas, where KERNEL
+     * is the kernel of the formula with the step of a single point,
+     * KERNEL::step().
+     */
+    template <
+        typename KERNEL, int INT, int FRAC, typename POLICY, typename ROUNDING >
+    struct escape_kernel_base
+    {
+        using raw = raw_format<INT,FRAC,POLICY,ROUNDING>;
+        using wide_type = typename raw::wide_type;
+        template <int N>
+        using batch = ComplexFixedBatch<INT,FRAC,N,POLICY,ROUNDING>;
+        static constexpr int64_t BAILOUT = raw::constant(4, 0);
+
+        static bool escaped(int64_t z_re_sqr, int64_t z_im_sqr) noexcept
+        {
+            return z_re_sqr + z_im_sqr > BAILOUT;
+        }
+
+        /*
+         * The step on all lanes of the batches 'z', 'z_sqr' (the squares of
+         * the parts of z, see ComplexFixedBatch::square_parts()) and 'c'.
+         */
+        template <int N>
+        static void step(
+                batch<N> &z, batch<N> &z_sqr, const batch<N> &c) noexcept
+        {
+            for (int l=0; l<N; ++l)
+            {
+                KERNEL::step(
+                    z.re[l], z.im[l], z_sqr.re[l], z_sqr.im[l],
+                    c.re[l], c.im[l]);
+            }
+        }
+
+        /*
+         * Last part of a counted step: assign the squares of the parts of the
+         * new z, and count the assignments and overflows of z, given by
+         * 're_overflow' and 'im_overflow', and of the squares to 'counters'.
+         * Returns true if any assignment of the step overflowed.
+         */
+        static bool squares_counted(
+                int64_t z_re, int64_t z_im, bool re_overflow, bool im_overflow,
+                int64_t &z_re_sqr, int64_t &z_im_sqr,
+                overflow_counters_t &counters) noexcept
+        {
+            const wide_type re_sqr = raw::round_shift(wide_type(z_re) * z_re);
+            const wide_type im_sqr = raw::round_shift(wide_type(z_im) * z_im);
+            z_re_sqr = raw::fit(re_sqr);
+            z_im_sqr = raw::fit(im_sqr);
+
+            const bool overflow[4] = {
+                re_overflow, im_overflow,
+                z_re_sqr != re_sqr, z_im_sqr != im_sqr };
+            for (int i=0; i<4; ++i)
+            {
+                ++counters.assignments[OVERFLOW_Z_RE + i];
+                counters.overflows[OVERFLOW_Z_RE + i] += overflow[i];
+            }
+            return overflow[0] | overflow[1] | overflow[2] | overflow[3];
+        }
+    };
+}
+
+
+/*
+ * Escape iteration step on raw numbers, specialized at compile time for the
+ * format <INT,FRAC> and the formula FORMULA, see formula.h. Each step models
+ * the FORMULA::step() expressions with one rounding and fit per assignment
+ * and constants resolved at compile time, instead of the widened intermediate
+ * types and per-operation masking of the generic operators. See
+ * verify_escape_kernel() for the bit-exactness check against the generic path.
+ */
+template <
+    int INT, int FRAC,
+    typename POLICY = OverflowWrap, typename ROUNDING = RoundTruncate,
+    typename FORMULA = formula_mandelbrot >
+struct escape_kernel;
+
+
+/*
+ * Mandelbrot step, reproducing the fixed point expressions
+ *
+ *     z_im = (z_re+z_im)*(z_re+z_im) - z_re_sqr - z_im_sqr + c_im
+ *     z_re = z_re_sqr - z_im_sqr + c_re
+ *     z_re_sqr = z_re * z_re
+ *     z_im_sqr = z_im * z_im
+ *
+ * of get_escape_unfiltered().
+ */
+template <int INT, int FRAC, typename POLICY, typename ROUNDING>
+struct escape_kernel<INT,FRAC,POLICY,ROUNDING,formula_mandelbrot>
+    : detail::escape_kernel_base<
+        escape_kernel<INT,FRAC,POLICY,ROUNDING,formula_mandelbrot>,
+        INT,FRAC,POLICY,ROUNDING>
+{
+    using base_type = detail::escape_kernel_base<
+        escape_kernel, INT,FRAC,POLICY,ROUNDING>;
+    using raw = typename base_type::raw;
+    using wide_type = typename base_type::wide_type;
+    using base_type::step;
+
+    static void step(
+            int64_t &z_re, int64_t &z_im, int64_t &z_re_sqr, int64_t &z_im_sqr,
+            int64_t c_re, int64_t c_im) noexcept
+    {
+        const wide_type s = z_re + z_im;
+        z_im = raw::narrow_sum(s*s, c_im - z_re_sqr - z_im_sqr);
+        z_re = raw::fit(z_re_sqr - z_im_sqr + c_re);
+        z_re_sqr = raw::narrow(wide_type(z_re) * z_re);
+        z_im_sqr = raw::narrow(wide_type(z_im) * z_im);
+    }
+
+    /*
+     * Same step, counting the assignments and overflows per call site to
+     * 'counters'. Returns true if any assignment of the step overflowed.
+     */
+    static bool step_counted(
+            int64_t &z_re, int64_t &z_im, int64_t &z_re_sqr, int64_t &z_im_sqr,
+            int64_t c_re, int64_t c_im, overflow_counters_t &counters) noexcept
+    {
+        const wide_type s = z_re + z_im;
+        const wide_type im_exact =
+            raw::round_shift(s*s, c_im - z_re_sqr - z_im_sqr);
+        const int64_t re_exact = z_re_sqr - z_im_sqr + c_re;
+        z_im = raw::fit(im_exact);
+        z_re = raw::fit(re_exact);
+        return base_type::squares_counted(
+            z_re, z_im, z_re != re_exact, z_im != im_exact,
+            z_re_sqr, z_im_sqr, counters);
+    }
+};
+
+
+/*
+ * Julia sets iterate the mandelbrot step, only the start of the escape loop
+ * differs, see escape_lanes().
+ */
+template <int INT, int FRAC, typename POLICY, typename ROUNDING>
+struct escape_kernel<INT,FRAC,POLICY,ROUNDING,formula_julia>
+    : escape_kernel<INT,FRAC,POLICY,ROUNDING,formula_mandelbrot>
+{
+};
+
+
+/*
+ * Multibrot step of degree D, the power formed by D-1 complex multiplications
+ * as ComplexFixedBatch::mul() does.
+ */
+template <int INT, int FRAC, typename POLICY, typename ROUNDING, int D>
+struct escape_kernel<INT,FRAC,POLICY,ROUNDING,formula_multibrot<D>>
+    : detail::escape_kernel_base<
+        escape_kernel<INT,FRAC,POLICY,ROUNDING,formula_multibrot<D>>,
+        INT,FRAC,POLICY,ROUNDING>
+{
+    using base_type = detail::escape_kernel_base<
+        escape_kernel, INT,FRAC,POLICY,ROUNDING>;
+    using raw = typename base_type::raw;
+    using wide_type = typename base_type::wide_type;
+    using base_type::step;
+
+    static void step(
+            int64_t &z_re, int64_t &z_im, int64_t &z_re_sqr, int64_t &z_im_sqr,
+            int64_t c_re, int64_t c_im) noexcept
+    {
+        int64_t w_re = z_re, w_im = z_im;
+        for (int k=1; k<D; ++k)
+        {
+            const int64_t re =
+                raw::narrow(wide_type(w_re)*z_re - wide_type(w_im)*z_im);
+            w_im = raw::narrow(wide_type(w_re)*z_im + wide_type(w_im)*z_re);
+            w_re = re;
+        }
+        z_re = raw::fit(wide_type(w_re) + c_re);
+        z_im = raw::fit(wide_type(w_im) + c_im);
+        z_re_sqr = raw::narrow(wide_type(z_re) * z_re);
+        z_im_sqr = raw::narrow(wide_type(z_im) * z_im);
+    }
+
+    /*
+     * Overflows of the power count toward the call sites of z.
+     */
+    static bool step_counted(
+            int64_t &z_re, int64_t &z_im, int64_t &z_re_sqr, int64_t &z_im_sqr,
+            int64_t c_re, int64_t c_im, overflow_counters_t &counters) noexcept
+    {
+        int64_t w_re = z_re, w_im = z_im;
+        bool re_overflow = false, im_overflow = false;
+        for (int k=1; k<D; ++k)
+        {
+            const wide_type re = raw::round_shift(
+                wide_type(w_re)*z_re - wide_type(w_im)*z_im);
+            const wide_type im = raw::round_shift(
+                wide_type(w_re)*z_im + wide_type(w_im)*z_re);
+            w_re = raw::fit(re);
+            w_im = raw::fit(im);
+            re_overflow |= w_re != re;
+            im_overflow |= w_im != im;
+        }
+        const wide_type re_exact = wide_type(w_re) + c_re;
+        const wide_type im_exact = wide_type(w_im) + c_im;
+        z_re = raw::fit(re_exact);
+        z_im = raw::fit(im_exact);
+        return base_type::squares_counted(
+            z_re, z_im, re_overflow || z_re != re_exact,
+            im_overflow || z_im != im_exact, z_re_sqr, z_im_sqr, counters);
+    }
+};
+
+
+/*
+ * Burning ship step, the mandelbrot step on the absolute values of the parts
+ * of z. The negation of the most negative number wraps around as in
+ * detail::formula_abs().
+ */
+template <int INT, int FRAC, typename POLICY, typename ROUNDING>
+struct escape_kernel<INT,FRAC,POLICY,ROUNDING,formula_burning_ship>
+    : detail::escape_kernel_base<
+        escape_kernel<INT,FRAC,POLICY,ROUNDING,formula_burning_ship>,
+        INT,FRAC,POLICY,ROUNDING>
+{
+    using base_type = detail::escape_kernel_base<
+        escape_kernel, INT,FRAC,POLICY,ROUNDING>;
+    using raw = typename base_type::raw;
+    using wide_type = typename base_type::wide_type;
+    using base_type::step;
+
+    static int64_t abs(int64_t v) noexcept
+    {
+        return v < 0 ? raw::wrap(-v) : v;
+    }
+
+    static void step(
+            int64_t &z_re, int64_t &z_im, int64_t &z_re_sqr, int64_t &z_im_sqr,
+            int64_t c_re, int64_t c_im) noexcept
+    {
+        const wide_type s = abs(z_re) + abs(z_im);
+        z_im = raw::narrow_sum(s*s, c_im - z_re_sqr - z_im_sqr);
+        z_re = raw::fit(z_re_sqr - z_im_sqr + c_re);
+        z_re_sqr = raw::narrow(wide_type(z_re) * z_re);
+        z_im_sqr = raw::narrow(wide_type(z_im) * z_im);
+    }
+
+    static bool step_counted(
+            int64_t &z_re, int64_t &z_im, int64_t &z_re_sqr, int64_t &z_im_sqr,
+            int64_t c_re, int64_t c_im, overflow_counters_t &counters) noexcept
+    {
+        const wide_type s = abs(z_re) + abs(z_im);
+        const wide_type im_exact =
+            raw::round_shift(s*s, c_im - z_re_sqr - z_im_sqr);
+        const int64_t re_exact = z_re_sqr - z_im_sqr + c_re;
+        z_im = raw::fit(im_exact);
+        z_re = raw::fit(re_exact);
+        return base_type::squares_counted(
+            z_re, z_im, z_re != re_exact, z_im != im_exact,
+            z_re_sqr, z_im_sqr, counters);
+    }
+};
+
+
+/*
+ * Escape loop over the points (re[queue[k]], im[queue[k]]), k in [0, n), in
+ * raw representation, with LANES points in flight. All lanes are stepped
+ * together, and when the point of a lane escapes or reaches 'iterations' its
+ * result is written to res[queue[k]] and the next pending point of the queue
+ * is loaded into the lane, so all lanes stay busy until the queue drains. The
+ * iteration is identical to get_escape_unfiltered(). The lane utilization is
+ * added to 'stats' if given. Overflows are counted with _COUNT_OVERFLOW.
+ *
+ * If 'start' is given, the point queue[k] continues from the iteration and z
+ * of start[queue[k]], typically the result of an earlier loop with a lower
+ * iteration limit, instead of from z = 0. Since the squares of z are derived
+ * from z alone, the continued loop gives the same result as a loop run with
+ * the higher limit from the start (with stochastic rounding only
+ * statistically). 'start' may be the same array as 'res'.
+ *
+ * The points are iterated with the formula 'formula', see formula.h. For
+ * Julia sets z starts at the point and c is the constant of the formula.
+ */
+template <
+    int INT, int FRAC,
+    typename POLICY = OverflowWrap, typename ROUNDING = RoundTruncate,
+    int LANES = 8, typename FORMULA = formula_mandelbrot >
+void escape_lanes(
+        const int64_t *re, const int64_t *im, const int *queue, const int n,
+        const unsigned iterations, raw_escape_t *res,
+        lane_stats_t *stats = nullptr, const raw_escape_t *start = nullptr,
+        const FORMULA &formula = FORMULA{})
+{
+    using kernel = escape_kernel<INT,FRAC,POLICY,ROUNDING,FORMULA>;
+    using raw = typename kernel::raw;
+    using wide_type = typename kernel::wide_type;
+    using real_type = typename raw::real_type;
+    typename kernel::template batch<LANES> z{}, z_sqr{}, c{};
+    unsigned it[LANES]{};
+    unsigned first_overflow[LANES]{};
+    int idx[LANES]{};
+    int next = 0;
+    int active = 0;
+    const std::complex<real_type> julia =
+        formula.constant(std::complex<real_type>{});
+    const int64_t julia_re = raw::to_raw(julia.real());
+    const int64_t julia_im = raw::to_raw(julia.imag());
+
+    // Set z of lane l, and the squares of its parts.
+    auto set_z = [&](int l, int64_t z_re, int64_t z_im)
+    {
+        z.re[l] = z_re;
+        z.im[l] = z_im;
+        z_sqr.re[l] = raw::narrow(wide_type(z_re) * z_re);
+        z_sqr.im[l] = raw::narrow(wide_type(z_im) * z_im);
+    };
+
+    // Load the next pending point into lane l, or mark it idle.
+    auto load = [&](int l)
+    {
+        z.re[l] = z.im[l] = z_sqr.re[l] = z_sqr.im[l] = 0;
+        it[l] = 0;
+        first_overflow[l] = UINT_MAX;
+        if (next < n)
+        {
+            idx[l] = queue[next++];
+            c.re[l] = re[idx[l]];
+            c.im[l] = im[idx[l]];
+            ++active;
+            if CONSTEXPR (FORMULA::JULIA)
+            {
+                if (!start)
+                {
+                    set_z(l, c.re[l], c.im[l]);
+                }
+                c.re[l] = julia_re;
+                c.im[l] = julia_im;
+            }
+            if (start)
+            {
+                const raw_escape_t &s = start[idx[l]];
+                set_z(l, s.z_re, s.z_im);
+                it[l] = s.iteration;
+                first_overflow[l] = s.first_overflow;
+            }
+        }
+        else
+        {
+            idx[l] = -1;
+        }
+    };
+    for (int l=0; l<LANES; ++l)
+    {
+        load(l);
+    }
+
+    lane_stats_t lane_stats{};
+    while (active > 0)
+    {
+        // Retire lanes that escaped or ran out of iterations and refill them.
+        for (int l=0; l<LANES; ++l)
+        {
+            while (idx[l] >= 0 && (kernel::escaped(z_sqr.re[l], z_sqr.im[l]) ||
+                                   it[l] == iterations))
+            {
+                res[idx[l]] = raw_escape_t{
+                    it[l], first_overflow[l], z.re[l], z.im[l] };
+                --active;
+                load(l);
+            }
+        }
+        if (active == 0)
+        {
+            break;
+        }
+
+        // Step all lanes, idle lanes included.
+        if CONSTEXPR (COUNT_OVERFLOW)
+        {
+            overflow_counters_t &counters = thread_overflow_counters<INT,FRAC>();
+            for (int l=0; l<LANES; ++l)
+            {
+                if (idx[l] >= 0 && kernel::step_counted(
+                        z.re[l], z.im[l], z_sqr.re[l], z_sqr.im[l],
+                        c.re[l], c.im[l], counters))
+                {
+                    first_overflow[l] = std::min(first_overflow[l], it[l]);
+                }
+                ++it[l];
+            }
+        }
+        else
+        {
+            kernel::step(z, z_sqr, c);
+            for (int l=0; l<LANES; ++l)
+            {
+                ++it[l];
+            }
+        }
+        lane_stats.lane_steps += LANES;
+        lane_stats.active_steps += active;
+    }
+    if (stats)
+    {
+        *stats += lane_stats;
+    }
+}
+
+
+/*
+ * Check the operations of ComplexFixedBatch on the operands (a_re, a_im) and
+ * (b_re, b_im) against the generic fixed point operators, see
+ * verify_escape_kernel().
+ */
+template <int INT, int FRAC, typename POLICY, typename ROUNDING>
+bool verify_batch_ops(
+        int64_t a_re, int64_t a_im, int64_t b_re, int64_t b_im,
+        uint64_t rounding_seed)
+{
+    using raw = raw_format<INT,FRAC,POLICY,ROUNDING>;
+    using T = SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>;
+    using batch = ComplexFixedBatch<INT,FRAC,1,POLICY,ROUNDING>;
+    const T x_re = raw::from_raw(a_re), x_im = raw::from_raw(a_im);
+    const T y_re = raw::from_raw(b_re), y_im = raw::from_raw(b_im);
+    batch a{}, b{}, res[5]{};
+    a.fill(a_re, a_im);
+    b.fill(b_re, b_im);
+
+    // Generic fixed point path, then the batch operations.
+    T expected[10]{};
+    seed_stochastic_rounding(rounding_seed);
+    expected[0] = x_re + y_re;
+    expected[1] = x_im + y_im;
+    expected[2] = x_re - y_re;
+    expected[3] = x_im - y_im;
+    expected[4] = x_re*y_re - x_im*y_im;
+    expected[5] = x_re*y_im + x_im*y_re;
+    expected[6] = x_re*x_re - x_im*x_im;
+    expected[7] = x_re*x_im + x_im*x_re;
+    expected[8] = x_re*x_re;
+    expected[9] = x_im*x_im;
+    const bool norm = x_re*x_re + x_im*x_im > y_re;
+
+    seed_stochastic_rounding(rounding_seed);
+    res[0].add(a, b);
+    res[1].sub(a, b);
+    res[2].mul(a, b);
+    res[3].square(a);
+    res[4].square_parts(a);
+    uint8_t norm_mask{};
+    a.norm_greater(b_re, &norm_mask);
+
+    bool ok = bool(norm_mask) == norm;
+    for (int i=0; i<5; ++i)
+    {
+        ok = ok && raw::to_raw(expected[2*i]) == res[i].re[0] &&
+            raw::to_raw(expected[2*i+1]) == res[i].im[0];
+    }
+    return ok;
+}
+
+
+/*
+ * Randomized bit-exactness check of the raw building blocks of the format
+ * <INT,FRAC> against the generic fixed point operators: the escape kernel
+ * step and bailout, and the interior pre-filter. Operands are drawn from the
+ * whole number range, from around the escape radius and from the range
+ * boundaries, so that wrap-around and saturation are exercised. The counting
+ * step is checked to produce the same result as the plain step. Returns the
+ * number of mismatching samples out of 'samples'. The ComplexFixedBatch
+ * operations are checked on the same operands. Formats with the trap policy
+ * can not be checked, since the operands overflow by design. With stochastic
+ * rounding the generator is reseeded per sample, so that both paths draw the
+ * same random bits. The kernel step is that of the formula FORMULA, checked
+ * against FORMULA::step() on the generic operators, see formula.h.
+ */
+template <
+    int INT, int FRAC, typename POLICY, typename ROUNDING,
+    typename FORMULA = formula_mandelbrot >
+uint64_t verify_escape_kernel(
+        const SignedFixedPoint<INT,FRAC,POLICY,ROUNDING> &, uint64_t samples,
+        uint64_t seed, const FORMULA & = FORMULA{})
+{
+    static_assert(!std::is_same<POLICY, OverflowTrap>::value,
+        "Trapping formats can not be verified.");
+    using raw = raw_format<INT,FRAC,POLICY,ROUNDING>;
+    using kernel = escape_kernel<INT,FRAC,POLICY,ROUNDING,FORMULA>;
+    using T = SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>;
+    constexpr int64_t MIN = raw::MIN;
+    constexpr int64_t MAX = raw::MAX;
+    std::mt19937_64 rng{ seed };
+    auto operand = [&]() -> int64_t
+    {
+        switch (rng() % 4)
+        {
+            case 0: return raw::wrap(int64_t(rng()));
+            case 1: return raw::wrap(
+                int64_t(rng() % (uint64_t(16) << FRAC)) - (int64_t(8) << FRAC));
+            case 2: return rng() % 2 ? MIN + int64_t(rng() % 4) :
+                                       MAX - int64_t(rng() % 4);
+            default: return raw::wrap(int64_t(rng() % 9) - 4);
+        }
+    };
+
+    overflow_counters_t counters{};
+    uint64_t mismatches = 0;
+    for (uint64_t i=0; i<samples; ++i)
+    {
+        int64_t z[4] = { operand(), operand(), operand(), operand() };
+        const int64_t c_re = operand(), c_im = operand();
+        const uint64_t rounding_seed = rng();
+        const bool batch_ok = verify_batch_ops<INT,FRAC,POLICY,ROUNDING>(
+            z[0], z[1], c_re, c_im, rounding_seed);
+
+        // Generic fixed point path.
+        seed_stochastic_rounding(rounding_seed);
+        T z_re = raw::from_raw(z[0]), z_im = raw::from_raw(z[1]);
+        T z_re_sqr = raw::from_raw(z[2]), z_im_sqr = raw::from_raw(z[3]);
+        const T x = raw::from_raw(c_re), y = raw::from_raw(c_im);
+        const bool escaped = z_re_sqr+z_im_sqr > T(4.0);
+        FORMULA::step(z_re, z_im, z_re_sqr, z_im_sqr, std::complex<T>{ x, y });
+        T q = (x - T(0.25))*(x - T(0.25)) + y*y;
+        const bool interior =
+            q*(q+x-T(0.25)) < T(0.25)*T(y*y) ||
+            (x+T(1))*(x+T(1)) + y*y < T(0.0625);
+
+        // Raw path.
+        const bool raw_escaped = kernel::escaped(z[2], z[3]);
+        int64_t zc[4] = { z[0], z[1], z[2], z[3] };
+        seed_stochastic_rounding(rounding_seed);
+        kernel::step(z[0], z[1], z[2], z[3], c_re, c_im);
+        seed_stochastic_rounding(rounding_seed);
+        kernel::step_counted(zc[0], zc[1], zc[2], zc[3], c_re, c_im, counters);
+        uint8_t raw_interior{};
+        filter_interior<INT,FRAC,POLICY,ROUNDING>(
+            &c_re, &c_im, 1, &raw_interior);
+
+        mismatches += !batch_ok || escaped != raw_escaped ||
+            interior != bool(raw_interior) ||
+            raw::to_raw(z_re) != z[0] || raw::to_raw(z_im) != z[1] ||
+            raw::to_raw(z_re_sqr) != z[2] || raw::to_raw(z_im_sqr) != z[3] ||
+            zc[0] != z[0] || zc[1] != z[1] || zc[2] != z[2] || zc[3] != z[3];
+    }
+    return mismatches;
+}
+
+
+/*
+ * Check the division by a divisor of the format <D_INT,D_FRAC> prepared by
+ * make_divisor() against operator/ of the fixed point number, for dividends of
+ * the format <INT,FRAC> and for products of two such numbers, whose scaled
+ * integers need more than 64 bits if the format is wide. Divisors are drawn
+ * from the powers of two, small numbers, the whole number range and its
+ * boundaries, so that the shift, the reciprocal and the fallback division are
+ * exercised. Returns the number of mismatching samples out of 'samples'.
+ */
+template <int INT, int FRAC, int D_INT, int D_FRAC>
+uint64_t verify_prepared_divisor(uint64_t samples, uint64_t seed)
+{
+    using raw = raw_format<INT,FRAC,OverflowWrap,RoundTruncate>;
+    using d_raw = raw_format<D_INT,D_FRAC,OverflowWrap,RoundTruncate>;
+    std::mt19937_64 rng{ seed };
+    auto divisor = [&]() -> int64_t
+    {
+        int64_t d = 0;
+        while (d == 0)
+        {
+            switch (rng() % 4)
+            {
+                case 0: d = d_raw::wrap(
+                    int64_t(1) << (rng() % (D_INT+D_FRAC-1)));
+                    d = rng() % 2 ? d : d_raw::wrap(-d);
+                    break;
+                case 1: d = d_raw::wrap(int64_t(rng() % 33) - 16); break;
+                case 2: d = d_raw::wrap(int64_t(rng())); break;
+                default: d = rng() % 2 ? d_raw::MIN : d_raw::MAX; break;
+            }
+        }
+        return d;
+    };
+
+    uint64_t mismatches = 0;
+    for (uint64_t i=0; i<samples; ++i)
+    {
+        const auto d = d_raw::from_raw(divisor());
+        const auto prepared = make_divisor(d);
+        const auto a = raw::from_raw(raw::wrap(int64_t(rng())));
+        const auto b = raw::from_raw(raw::wrap(int64_t(rng())));
+        const auto p = a*b;
+        mismatches += !(a/prepared == a/d) || !(p/prepared == p/d);
+    }
+    return mismatches;
+}
+
+#endif
@@ -0,0 +1,368 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include "FixedPoint.h"
+#include "render.h"
+#include "tiles.h"
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <random>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+/*
+ * Micro-benchmarks of the hot building blocks of the renderer. Each benchmark
+ * checks that the fast variant gives results identical to the reference it is
+ * timed against, prints the timings to 'os' and returns false on a mismatch.
+ */
+namespace detail
+{
+    /*
+     * Best of 'runs' wall clock times, in nanoseconds per element, of 'f'
+     * processing 'n' elements.
+     */
+    template <typename F>
+    static double bench_ns(size_t n, int runs, F &&f)
+    {
+        using clock = std::chrono::steady_clock;
+        double best = 0.0;
+        for (int r=0; r<runs; ++r)
+        {
+            const auto start = clock::now();
+            f();
+            const std::chrono::duration<double, std::nano> t =
+                clock::now() - start;
+            best = r == 0 ? t.count() : std::min(best, t.count());
+        }
+        return best / n;
+    }
+
+
+    /*
+     * Hardware event counter of the calling thread, see perf_event_open(2),
+     * counting user space events only. The counter is invalid if the kernel or
+     * the hardware does not provide it, e.g. in containers or virtual machines.
+     */
+    class perf_counter
+    {
+    public:
+        perf_counter(uint32_t type, uint64_t config)
+        {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+
+        perf_counter(const perf_counter &) = delete;
+        perf_counter &operator=(const perf_counter &) = delete;
+
+        ~perf_counter()
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+
+        bool valid() const { return fd >= 0; }
+
+        void start()
+        {
+            if (fd >= 0)
+            {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+
+        uint64_t stop()
+        {
+            uint64_t count = 0;
+            if (fd >= 0)
+            {
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+                if (read(fd, &count, sizeof(count)) != sizeof(count))
+                {
+                    count = 0;
+                }
+            }
+            return count;
+        }
+
+    private:
+        int fd{ -1 };
+    };
+
+
+    /*
+     * Benchmark the bulk double conversions of the format <INT,FRAC> against
+     * the scalar conversion constructor and operator. The conversion to raw
+     * numbers alone is what the batched renderer uses.
+     */
+    template <int INT, int FRAC>
+    static bool bench_convert_format(std::ostream &os, const size_t N)
+    {
+        using T = SignedFixedPoint<INT,FRAC>;
+        constexpr int RUNS = 5;
+        std::mt19937_64 rng{ 0x6d616e64 };
+        std::uniform_real_distribution<double> dist{ -2.0, 2.0 };
+        std::vector<double> src(N), back_scalar(N), back_bulk(N);
+        for (double &d : src)
+        {
+            d = dist(rng);
+        }
+        std::vector<T> scalar(N), bulk(N);
+
+        double from_scalar = bench_ns(N, RUNS, [&]()
+        {
+            for (size_t i=0; i<N; ++i)
+            {
+                scalar[i] = T(src[i]);
+            }
+        });
+        double from_bulk = bench_ns(N, RUNS, [&]()
+        {
+            T::from_doubles(src.data(), bulk.data(), N);
+        });
+        std::vector<int64_t> raw(N);
+        double from_raw = bench_ns(N, RUNS, [&]()
+        {
+            detail::doubles_to_raw<INT,FRAC>(src.data(), raw.data(), N);
+        });
+        double to_scalar = bench_ns(N, RUNS, [&]()
+        {
+            for (size_t i=0; i<N; ++i)
+            {
+                back_scalar[i] = double(scalar[i]);
+            }
+        });
+        double to_bulk = bench_ns(N, RUNS, [&]()
+        {
+            T::to_doubles(bulk.data(), back_bulk.data(), N);
+        });
+
+        size_t mismatches = 0;
+        for (size_t i=0; i<N; ++i)
+        {
+            const auto a = scalar[i].get_num(), b = bulk[i].get_num();
+            mismatches += a.table[0] != b.table[0] || a.table[1] != b.table[1];
+            mismatches += raw[i] != (b >> (64-FRAC)).table[0];
+            mismatches += std::memcmp(
+                &back_scalar[i], &back_bulk[i], sizeof(double)) != 0;
+        }
+
+        os << "<" << INT << "," << FRAC << "> " << std::fixed;
+        os << std::setprecision(2);
+        os << "from double: " << std::setw(6) << from_scalar << " -> ";
+        os << std::setw(6) << from_bulk << " ns (raw ";
+        os << std::setw(5) << from_raw << " ns), ";
+        os << "to double: " << std::setw(6) << to_scalar << " -> ";
+        os << std::setw(6) << to_bulk << " ns";
+        os << (mismatches ? "  FAILED" : "  ok") << std::endl;
+        return mismatches == 0;
+    }
+
+
+    /*
+     * Benchmark the bailout test of the format <INT,FRAC>, see has_escaped(),
+     * against the generic comparison of the widened sum to REAL_TYPE(4.0), and
+     * the raw extra iterations of get_convergence_value() against the generic
+     * ones. The squares are drawn around the bailout, wrapped negative values
+     * included, and the escaped points from a ring outside the escape radius.
+     */
+    template <int INT, int FRAC>
+    static bool bench_bailout_format(std::ostream &os, const size_t N)
+    {
+        using T = SignedFixedPoint<INT,FRAC>;
+        constexpr int RUNS = 5;
+        std::mt19937_64 rng{ 0x6d616e64 };
+        std::uniform_real_distribution<double> sqr{ -1.0, 5.0 };
+        std::uniform_real_distribution<double> angle{ 0.0, 6.283185307179586 };
+        std::uniform_real_distribution<double> radius{ 2.0, 4.0 };
+        std::uniform_real_distribution<double> point{ -2.0, 2.0 };
+        std::vector<T> re_sqr(N), im_sqr(N);
+        std::vector<std::complex<T>> z(N), c(N);
+        for (size_t i=0; i<N; ++i)
+        {
+            re_sqr[i] = T(sqr(rng));
+            im_sqr[i] = T(i % 16 ? sqr(rng) : 4.0 - double(re_sqr[i]));
+            const std::complex<double> p = std::polar(radius(rng), angle(rng));
+            z[i] = std::complex<T>{ T(p.real()), T(p.imag()) };
+            c[i] = std::complex<T>{ T(point(rng)), T(point(rng)) };
+        }
+        std::vector<uint8_t> escaped_generic(N), escaped_fast(N);
+        std::vector<double> conv_generic(N), conv_fast(N);
+
+        double bailout_generic = bench_ns(N, RUNS, [&]()
+        {
+            for (size_t i=0; i<N; ++i)
+            {
+                escaped_generic[i] = re_sqr[i]+im_sqr[i] > T(4.0);
+            }
+        });
+        double bailout_fast = bench_ns(N, RUNS, [&]()
+        {
+            for (size_t i=0; i<N; ++i)
+            {
+                escaped_fast[i] = has_escaped(re_sqr[i], im_sqr[i]);
+            }
+        });
+        double extra_generic = bench_ns(N, RUNS, [&]()
+        {
+            for (size_t i=0; i<N; ++i)
+            {
+                conv_generic[i] = get_convergence_value<T>(
+                    0, z[i].real(), z[i].imag(), c[i]);
+            }
+        });
+        double extra_fast = bench_ns(N, RUNS, [&]()
+        {
+            for (size_t i=0; i<N; ++i)
+            {
+                conv_fast[i] = get_convergence_value(
+                    0, z[i].real(), z[i].imag(), c[i]);
+            }
+        });
+
+        size_t mismatches = 0;
+        for (size_t i=0; i<N; ++i)
+        {
+            mismatches += escaped_generic[i] != escaped_fast[i];
+            mismatches += std::memcmp(
+                &conv_generic[i], &conv_fast[i], sizeof(double)) != 0;
+        }
+
+        os << "<" << INT << "," << FRAC << "> " << std::fixed;
+        os << std::setprecision(2);
+        os << "bailout: " << std::setw(6) << bailout_generic << " -> ";
+        os << std::setw(6) << bailout_fast << " ns, ";
+        os << "convergence: " << std::setw(6) << extra_generic << " -> ";
+        os << std::setw(6) << extra_fast << " ns";
+        os << (mismatches ? "  FAILED" : "  ok") << std::endl;
+        return mismatches == 0;
+    }
+}
+
+
+/*
+ * Benchmark the bulk conversions between double and SignedFixedPoint, see
+ * SignedFixedPoint::from_doubles(), against the scalar conversions.
+ */
+static bool bench_convert(std::ostream &os)
+{
+    constexpr size_t N = 1 << 20;
+    bool ok = true;
+    ok = detail::bench_convert_format<5,12>(os, N) && ok;
+    ok = detail::bench_convert_format<16,15>(os, N) && ok;
+    ok = detail::bench_convert_format<4,28>(os, N) && ok;
+    ok = detail::bench_convert_format<4,58>(os, N) && ok;
+    return ok;
+}
+
+
+/*
+ * Benchmark the tile traversal orders, see render_tiled(), against the row by
+ * row render() of the whole image, on an 8K frame without super sampling and
+ * with few iterations, so that memory traffic is a noticeable share of the
+ * time. Prints the wall clock time and, where perf counters are available, the
+ * last level cache and L1 data cache read misses of each order, and checks
+ * that all orders give the image of render().
+ */
+static bool bench_tiles(std::ostream &os)
+{
+    using T = SignedFixedPoint<29,30>;
+    constexpr int WIDTH = 7680;
+    constexpr int HEIGHT = 4320;
+    constexpr int ITERATIONS = 64;
+    const segment_t<T> seg{ { T(-0.5), T(0.0) }, T(3.5), T(2.0) };
+    SDL_Surface *ref = SDL_CreateRGBSurface(0, WIDTH, HEIGHT, 32, 0, 0, 0, 0);
+    SDL_Surface *img = SDL_CreateRGBSurface(0, WIDTH, HEIGHT, 32, 0, 0, 0, 0);
+    if (!ref || !img || SDL_LockSurface(ref) < 0 || SDL_LockSurface(img) < 0)
+    {
+        os << "Could not create 8K surfaces." << std::endl;
+        return false;
+    }
+    const size_t bytes = size_t(ref->pitch) * HEIGHT;
+
+    detail::perf_counter llc{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES };
+    detail::perf_counter l1d{ PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_L1D |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) };
+    if (!llc.valid() || !l1d.valid())
+    {
+        os << "Perf counters unavailable, timing only." << std::endl;
+    }
+
+    const char *names[] = { "render()", "row-major", "morton", "hilbert" };
+    bool ok = true;
+    for (int order=-1; order<=TILE_HILBERT; ++order)
+    {
+        SDL_Surface *surf = order < 0 ? ref : img;
+        std::memset(surf->pixels, 0, bytes);
+        double ms = detail::bench_ns(1, 1, [&]()
+        {
+            llc.start();
+            l1d.start();
+            if (order < 0)
+            {
+                render(seg, WIDTH, HEIGHT, false, ITERATIONS, surf);
+            }
+            else
+            {
+                render_tiled(
+                    seg, WIDTH, HEIGHT, false, ITERATIONS, surf,
+                    tile_order_t(order));
+            }
+        }) * 1e-6;
+        const uint64_t l1d_misses = l1d.stop();
+        const uint64_t llc_misses = llc.stop();
+        const bool same =
+            order < 0 || std::memcmp(ref->pixels, img->pixels, bytes) == 0;
+        ok = ok && same;
+
+        os << std::left << std::setw(10) << names[order+1] << std::right;
+        os << std::fixed << std::setprecision(1) << std::setw(8) << ms;
+        os << " ms";
+        if (llc.valid() && l1d.valid())
+        {
+            os << ", LLC misses " << std::setw(10) << llc_misses;
+            os << ", L1D read misses " << std::setw(11) << l1d_misses;
+        }
+        os << (same ? "  ok" : "  FAILED") << std::endl;
+    }
+    SDL_FreeSurface(ref);
+    SDL_FreeSurface(img);
+    return ok;
+}
+
+
+/*
+ * Benchmark the bailout test and the extra iterations of the convergence value
+ * on the integer words of the fixed point numbers against the generic
+ * operators. The bailout test runs once per iteration of the per-pixel escape
+ * loop, so its timing is the saving per iteration.
+ */
+static bool bench_bailout(std::ostream &os)
+{
+    constexpr size_t N = 1 << 18;
+    bool ok = true;
+    ok = detail::bench_bailout_format<5,12>(os, N) && ok;
+    ok = detail::bench_bailout_format<16,15>(os, N) && ok;
+    ok = detail::bench_bailout_format<29,30>(os, N) && ok;
+    ok = detail::bench_bailout_format<4,28>(os, N) && ok;
+    return ok;
+}
+
+#endif
@@ -0,0 +1,336 @@
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+
+#include "render.h"
+#include "archive.h"
+#include "tiles.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <SDL/SDL.h>
+
+
+/*
+ * Checkpointed rendering. Long renders keep the escape results of their tiles
+ * in a checkpoint file, so that a render that crashed or was preempted can be
+ * resumed and only renders the tiles that were not yet completed. The file
+ * consists of a checkpoint_header_t, a completion bitmap with one bit per
+ * tile (padded to a multiple of 8 bytes) and the archive_sample_t records of
+ * the frame in archive order, see archive.h.
+ *
+ * The file is memory mapped, and the render threads write the escape results
+ * of their tiles straight into the mapping. A writer thread commits the
+ * completed tiles periodically: it first flushes the mapping to disk and only
+ * then sets the bits of the tiles in the bitmap, so that a set bit always
+ * refers to escape results that are on disk. The render threads never wait
+ * for the disk.
+ */
+constexpr char CHECKPOINT_MAGIC[8] = { 'M', 'F', 'P', 'C', 'K', 'P', 'T', '\0' };
+constexpr uint32_t CHECKPOINT_VERSION = 1;
+
+
+/*
+ * Checkpoint file header. The frame must match exactly for a checkpoint to be
+ * resumed.
+ */
+struct checkpoint_header_t
+{
+    char magic[8];              // CHECKPOINT_MAGIC
+    uint32_t version;           // CHECKPOINT_VERSION
+    uint32_t tile_size;         // Tile width and height in pixels
+    uint32_t tiles;             // Number of tiles, in row-major order
+    uint32_t reserved;
+    archive_header_t frame;     // Frame of the render
+};
+
+
+struct checkpoint_config_t
+{
+    int tile_size{ 64 };        // Tile width and height in pixels
+    int interval_ms{ 10000 };   // Time between commits of completed tiles
+    uint64_t rounding_seed{ 0 };    // Seed of the stochastic rounding
+};
+
+
+struct checkpoint_stats_t
+{
+    size_t tiles;               // Tiles of the frame
+    size_t resumed;             // Tiles loaded from the checkpoint
+    size_t commits;             // Commits of completed tiles
+};
+
+
+/*
+ * Memory-mapped checkpoint file with an asynchronous commit thread.
+ */
+class checkpoint_file
+{
+public:
+    checkpoint_file() = default;
+    checkpoint_file(const checkpoint_file &) = delete;
+    checkpoint_file &operator=(const checkpoint_file &) = delete;
+    ~checkpoint_file() { close(); }
+
+    /*
+     * Create the checkpoint file 'filename' for a frame of 'tiles' tiles, or,
+     * if 'resume' is set, open the existing checkpoint of the same frame. The
+     * completed tiles are committed every 'interval_ms' milliseconds. The
+     * function returns false on failure or if the frame of an existing
+     * checkpoint differs.
+     */
+    bool open(
+            const char *filename, const archive_header_t &frame,
+            int tile_size, int tiles, bool resume, int interval_ms)
+    {
+        close();
+        checkpoint_header_t hdr{};
+        std::memcpy(hdr.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        hdr.version = CHECKPOINT_VERSION;
+        hdr.tile_size = tile_size;
+        hdr.tiles = tiles;
+        hdr.frame = frame;
+        bitmap_size = (size_t(tiles) + 63) / 64 * 8;
+        const uint64_t n = uint64_t(frame.width) * frame.height * frame.samples;
+        size = sizeof(hdr) + bitmap_size + n*sizeof(archive_sample_t);
+
+        int fd = ::open(
+            filename, resume ? O_RDWR : O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat st{};
+        if ((!resume && ftruncate(fd, size) < 0) ||
+            fstat(fd, &st) < 0 || size_t(st.st_size) != size)
+        {
+            ::close(fd);
+            return false;
+        }
+        void *map = mmap(
+            nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED)
+        {
+            return false;
+        }
+        data = static_cast<uint8_t *>(map);
+        if (resume && std::memcmp(data, &hdr, sizeof(hdr)))
+        {
+            munmap(data, size);
+            data = nullptr;
+            return false;
+        }
+        std::memcpy(data, &hdr, sizeof(hdr));
+        resumed = 0;
+        for (int i=0; i<tiles; ++i)
+        {
+            resumed += is_committed(i);
+        }
+
+        commits = 0;
+        failed = false;
+        stop = false;
+        interval = std::chrono::milliseconds(interval_ms);
+        writer = std::thread([this]{ writer_loop(); });
+        return true;
+    }
+
+    /*
+     * Commit the remaining completed tiles, stop the writer thread and unmap
+     * the file. The function returns false if a commit failed.
+     */
+    bool close()
+    {
+        if (!data)
+        {
+            return true;
+        }
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            stop = true;
+        }
+        cv.notify_all();
+        writer.join();
+        munmap(data, size);
+        data = nullptr;
+        return !failed;
+    }
+
+    /*
+     * Test if the tile 'tile' has been committed.
+     */
+    bool is_committed(int tile) const
+    {
+        return bitmap()[tile / 8] & (1 << (tile % 8));
+    }
+
+    /*
+     * Mark the tile 'tile' as completed, once its escape results have been
+     * written to samples(). The tile is committed with the next commit.
+     */
+    void complete(int tile)
+    {
+        std::lock_guard<std::mutex> lock{ mutex };
+        pending.push_back(tile);
+    }
+
+    archive_sample_t *samples()
+    {
+        return reinterpret_cast<archive_sample_t *>(
+                data + sizeof(checkpoint_header_t) + bitmap_size);
+    }
+
+    /*
+     * Number of tiles that were committed when the file was opened, and
+     * number of commits since.
+     */
+    size_t resumed_tiles() const { return resumed; }
+    size_t commit_count() const { return commits; }
+
+private:
+    void writer_loop()
+    {
+        std::unique_lock<std::mutex> lock{ mutex };
+        for (bool last=false; !last; )
+        {
+            cv.wait_for(lock, interval, [this]{ return stop; });
+            last = stop;
+            std::vector<int> tiles{};
+            tiles.swap(pending);
+            lock.unlock();
+            commit(tiles);
+            lock.lock();
+        }
+    }
+
+    void commit(const std::vector<int> &tiles)
+    {
+        if (tiles.empty() || failed)
+        {
+            return;
+        }
+        // Escape results first, then the bitmap.
+        const size_t page = sysconf(_SC_PAGESIZE);
+        const size_t head = sizeof(checkpoint_header_t) + bitmap_size;
+        if (msync(data, size, MS_SYNC) < 0)
+        {
+            failed = true;
+            return;
+        }
+        for (int tile : tiles)
+        {
+            bitmap()[tile / 8] |= uint8_t(1 << (tile % 8));
+        }
+        failed = msync(data, (head + page - 1) / page * page, MS_SYNC) < 0;
+        ++commits;
+    }
+
+    uint8_t *bitmap() const
+    {
+        return data + sizeof(checkpoint_header_t);
+    }
+
+    uint8_t *data{ nullptr };
+    size_t size{ 0 };
+    size_t bitmap_size{ 0 };
+    size_t resumed{ 0 };
+    size_t commits{ 0 };
+    bool failed{ false };
+    bool stop{ false };
+    std::chrono::milliseconds interval{};
+    std::vector<int> pending{};
+    std::mutex mutex{};
+    std::condition_variable cv{};
+    std::thread writer{};
+};
+
+
+/*
+ * Render a segment of the madelbrot set to the SDL_Surface pointed to by surf,
+ * with a checkpoint in the file 'filename'. The SDL_Surface object should
+ * have its surface locked with SDL_LockSurface before calling this function.
+ * If 'resume' is set, the tiles committed to the existing checkpoint of the
+ * same frame are loaded instead of rendered. The remaining tiles are rendered
+ * on a thread pool, and the image is colored from the escape results of the
+ * checkpoint, as by recolor(), so that a resumed render gives the same image
+ * as one that was never interrupted. Every tile draws from its own stochastic
+ * rounding stream, so that this also holds with stochastic rounding. The
+ * complete checkpoint is kept. The function returns false if the checkpoint
+ * could not be opened or written.
+ */
+template <typename REAL_TYPE>
+bool render_checkpointed(
+        const segment_t<REAL_TYPE> &seg,
+        const int WIDTH, const int HEIGHT, const bool SUPERSAMPLE,
+        const int ITERATIONS, SDL_Surface *surf,
+        const char *filename, const bool resume,
+        const checkpoint_config_t &config, checkpoint_stats_t &stats)
+{
+    const archive_header_t frame = get_archive_header(
+            seg, WIDTH, HEIGHT, SUPERSAMPLE, ITERATIONS);
+    const std::vector<tile_t> tiles =
+        make_tiles(WIDTH, HEIGHT, config.tile_size);
+    checkpoint_file ckpt{};
+    if (!ckpt.open(filename, frame, config.tile_size, tiles.size(), resume,
+                   config.interval_ms))
+    {
+        return false;
+    }
+    std::vector<int> missing{};
+    for (int i=0; i<int(tiles.size()); ++i)
+    {
+        if (!ckpt.is_committed(i))
+        {
+            missing.push_back(i);
+        }
+    }
+
+    // Render the missing tiles, writing their escape results in archive
+    // order of the frame.
+    const unsigned S = frame.samples;
+    archive_sample_t *samples = ckpt.samples();
+    thread_pool pool{};
+    parallel_for(pool, int(missing.size()), [&](int k)
+    {
+        const tile_t &tile = tiles[missing[k]];
+        archive_header_t tile_frame = frame;
+        tile_frame.width = tile.w;
+        tile_frame.height = tile.h;
+        archive_writer archive{};
+        archive.open(tile_frame);
+        std::vector<uint32_t> pixels(size_t(tile.w) * tile.h);
+        seed_stochastic_rounding(
+            stochastic_rounding_seed(config.rounding_seed, missing[k]));
+        render_tile(
+            seg, WIDTH, HEIGHT, SUPERSAMPLE, ITERATIONS, tile, surf->format,
+            pixels.data(), tile.w, &archive);
+        archive.close();
+        const archive_sample_t *src = archive.samples().data();
+        for (int y=0; y<tile.h; ++y)
+        {
+            std::copy(
+                src + size_t(y)*tile.w*S, src + size_t(y+1)*tile.w*S,
+                samples + (size_t(tile.y + y)*WIDTH + tile.x)*S);
+        }
+        ckpt.complete(missing[k]);
+    });
+
+    recolor(frame, samples, surf);
+    stats.tiles = tiles.size();
+    stats.resumed = ckpt.resumed_tiles();
+    const bool ok = ckpt.close();
+    stats.commits = ckpt.commit_count();
+    return ok;
+}
+
+#endif
@@ -0,0 +1,400 @@
+#ifndef _DISTANCE_H
+#define _DISTANCE_H
+
+#include "render.h"
+#include "batch.h"
+#include "thread_pool.h"
+#include "FixedPoint.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <SDL/SDL.h>
+
+
+/*
+ * Distance estimation. Along with the orbit of z the escape loop iterates the
+ * derivative dz/dc, dz = 2*z*dz + 1, and once the point has escaped the
+ * distance from c to the boundary of the set is estimated as
+ *
+ *      d = |z| * ln|z| / (2 * |dz|).
+ *
+ * Relative to the pixel size the distance tells how close a pixel is to the
+ * boundary, which is used to anti-alias renders at one sample per pixel and to
+ * decide which pixels are worth super sampling.
+ */
+struct distance_t
+{
+    escape_t escape;        // Escape result, see get_escape()
+    double distance;        // Distance estimate, 0 for points within the set
+};
+
+
+/*
+ * Rendering modes using the distance estimate. DISTANCE_SHADE darkens pixels
+ * close to the boundary at one sample per pixel, DISTANCE_ADAPTIVE super
+ * samples only the pixels within ADAPTIVE_RADIUS pixels of the boundary.
+ */
+enum distance_mode_t
+{
+    DISTANCE_SHADE,
+    DISTANCE_ADAPTIVE
+};
+
+
+namespace detail
+{
+    /*
+     * The derivative grows exponentially with the iterations, which neither a
+     * fixed point format nor a double holds for long. It is therefore kept as
+     * a mantissa of REAL_TYPE times 2^exp, and the mantissa is scaled down by
+     * 2^-SHIFT until no component exceeds 2^LIMIT_EXP. The limit leaves room
+     * for one more iteration, |2*z*dz + 1| < 6*2^LIMIT_EXP, within the number
+     * range. The scale 2^-SHIFT must be representable, so SHIFT is at most
+     * the fractional bits. Formats with few integer or fractional bits have a
+     * SHIFT below the growth of an iteration, and are scaled down several
+     * times in a row.
+     */
+    template <typename REAL_TYPE>
+    struct derivative_range
+    {
+        static constexpr int LIMIT_EXP = 256;
+        static constexpr int SHIFT = 128;
+    };
+
+    template <int INT, int FRAC, typename POLICY, typename ROUNDING>
+    struct derivative_range<SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>>
+    {
+        static constexpr int LIMIT_EXP = INT - 5;
+        static constexpr int SHIFT = std::min(FRAC, std::max(1, LIMIT_EXP/2));
+        static_assert(LIMIT_EXP + FRAC >= 1,
+            "The derivative limit is not representable in the format.");
+        static_assert(SHIFT >= 1,
+            "The derivative scale is not representable in the format.");
+    };
+}
+
+
+namespace detail
+{
+    /*
+     * Distance estimate of a point 'c' whose orbit has escaped to 'z' with the
+     * derivative dz*2^exp. The derivative is iterated as many extra times as
+     * get_convergence_value() iterates z, in double.
+     */
+    static double distance_estimate(
+            std::complex<double> z, std::complex<double> dz, int exp,
+            const std::complex<double> &c)
+    {
+        const double one = std::ldexp(1.0, -exp);
+        for (int i=0; i<3; ++i)
+        {
+            dz = 2.0*z*dz + one;
+            z = z*z + c;
+        }
+        const double z_abs = std::abs(z);
+        const double dz_abs = std::ldexp(std::abs(dz), exp);
+        return z_abs*std::log(z_abs) / (2.0*dz_abs);
+    }
+}
+
+
+/*
+ * Escape loop of get_escape_unfiltered() that also iterates the derivative
+ * dz/dc, see distance_t.
+ */
+template <typename REAL_TYPE>
+static distance_t get_escape_distance_unfiltered(
+        const std::complex<REAL_TYPE> &c, unsigned iterations)
+{
+    using range = detail::derivative_range<REAL_TYPE>;
+    const REAL_TYPE LIMIT{ std::ldexp(1.0, range::LIMIT_EXP) };
+    const REAL_TYPE NEG_LIMIT{ -std::ldexp(1.0, range::LIMIT_EXP) };
+    const REAL_TYPE SCALE{ std::ldexp(1.0, -range::SHIFT) };
+    REAL_TYPE z_re{ 0.0 }, z_im{ 0.0 }, z_re_sqr{ 0.0 }, z_im_sqr{ 0.0 };
+    REAL_TYPE dz_re{ 0.0 }, dz_im{ 0.0 }, one{ 1.0 };
+    int exp = 0;
+    for (unsigned i=0; i<iterations; ++i)
+    {
+        if (has_escaped(z_re_sqr, z_im_sqr))
+        {
+            const escape_t e{ i, get_convergence_value(i, z_re, z_im, c) };
+            return { e, detail::distance_estimate(
+                { double(z_re), double(z_im) },
+                { double(dz_re), double(dz_im) }, exp,
+                { double(c.real()), double(c.imag()) }) };
+        }
+
+        // dz = 2*z*dz + 1, scaled by 2^-exp.
+        while (dz_re > LIMIT || dz_re < NEG_LIMIT ||
+               dz_im > LIMIT || dz_im < NEG_LIMIT)
+        {
+            dz_re = dz_re * SCALE;
+            dz_im = dz_im * SCALE;
+            exp += range::SHIFT;
+            one = REAL_TYPE(std::ldexp(1.0, -exp));
+        }
+        REAL_TYPE t_re = z_re*dz_re - z_im*dz_im;
+        REAL_TYPE t_im = z_re*dz_im + z_im*dz_re;
+        dz_re = t_re + t_re + one;
+        dz_im = t_im + t_im;
+
+        // z = z*z + c
+        z_im = (z_re+z_im)*(z_re+z_im) - z_re_sqr - z_im_sqr + c.imag();
+        z_re = z_re_sqr - z_im_sqr + c.real();
+        z_re_sqr = z_re * z_re;
+        z_im_sqr = z_im * z_im;
+    }
+
+    // Escape didn't happen.
+    return { { iterations, 0.0 }, 0.0 };
+}
+
+
+/*
+ * Fixed point variant of the loop, on raw numbers. z is stepped by the escape
+ * kernel, see escape_kernel, and the derivative is rounded and fit the same
+ * way, so the result is identical to that of the generic loop.
+ */
+template <int INT, int FRAC, typename POLICY, typename ROUNDING>
+static distance_t get_escape_distance_unfiltered(
+        const std::complex<SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>> &c,
+        unsigned iterations)
+{
+    using REAL_TYPE = SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>;
+    using range = detail::derivative_range<REAL_TYPE>;
+    using kernel = escape_kernel<INT,FRAC,POLICY,ROUNDING>;
+    using raw = raw_format<INT,FRAC,POLICY,ROUNDING>;
+    using wide_type = typename raw::wide_type;
+    const int64_t LIMIT = raw::to_raw(std::ldexp(1.0, range::LIMIT_EXP));
+    const int64_t SCALE = raw::to_raw(std::ldexp(1.0, -range::SHIFT));
+    const int64_t c_re = raw::to_raw(c.real()), c_im = raw::to_raw(c.imag());
+    int64_t z_re = 0, z_im = 0, z_re_sqr = 0, z_im_sqr = 0;
+    int64_t dz_re = 0, dz_im = 0, one = raw::to_raw(1.0);
+    int exp = 0;
+    for (unsigned i=0; i<iterations; ++i)
+    {
+        if (kernel::escaped(z_re_sqr, z_im_sqr))
+        {
+            const escape_t e{ i, get_convergence_value_raw<
+                INT,FRAC,POLICY,ROUNDING>(i, z_re, z_im, c_re, c_im) };
+            return { e, detail::distance_estimate(
+                { double(raw::from_raw(z_re)), double(raw::from_raw(z_im)) },
+                { double(raw::from_raw(dz_re)), double(raw::from_raw(dz_im)) },
+                exp, { double(c.real()), double(c.imag()) }) };
+        }
+
+        while (dz_re > LIMIT || dz_re < -LIMIT ||
+               dz_im > LIMIT || dz_im < -LIMIT)
+        {
+            dz_re = raw::narrow(wide_type(dz_re) * SCALE);
+            dz_im = raw::narrow(wide_type(dz_im) * SCALE);
+            exp += range::SHIFT;
+            one = raw::to_raw(std::ldexp(1.0, -exp));
+        }
+        const int64_t t_re = raw::narrow(
+            wide_type(z_re)*dz_re - wide_type(z_im)*dz_im);
+        const int64_t t_im = raw::narrow(
+            wide_type(z_re)*dz_im + wide_type(z_im)*dz_re);
+        dz_re = raw::fit(wide_type(t_re) + t_re + one);
+        dz_im = raw::fit(wide_type(t_im) + t_im);
+
+        kernel::step(z_re, z_im, z_re_sqr, z_im_sqr, c_re, c_im);
+    }
+
+    // Escape didn't happen.
+    return { { iterations, 0.0 }, 0.0 };
+}
+
+
+/*
+ * Escape result and distance estimate of a point 'c' on the complex plane. The
+ * escape iteration and convergence value equal those of get_escape(), as z is
+ * iterated by the same expressions.
+ */
+template <typename REAL_TYPE>
+static distance_t get_escape_distance(
+        const std::complex<REAL_TYPE> &c, unsigned iterations)
+{
+    const distance_t IN_SET{ { iterations, 0.0 }, 0.0 };
+    REAL_TYPE x = c.real();
+    REAL_TYPE y = c.imag();
+    REAL_TYPE q = (x - REAL_TYPE(0.25))*(x - REAL_TYPE(0.25)) + y*y;
+    if ( q*(q+x-REAL_TYPE(0.25)) < REAL_TYPE(0.25)*REAL_TYPE(y*y) )
+    {
+        // Inside main cardioid.
+        return IN_SET;
+    }
+    else if ( (x+REAL_TYPE(1))*(x+REAL_TYPE(1)) + y*y < REAL_TYPE(0.0625) )
+    {
+        // Inside period one bulb.
+        return IN_SET;
+    }
+    else
+    {
+        // Test requiered.
+        return get_escape_distance_unfiltered(c, iterations);
+    }
+}
+
+
+namespace detail
+{
+    /*
+     * Reference of the distance estimate loop of the fixed point format T, with
+     * z iterated by the generic operators and the derivative in double, so it
+     * differs only by the rounding and scaling of the derivative.
+     */
+    template <typename T>
+    static distance_t reference_distance(
+            const std::complex<T> &c, unsigned iterations)
+    {
+        T z_re{ 0.0 }, z_im{ 0.0 }, z_re_sqr{ 0.0 }, z_im_sqr{ 0.0 };
+        std::complex<double> dz{ 0.0 };
+        for (unsigned i=0; i<iterations; ++i)
+        {
+            if (has_escaped(z_re_sqr, z_im_sqr))
+            {
+                const escape_t e{ i, get_convergence_value(i, z_re, z_im, c) };
+                return { e, distance_estimate(
+                    { double(z_re), double(z_im) }, dz, 0,
+                    { double(c.real()), double(c.imag()) }) };
+            }
+            dz = 2.0*std::complex<double>{ double(z_re), double(z_im) }*dz;
+            dz += 1.0;
+            z_im = (z_re+z_im)*(z_re+z_im) - z_re_sqr - z_im_sqr + c.imag();
+            z_re = z_re_sqr - z_im_sqr + c.real();
+            z_re_sqr = z_re * z_re;
+            z_im_sqr = z_im * z_im;
+        }
+        return { { iterations, 0.0 }, 0.0 };
+    }
+}
+
+
+/*
+ * Check the distance estimate of the format <INT,FRAC> for random points around
+ * the set, with 'iterations' iterations. The raw loop must equal the generic
+ * loop, and the distance of every escaped point must be within a factor of two
+ * of that of detail::reference_distance(). Formats with very few integer bits
+ * wrap the derivative and can not be checked. Returns the number of mismatching
+ * samples out of 'samples'.
+ */
+template <int INT, int FRAC>
+uint64_t verify_distance_estimate(
+        uint64_t samples, unsigned iterations, uint64_t seed)
+{
+    using T = SignedFixedPoint<INT,FRAC>;
+    std::mt19937_64 rng{ seed };
+    std::uniform_real_distribution<double> re{ -2.0, 0.5 }, im{ -1.25, 1.25 };
+    uint64_t mismatches = 0;
+    for (uint64_t i=0; i<samples; ++i)
+    {
+        const std::complex<T> c{ T(re(rng)), T(im(rng)) };
+        const distance_t d = get_escape_distance_unfiltered(c, iterations);
+        const distance_t generic = get_escape_distance_unfiltered<T>(
+            c, iterations);
+        const distance_t ref = detail::reference_distance(c, iterations);
+        bool ok = d.escape.iteration == generic.escape.iteration &&
+            d.distance == generic.distance &&
+            d.escape.iteration == ref.escape.iteration;
+        if (d.escape.iteration < iterations)
+        {
+            ok = ok && std::isfinite(d.distance) &&
+                d.distance <= 2.0*ref.distance &&
+                ref.distance <= 2.0*d.distance;
+        }
+        mismatches += !ok;
+    }
+    return mismatches;
+}
+
+
+/*
+ * Color of a distance estimate result of a pixel of width 'px_size' on the
+ * complex plane. Escaped points closer to the boundary than one pixel fade to
+ * the black of the set, which anti-aliases the filaments of the set without
+ * super sampling.
+ */
+static SDL_Color get_distance_color(
+        const distance_t &d, unsigned iterations, double px_size)
+{
+    SDL_Color c = get_escape_color(d.escape, iterations);
+    if (d.escape.iteration < iterations)
+    {
+        const double shade = std::min(1.0, std::sqrt(d.distance / px_size));
+        c.r = uint8_t(c.r * shade);
+        c.g = uint8_t(c.g * shade);
+        c.b = uint8_t(c.b * shade);
+    }
+    return c;
+}
+
+
+/*
+ * Render a segment of the mandelbrot set to the SDL_Surface pointed to by surf
+ * using the distance estimate in the mode 'mode'. The SDL_Surface object should
+ * have its surface locked with SDL_LockSurface before calling this function.
+ * The sample point of every pixel is the first super sampling point, see
+ * get_sample_points(), so in DISTANCE_ADAPTIVE mode its escape result is reused
+ * and the pixels far from the boundary equal those of a render without super
+ * sampling, while those close to it equal those of a 4x super sampled render.
+ * Points within the set have no distance and are not super sampled, the escaped
+ * pixels next to them carry the anti-aliasing of the boundary. Rows are
+ * distributed over the thread pool 'pool', each with its own stochastic
+ * rounding stream of the seed 'rounding_seed'. Returns the number of super
+ * sampled pixels.
+ */
+template <typename REAL_TYPE>
+static uint64_t render_distance(
+        const segment_t<REAL_TYPE> &seg,
+        const int WIDTH, const int HEIGHT, const int ITERATIONS,
+        SDL_Surface *surf, distance_mode_t mode, thread_pool &pool,
+        const uint64_t rounding_seed = 0)
+{
+    // Pixels within this many pixels of the boundary are super sampled.
+    constexpr double ADAPTIVE_RADIUS = 2.0;
+    const pixel_grid<REAL_TYPE> grid{ seg, WIDTH, HEIGHT };
+    const double px_size = double(seg.w) / WIDTH;
+    std::atomic<uint64_t> supersampled{ 0 };
+    parallel_for(pool, HEIGHT, [&](int px_y)
+    {
+        seed_stochastic_rounding(stochastic_rounding_seed(rounding_seed, px_y));
+        uint32_t *px = (uint32_t *)
+            ((uint8_t *)surf->pixels + size_t(px_y)*surf->pitch);
+        uint64_t row_supersampled = 0;
+        for (int px_x=0; px_x<WIDTH; ++px_x)
+        {
+            const segment_t<REAL_TYPE> px_seg = grid(px_x, px_y);
+            const distance_t d = get_escape_distance(px_seg.c, ITERATIONS);
+            SDL_Color c{};
+            if (mode == DISTANCE_SHADE)
+            {
+                c = get_distance_color(d, ITERATIONS, px_size);
+            }
+            else if (d.escape.iteration < unsigned(ITERATIONS) &&
+                     d.distance < ADAPTIVE_RADIUS*px_size)
+            {
+                std::complex<REAL_TYPE> points[4]{};
+                get_sample_points(px_seg, points);
+                escape_t res[4]{ d.escape };
+                for (int i=1; i<4; ++i)
+                {
+                    res[i] = get_escape(points[i], ITERATIONS);
+                }
+                c = get_average_color(res, ITERATIONS);
+                ++row_supersampled;
+            }
+            else
+            {
+                c = get_escape_color(d.escape, ITERATIONS);
+            }
+            px[px_x] = SDL_MapRGB(surf->format, c.r, c.g, c.b);
+        }
+        supersampled += row_supersampled;
+    });
+    return supersampled;
+}
+
+#endif
@@ -0,0 +1,310 @@
+#ifndef _DISTRIBUTED_H
+#define _DISTRIBUTED_H
+
+#include "render.h"
+#include "tiles.h"
+#include "estimate.h"
+#include "socket_io.h"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+/*
+ * Distributed tile rendering across local worker processes. The coordinator
+ * splits the image into tiles and hands them to forked worker processes over
+ * a socket pair per worker. Each worker renders its tile with render_tile()
+ * and sends back the pixels, so the assembled image is bit identical to the
+ * single process render. Tiles of dead workers are re-issued and dead workers
+ * are replaced. Tiles that run for longer than 'slow_ms' are speculatively
+ * issued to idle workers once there is no other work left, and the first
+ * result to arrive is used. Given a render estimate, the tiles are issued in
+ * decreasing order of their estimated cost instead, see order_tiles_by_cost().
+ */
+struct distributed_config_t
+{
+    int workers{ 4 };           // Number of worker processes
+    int tile_size{ 64 };        // Tile width and height in pixels
+    tile_order_t tile_order{ TILE_ROW_MAJOR };  // Order tiles are issued in
+    const render_estimate_t *estimate{ nullptr };   // Issue longest first
+    int slow_ms{ 2000 };        // Time before a tile is considered slow
+    int max_respawns{ 16 };     // Number of dead workers that are replaced
+};
+
+
+namespace detail
+{
+    /*
+     * Tile request and response header. A response header is followed by
+     * tile.w*tile.h pixels.
+     */
+    struct tile_msg_t
+    {
+        int32_t id;
+        tile_t tile;
+    };
+
+    /*
+     * Worker process main loop. Renders requested tiles until the coordinator
+     * closes the socket.
+     */
+    template <typename REAL_TYPE>
+    static void distributed_worker(
+            int fd, const segment_t<REAL_TYPE> &seg,
+            const int WIDTH, const int HEIGHT, const bool SUPERSAMPLE,
+            const int ITERATIONS, const SDL_PixelFormat *fmt)
+    {
+        tile_msg_t msg{};
+        std::vector<uint32_t> pixels{};
+        while (read_full(fd, &msg, sizeof(msg)))
+        {
+            pixels.resize(size_t(msg.tile.w) * msg.tile.h);
+            render_tile(
+                seg, WIDTH, HEIGHT, SUPERSAMPLE, ITERATIONS, msg.tile, fmt,
+                pixels.data(), msg.tile.w);
+            if (!write_full(fd, &msg, sizeof(msg)) ||
+                !write_full(fd, pixels.data(), pixels.size()*sizeof(uint32_t)))
+            {
+                break;
+            }
+        }
+    }
+}
+
+
+/*
+ * Render a segment of the madelbrot set to the SDL_Surface pointed to by surf
+ * using local worker processes. The SDL_Surface object should have its surface
+ * locked with SDL_LockSurface before calling this function. The function
+ * returns false if the image could not be completed.
+ */
+template <typename REAL_TYPE>
+bool render_distributed(
+        const segment_t<REAL_TYPE> &seg,
+        const int WIDTH, const int HEIGHT, const bool SUPERSAMPLE,
+        const int ITERATIONS, SDL_Surface *surf,
+        const distributed_config_t &config = distributed_config_t{})
+{
+    using clock = std::chrono::steady_clock;
+    using detail::tile_msg_t;
+    constexpr int IDLE = -1;
+
+    struct worker_t
+    {
+        pid_t pid;
+        int fd;
+        int tile;                   // Tile being rendered, or IDLE
+        clock::time_point start;    // Start time of the current tile
+    };
+
+    // Split the image into tiles.
+    std::vector<tile_t> tiles =
+        make_tiles(WIDTH, HEIGHT, config.tile_size, config.tile_order);
+    if (config.estimate)
+    {
+        order_tiles_by_cost(*config.estimate, tiles);
+    }
+    std::deque<int> pending{};
+    for (int i=0; i<int(tiles.size()); ++i)
+    {
+        pending.push_back(i);
+    }
+    std::vector<bool> done(tiles.size(), false);
+    std::vector<bool> reissued(tiles.size(), false);
+    size_t remaining = tiles.size();
+
+    const worker_t NO_WORKER{ -1, -1, IDLE, clock::time_point{} };
+    std::vector<worker_t> workers(config.workers, NO_WORKER);
+
+    // Spawn a worker process connected through a socket pair.
+    auto spawn = [&](worker_t &w) -> bool
+    {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+        {
+            return false;
+        }
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            ::close(sv[0]);
+            ::close(sv[1]);
+            return false;
+        }
+        if (pid == 0)
+        {
+            // Close the coordinator side of all sockets, otherwise workers
+            // would keep each other's sockets open.
+            ::close(sv[0]);
+            for (const worker_t &other : workers)
+            {
+                if (other.fd >= 0)
+                    ::close(other.fd);
+            }
+            detail::distributed_worker(
+                sv[1], seg, WIDTH, HEIGHT, SUPERSAMPLE, ITERATIONS,
+                surf->format);
+            _exit(EXIT_SUCCESS);
+        }
+        ::close(sv[1]);
+        w = worker_t{ pid, sv[0], IDLE, clock::now() };
+        return true;
+    };
+
+    // Terminate a worker and return its tile to the queue.
+    auto retire = [&](worker_t &w)
+    {
+        ::close(w.fd);
+        kill(w.pid, SIGKILL);
+        waitpid(w.pid, nullptr, 0);
+        if (w.tile != IDLE && !done[w.tile])
+        {
+            pending.push_front(w.tile);
+        }
+        w.fd = -1;
+        w.tile = IDLE;
+    };
+
+    for (worker_t &w : workers)
+    {
+        spawn(w);
+    }
+    int respawns = config.max_respawns;
+
+    std::vector<uint32_t> pixels{};
+    uint32_t *px = (uint32_t *)surf->pixels;
+    while (remaining > 0)
+    {
+        // Hand out work to idle workers. Pending tiles first, then slow tiles
+        // that have not yet been re-issued.
+        for (worker_t &w : workers)
+        {
+            if (w.fd < 0 || w.tile != IDLE)
+                continue;
+            int tile = IDLE;
+            while (!pending.empty() && tile == IDLE)
+            {
+                tile = pending.front();
+                pending.pop_front();
+                tile = done[tile] ? IDLE : tile;
+            }
+            if (tile == IDLE)
+            {
+                auto now = clock::now();
+                for (const worker_t &other : workers)
+                {
+                    auto ms = std::chrono::duration_cast<
+                        std::chrono::milliseconds>(now - other.start).count();
+                    if (other.fd >= 0 && other.tile != IDLE &&
+                        !reissued[other.tile] && ms > config.slow_ms)
+                    {
+                        tile = other.tile;
+                        reissued[tile] = true;
+                        break;
+                    }
+                }
+            }
+            if (tile == IDLE)
+                continue;
+            tile_msg_t msg{ tile, tiles[tile] };
+            w.tile = tile;
+            w.start = clock::now();
+            if (!detail::write_full(w.fd, &msg, sizeof(msg)))
+            {
+                retire(w);
+            }
+        }
+
+        // Replace dead workers while the respawn budget allows it.
+        int alive = 0;
+        for (worker_t &w : workers)
+        {
+            if (w.fd < 0 && respawns > 0 && spawn(w))
+            {
+                --respawns;
+            }
+            alive += w.fd >= 0;
+        }
+        if (alive == 0)
+        {
+            return false;
+        }
+
+        // Wait for results, or time out to check for slow tiles.
+        std::vector<pollfd> fds{};
+        std::vector<worker_t *> owners{};
+        for (worker_t &w : workers)
+        {
+            if (w.fd >= 0 && w.tile != IDLE)
+            {
+                fds.push_back(pollfd{ w.fd, POLLIN, 0 });
+                owners.push_back(&w);
+            }
+        }
+        int res = poll(fds.data(), fds.size(), config.slow_ms);
+        if (res < 0 && errno != EINTR)
+        {
+            break;
+        }
+        for (size_t i=0; i<fds.size() && res > 0; ++i)
+        {
+            worker_t &w = *owners[i];
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+
+            // Read the result, a failed read means that the worker died.
+            tile_msg_t msg{};
+            if (!detail::read_full(w.fd, &msg, sizeof(msg)) ||
+                msg.id != w.tile)
+            {
+                retire(w);
+                continue;
+            }
+            const tile_t &t = tiles[msg.id];
+            pixels.resize(size_t(t.w) * t.h);
+            if (!detail::read_full(
+                        w.fd, pixels.data(), pixels.size()*sizeof(uint32_t)))
+            {
+                retire(w);
+                continue;
+            }
+            w.tile = IDLE;
+
+            // First result of a tile wins.
+            if (done[msg.id])
+                continue;
+            for (int y=0; y<t.h; ++y)
+            {
+                std::copy(
+                    pixels.begin() + y*t.w, pixels.begin() + (y+1)*t.w,
+                    px + size_t(t.y + y)*WIDTH + t.x);
+            }
+            done[msg.id] = true;
+            --remaining;
+        }
+    }
+
+    // Shut down the workers. Closing the socket ends the worker loop, workers
+    // still rendering a duplicate of a slow tile are killed.
+    for (worker_t &w : workers)
+    {
+        if (w.fd >= 0)
+        {
+            ::close(w.fd);
+            if (w.tile != IDLE)
+            {
+                kill(w.pid, SIGKILL);
+            }
+            waitpid(w.pid, nullptr, 0);
+        }
+    }
+    return remaining == 0;
+}
+
+#endif
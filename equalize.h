@@ -0,0 +1,202 @@
+#ifndef _EQUALIZE_H
+#define _EQUALIZE_H
+
+#include "render.h"
+#include "archive.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <SDL/SDL.h>
+
+
+/*
+ * Histogram-equalized coloring. Instead of mapping the convergence value of
+ * every sample to a hue on its own, see palette_default(), the samples of the
+ * whole frame are colored by the cumulative distribution of their convergence
+ * values, so that the colors spread evenly over the image regardless of zoom
+ * depth and iteration limit. The coloring runs in two passes over the escape
+ * results of a frame in archive order, see archive.h: a histogram pass and a
+ * coloring pass, each distributed over a thread pool in blocks of contiguous
+ * rows.
+ */
+namespace detail
+{
+    /*
+     * Palette of the equalized coloring, mapping the cumulative distribution
+     * value 't' in [0, 1] to a color. The hue runs over most, but not all, of
+     * the color circle, so that the first and last samples differ in color.
+     */
+    static SDL_Color palette_equalized(double t)
+    {
+        return hsl_to_rgb(5.0*t, 1.0, 0.7);
+    }
+
+
+    /*
+     * Cumulative distribution of the convergence values of the escaped samples
+     * of a frame, with one histogram bin per integer convergence value and
+     * linear interpolation within the bins.
+     */
+    class equalizer
+    {
+    public:
+        equalizer(
+                const archive_header_t &hdr, const archive_sample_t *samples,
+                thread_pool &pool)
+            : bins( hdr.iterations + BIN_MARGIN ),
+              cdf( bins + 1, 0.0 )
+        {
+            // Histogram pass, one local histogram per block of rows.
+            const int blocks = block_count(hdr, pool);
+            const size_t block_samples =
+                size_t(rows_per_block(hdr, blocks)) * hdr.width * hdr.samples;
+            const size_t n =
+                size_t(hdr.width) * hdr.height * hdr.samples;
+            std::vector<std::vector<uint32_t>> local(blocks);
+            parallel_for(pool, blocks, [&](int b)
+            {
+                std::vector<uint32_t> &hist = local[b];
+                hist.assign(bins, 0);
+                const size_t begin = std::min(n, b*block_samples);
+                const size_t end = std::min(n, begin + block_samples);
+                for (size_t i=begin; i<end; ++i)
+                {
+                    if (samples[i].iteration < hdr.iterations)
+                    {
+                        ++hist[bin(conv(samples[i]))];
+                    }
+                }
+            });
+
+            // Merge the histograms and accumulate the distribution.
+            uint64_t total = 0;
+            std::vector<uint64_t> hist(bins, 0);
+            for (const std::vector<uint32_t> &h : local)
+            {
+                for (int k=0; k<bins; ++k)
+                {
+                    hist[k] += h[k];
+                }
+            }
+            for (int k=0; k<bins; ++k)
+            {
+                cdf[k] = double(total);
+                total += hist[k];
+            }
+            cdf[bins] = double(total);
+            const double scale = total ? 1.0 / double(total) : 0.0;
+            for (double &c : cdf)
+            {
+                c *= scale;
+            }
+
+            // Colors of the distribution values.
+            for (int i=0; i<LUT_SIZE; ++i)
+            {
+                lut[i] = palette_equalized(double(i) / (LUT_SIZE-1));
+            }
+        }
+
+        /*
+         * Color of the convergence value 'c', to be used as the palette of
+         * get_escape_color().
+         */
+        SDL_Color operator()(double c) const
+        {
+            const int k = bin(c);
+            const double f = std::min(std::max(c - k, 0.0), 1.0);
+            const double t = cdf[k] + (cdf[k+1] - cdf[k])*f;
+            return lut[int(t*(LUT_SIZE-1) + 0.5)];
+        }
+
+        /*
+         * Number of blocks of rows the passes are split into, and the rows of
+         * each block.
+         */
+        static int block_count(const archive_header_t &hdr, thread_pool &pool)
+        {
+            return std::max(1, std::min(int(hdr.height), 4*int(pool.size())));
+        }
+
+        static int rows_per_block(const archive_header_t &hdr, int blocks)
+        {
+            return (int(hdr.height) + blocks - 1) / blocks;
+        }
+
+        static double conv(const archive_sample_t &s)
+        {
+            return double(s.iteration) + s.smooth;
+        }
+
+    private:
+        // The convergence value exceeds the escape iteration by the extra
+        // iterations of get_convergence_value().
+        static constexpr int BIN_MARGIN = 8;
+        static constexpr int LUT_SIZE = 4096;
+
+        int bin(double c) const
+        {
+            return std::min(std::max(int(c), 0), bins-1);
+        }
+
+        const int bins;
+        std::vector<double> cdf;
+        SDL_Color lut[LUT_SIZE]{};
+    };
+}
+
+
+/*
+ * Color the frame of the header 'hdr' from its escape results 'samples', in
+ * archive order, by histogram equalization. The surface must have the same
+ * dimensions as the frame and it should be locked with SDL_LockSurface before
+ * calling this function. Both passes are distributed over the thread pool
+ * 'pool'.
+ */
+static void recolor_equalized(
+        const archive_header_t &hdr, const archive_sample_t *samples,
+        SDL_Surface *surf, thread_pool &pool)
+{
+    using detail::equalizer;
+    const equalizer eq{ hdr, samples, pool };
+    auto palette = [&eq](double c) { return eq(c); };
+
+    // Coloring pass, in the same blocks of rows as the histogram pass.
+    const int blocks = equalizer::block_count(hdr, pool);
+    const int rows = equalizer::rows_per_block(hdr, blocks);
+    const unsigned S = hdr.samples;
+    parallel_for(pool, blocks, [&](int b)
+    {
+        const int y_end = std::min(int(hdr.height), (b+1)*rows);
+        for (int y=b*rows; y<y_end; ++y)
+        {
+            uint32_t *px = (uint32_t *)
+                ((uint8_t *)surf->pixels + size_t(y)*surf->pitch);
+            const archive_sample_t *sample =
+                samples + size_t(y)*hdr.width*S;
+            for (unsigned x=0; x<hdr.width; ++x, sample += S)
+            {
+                escape_t res[4]{};
+                for (unsigned s=0; s<S; ++s)
+                {
+                    res[s].iteration = sample[s].iteration;
+                    res[s].conv = equalizer::conv(sample[s]);
+                }
+                SDL_Color c = S == 4 ?
+                    get_average_color(res, hdr.iterations, palette) :
+                    get_escape_color(res[0], hdr.iterations, palette);
+                px[x] = SDL_MapRGB(surf->format, c.r, c.g, c.b);
+            }
+        }
+    });
+}
+
+static void recolor_equalized(
+        const archive_reader &archive, SDL_Surface *surf, thread_pool &pool)
+{
+    recolor_equalized(archive.header(), archive.samples(), surf, pool);
+}
+
+#endif
@@ -0,0 +1,237 @@
+#ifndef _ESTIMATE_H
+#define _ESTIMATE_H
+
+#include "render.h"
+#include "archive.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+#include <SDL/SDL.h>
+
+
+/*
+ * Render time estimation. The iteration work of a frame varies by orders of
+ * magnitude with the segment, the iteration limit and the number format, so
+ * the frame is first rendered on a sparse grid of one sample per STRIDE x
+ * STRIDE pixels, with the same render path and format as the full render. The
+ * time of the sample render extrapolates to the wall time of the frame, and
+ * the escape iterations of the samples give the cost of every region of the
+ * image, from which tiles are scheduled longest first.
+ */
+struct render_estimate_t
+{
+    int width, height;          // Image dimensions in pixels
+    int grid_w, grid_h;         // Sample grid dimensions
+    std::vector<double> cost;   // Estimated iterations per pixel of each cell
+    double iterations;          // Estimated iterations of the whole image
+    double sample_ms;           // Time of the sample render
+    double ms;                  // Estimated time of the whole image
+
+    /*
+     * Fraction of the pixels of the image that were sampled.
+     */
+    double sampled() const
+    {
+        return double(grid_w) * grid_h / (double(width) * height);
+    }
+};
+
+
+namespace detail
+{
+    /*
+     * Test if the point (x, y) lies in the main cardioid or the period 2
+     * bulb, which get_escape() does not iterate.
+     */
+    static bool in_main_bulbs(double x, double y)
+    {
+        const double q = (x - 0.25)*(x - 0.25) + y*y;
+        return q*(q + x - 0.25) < 0.25*y*y ||
+               (x + 1.0)*(x + 1.0) + y*y < 0.0625;
+    }
+}
+
+
+/*
+ * Estimate the render of a WIDTH x HEIGHT image of the segment 'seg' by
+ * rendering a grid of one sample per STRIDE x STRIDE pixels. Every cell of
+ * the grid stands for the block of pixels at its upper left corner, and its
+ * cost is the number of escape iterations of its sample, plus one per super
+ * sample for the work outside the escape loop.
+ */
+template <typename REAL_TYPE>
+render_estimate_t estimate_render(
+        const segment_t<REAL_TYPE> &seg,
+        const int WIDTH, const int HEIGHT, const bool SUPERSAMPLE,
+        const int ITERATIONS, const int STRIDE = 8)
+{
+    render_estimate_t est{};
+    est.width = WIDTH;
+    est.height = HEIGHT;
+    est.grid_w = (WIDTH + STRIDE - 1) / STRIDE;
+    est.grid_h = (HEIGHT + STRIDE - 1) / STRIDE;
+    est.cost.assign(size_t(est.grid_w) * est.grid_h, 0.0);
+
+    // Render the sample grid as a smaller image of the same segment, keeping
+    // the escape results in memory.
+    SDL_Surface *surf = SDL_CreateRGBSurface(
+            0, est.grid_w, est.grid_h, 32, 0, 0, 0, 0);
+    if (!surf)
+    {
+        return est;
+    }
+    archive_header_t header{};
+    header.width = est.grid_w;
+    header.height = est.grid_h;
+    header.samples = SUPERSAMPLE ? 4 : 1;
+    archive_writer archive{};
+    archive.open(header);
+    auto t1 = std::chrono::steady_clock::now();
+    render(seg, est.grid_w, est.grid_h, SUPERSAMPLE, ITERATIONS, surf,
+           &archive);
+    auto t2 = std::chrono::steady_clock::now();
+    SDL_FreeSurface(surf);
+    archive.close();
+    est.sample_ms =
+        std::chrono::duration<double, std::milli>(t2 - t1).count();
+
+    // Cost of every cell, where samples within the main cardioid and the
+    // period 2 bulb cost no iterations.
+    const double re = double(seg.c.real()) - double(seg.w)/2.0;
+    const double im = double(seg.c.imag()) - double(seg.h)/2.0;
+    const double px_w = double(seg.w) / est.grid_w;
+    const double px_h = double(seg.h) / est.grid_h;
+    const std::vector<archive_sample_t> &samples = archive.samples();
+    const unsigned S = header.samples;
+    double total = 0.0;
+    for (int y=0; y<est.grid_h; ++y)
+    {
+        for (int x=0; x<est.grid_w; ++x)
+        {
+            const size_t i = size_t(y)*est.grid_w + x;
+            double cost = S;
+            for (unsigned s=0; s<S && i*S + s < samples.size(); ++s)
+            {
+                const double c_re = re + px_w*(x + 0.5*(s & 1));
+                const double c_im = im + px_h*(y + 0.5*(s >> 1));
+                if (!detail::in_main_bulbs(c_re, c_im))
+                {
+                    cost += samples[i*S + s].iteration;
+                }
+            }
+            // Pixels of the image per cell.
+            const double cell_w =
+                double((x+1)*WIDTH/est.grid_w - x*WIDTH/est.grid_w);
+            const double cell_h =
+                double((y+1)*HEIGHT/est.grid_h - y*HEIGHT/est.grid_h);
+            est.cost[i] = cost;
+            total += cost * cell_w * cell_h;
+        }
+    }
+    est.iterations = total;
+    est.ms = est.sample_ms / est.sampled();
+    return est;
+}
+
+
+/*
+ * Estimated iterations of the tile 'tile', from the cells of the sample grid
+ * that overlap it.
+ */
+static double estimate_tile_cost(
+        const render_estimate_t &est, const tile_t &tile)
+{
+    if (est.grid_w == 0 || est.grid_h == 0)
+    {
+        return 0.0;
+    }
+    // Cell x covers the pixels [x*width/grid_w, (x+1)*width/grid_w).
+    auto overlap = [](int cell, int cells, int size, int begin, int end)
+    {
+        const int lo = std::max(begin, int(int64_t(cell)*size/cells));
+        const int hi = std::min(end, int(int64_t(cell+1)*size/cells));
+        return std::max(0, hi - lo);
+    };
+    const int x0 = int(int64_t(tile.x) * est.grid_w / est.width);
+    const int y0 = int(int64_t(tile.y) * est.grid_h / est.height);
+    double cost = 0.0;
+    for (int y=y0; y<est.grid_h; ++y)
+    {
+        if (int64_t(y)*est.height/est.grid_h >= tile.y + tile.h)
+            break;
+        const int h = overlap(y, est.grid_h, est.height, tile.y,
+                              tile.y + tile.h);
+        for (int x=x0; x<est.grid_w; ++x)
+        {
+            if (int64_t(x)*est.width/est.grid_w >= tile.x + tile.w)
+                break;
+            const int w = overlap(x, est.grid_w, est.width, tile.x,
+                                  tile.x + tile.w);
+            cost += est.cost[size_t(y)*est.grid_w + x] * w * h;
+        }
+    }
+    return cost;
+}
+
+
+/*
+ * Sort the tiles by decreasing estimated cost. Tiles handed out in this order
+ * to whichever worker becomes idle first are scheduled by the longest
+ * processing time (LPT) rule, so that no expensive tile is left for the end
+ * of the render.
+ */
+static void order_tiles_by_cost(
+        const render_estimate_t &est, std::vector<tile_t> &tiles)
+{
+    std::vector<std::pair<double, tile_t>> keyed{};
+    keyed.reserve(tiles.size());
+    for (const tile_t &tile : tiles)
+    {
+        keyed.emplace_back(estimate_tile_cost(est, tile), tile);
+    }
+    std::stable_sort(keyed.begin(), keyed.end(),
+        [](const std::pair<double, tile_t> &a,
+           const std::pair<double, tile_t> &b) { return a.first > b.first; });
+    for (size_t i=0; i<tiles.size(); ++i)
+    {
+        tiles[i] = keyed[i].second;
+    }
+}
+
+
+/*
+ * Estimated wall time of rendering the tiles, in the given order, on
+ * 'workers' parallel workers that each take the next tile when they become
+ * idle. The time of a tile is its share of the estimated iterations of the
+ * image, times the estimated time of the image.
+ */
+static double estimate_parallel_ms(
+        const render_estimate_t &est, const std::vector<tile_t> &tiles,
+        const int workers)
+{
+    if (est.iterations <= 0.0)
+    {
+        return 0.0;
+    }
+    std::priority_queue<double, std::vector<double>, std::greater<double>>
+        idle_at{};
+    for (int i=0; i<std::max(1, workers); ++i)
+    {
+        idle_at.push(0.0);
+    }
+    double makespan = 0.0;
+    for (const tile_t &tile : tiles)
+    {
+        const double end = idle_at.top() +
+            est.ms * estimate_tile_cost(est, tile) / est.iterations;
+        idle_at.pop();
+        idle_at.push(end);
+        makespan = std::max(makespan, end);
+    }
+    return makespan;
+}
+
+#endif
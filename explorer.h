@@ -0,0 +1,447 @@
+#ifndef _EXPLORER_H
+#define _EXPLORER_H
+
+#include "render.h"
+#include "formats.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <SDL/SDL.h>
+
+
+/*
+ * Interactive explorer. Frames are rendered asynchronously on a thread pool,
+ * tile by tile with progressive refinement, into tile-local buffers. Completed
+ * passes are copied to the frame buffer and marked dirty, and the UI thread
+ * only blits dirty tiles to the screen, so it stays responsive regardless of
+ * the iteration count. Any change of view cancels the frame in flight.
+ *
+ * Controls:
+ *   Left mouse drag, arrow keys      Pan
+ *   Mouse wheel, +/-                 Zoom in/out
+ *   [ and ]                          Decrease/increase FRAC_BITS (0: double)
+ *   Page up/down                     Double/halve the iteration limit
+ *   s                                Toggle 4x super sampling
+ *   Escape                           Quit
+ */
+struct explorer_config_t
+{
+    int width{ 1280 };              // Window width
+    int height{ 720 };              // Window height
+    int tile_size{ 64 };            // Tile width and height
+    int frac_bits{ 30 };            // Initial number format, see formats.h
+    int iterations{ 1000 };         // Initial iteration limit
+    bool supersample{ false };      // Initial super sampling setting
+    unsigned threads{ std::max(2u, std::thread::hardware_concurrency()) - 1 };
+};
+
+
+class explorer
+{
+    /*
+     * State of a frame shared by its render tasks.
+     */
+    struct frame_job_t
+    {
+        std::atomic<bool> cancel{ false };  // Set when the frame is replaced
+        std::atomic<int> remaining{ 0 };    // Tiles not yet completed
+    };
+
+public:
+    explicit explorer(const explorer_config_t &config = {})
+        : config{ config },
+          frac_bits{ config.frac_bits },
+          iterations{ config.iterations },
+          supersample{ config.supersample },
+          frame(size_t(config.width) * config.height),
+          pool{ config.threads }
+    {
+        view_h = view_w * config.height / config.width;
+    }
+
+    explorer(const explorer &) = delete;
+    explorer &operator=(const explorer &) = delete;
+
+    ~explorer()
+    {
+        cancel_frame();
+    }
+
+    /*
+     * Open the window and run the UI loop until the user quits. Returns false
+     * if the window could not be opened.
+     */
+    bool run()
+    {
+        if (SDL_Init(SDL_INIT_VIDEO) < 0)
+        {
+            return false;
+        }
+        screen = SDL_SetVideoMode(
+                config.width, config.height, 32, SDL_SWSURFACE);
+        if (!screen)
+        {
+            SDL_Quit();
+            return false;
+        }
+        start_frame();
+
+        constexpr Uint32 UI_FRAME_MS = 16;
+        bool running = true;
+        while (running)
+        {
+            Uint32 t0 = SDL_GetTicks();
+            running = handle_events();
+            present();
+            Uint32 elapsed = SDL_GetTicks() - t0;
+            if (elapsed < UI_FRAME_MS)
+            {
+                SDL_Delay(UI_FRAME_MS - elapsed);
+            }
+        }
+        cancel_frame();
+        pool.wait();
+        SDL_Quit();
+        return true;
+    }
+
+private:
+    /*
+     * Handle all pending events. Returns false on quit.
+     */
+    bool handle_events()
+    {
+        bool changed = false;
+        shift_x = shift_y = 0;
+        SDL_Event event{};
+        while (SDL_PollEvent(&event))
+        {
+            switch (event.type)
+            {
+            case SDL_QUIT:
+                return false;
+            case SDL_MOUSEBUTTONDOWN:
+                if (event.button.button == SDL_BUTTON_LEFT)
+                {
+                    dragging = true;
+                }
+                else if (event.button.button == SDL_BUTTON_WHEELUP)
+                {
+                    zoom(0.5, event.button.x, event.button.y);
+                    changed = true;
+                }
+                else if (event.button.button == SDL_BUTTON_WHEELDOWN)
+                {
+                    zoom(2.0, event.button.x, event.button.y);
+                    changed = true;
+                }
+                break;
+            case SDL_MOUSEBUTTONUP:
+                if (event.button.button == SDL_BUTTON_LEFT)
+                {
+                    dragging = false;
+                }
+                break;
+            case SDL_MOUSEMOTION:
+                if (dragging)
+                {
+                    pan(event.motion.xrel, event.motion.yrel);
+                    changed = true;
+                }
+                break;
+            case SDL_KEYDOWN:
+                switch (event.key.keysym.sym)
+                {
+                case SDLK_ESCAPE:
+                    return false;
+                case SDLK_LEFT:  pan( config.width/8, 0); break;
+                case SDLK_RIGHT: pan(-config.width/8, 0); break;
+                case SDLK_UP:    pan(0,  config.height/8); break;
+                case SDLK_DOWN:  pan(0, -config.height/8); break;
+                case SDLK_PLUS:
+                case SDLK_EQUALS:
+                    zoom(0.5, config.width/2, config.height/2);
+                    break;
+                case SDLK_MINUS:
+                    zoom(2.0, config.width/2, config.height/2);
+                    break;
+                case SDLK_LEFTBRACKET:
+                    frac_bits = std::max(0, frac_bits-1);
+                    break;
+                case SDLK_RIGHTBRACKET:
+                    frac_bits = std::min(FORMAT_MAX_FRAC_BITS, frac_bits+1);
+                    break;
+                case SDLK_PAGEUP:
+                    iterations *= 2;
+                    break;
+                case SDLK_PAGEDOWN:
+                    iterations = std::max(1, iterations/2);
+                    break;
+                case SDLK_s:
+                    supersample = !supersample;
+                    break;
+                default:
+                    continue;
+                }
+                changed = true;
+                break;
+            default:
+                break;
+            }
+        }
+        if (changed)
+        {
+            cancel_frame();
+            shift_frame(shift_x, shift_y);
+            start_frame();
+        }
+        return true;
+    }
+
+    /*
+     * Pan the view by (dx, dy) pixels.
+     */
+    void pan(int dx, int dy)
+    {
+        center_re -= dx * view_w / config.width;
+        center_im -= dy * view_h / config.height;
+        shift_x += dx;
+        shift_y += dy;
+    }
+
+    /*
+     * Shift the frame buffer by (dx, dy) pixels, so that the old content is
+     * displayed at its new position until it is replaced. The frame in flight
+     * must be cancelled first.
+     */
+    void shift_frame(int dx, int dy)
+    {
+        if (dx == 0 && dy == 0)
+        {
+            return;
+        }
+        const int W = config.width;
+        const int H = config.height;
+        std::lock_guard<std::mutex> lock{ frame_mutex };
+        std::vector<uint32_t> shifted(frame.size(), 0);
+        for (int y=std::max(0, dy); y<std::min(H, H+dy); ++y)
+        {
+            for (int x=std::max(0, dx); x<std::min(W, W+dx); ++x)
+            {
+                shifted[size_t(y)*W + x] = frame[size_t(y-dy)*W + (x-dx)];
+            }
+        }
+        frame.swap(shifted);
+        dirty.push_back(SDL_Rect{ 0, 0, Uint16(W), Uint16(H) });
+    }
+
+    /*
+     * Zoom the view by 'factor' around the pixel (px_x, px_y).
+     */
+    void zoom(double factor, int px_x, int px_y)
+    {
+        double re = center_re - view_w/2.0 + view_w*px_x/config.width;
+        double im = center_im - view_h/2.0 + view_h*px_y/config.height;
+        center_re = re + (center_re - re)*factor;
+        center_im = im + (center_im - im)*factor;
+        view_w *= factor;
+        view_h *= factor;
+    }
+
+    /*
+     * Cancel the frame in flight, if any. Tasks of the frame that have not yet
+     * started are removed and running tasks stop at their next row.
+     */
+    void cancel_frame()
+    {
+        if (job)
+        {
+            job->cancel = true;
+        }
+        pool.clear();
+    }
+
+    /*
+     * Start rendering a new frame of the current view.
+     */
+    void start_frame()
+    {
+        cancel_frame();
+        job = std::make_shared<frame_job_t>();
+        frame_start = std::chrono::steady_clock::now();
+        const int W = config.width;
+        const int H = config.height;
+        const int T = config.tile_size;
+
+        // Tiles closest to the image center are rendered first.
+        std::vector<tile_t> tiles{};
+        for (int y=0; y<H; y+=T)
+        {
+            for (int x=0; x<W; x+=T)
+            {
+                tiles.push_back(
+                    tile_t{ x, y, std::min(T, W-x), std::min(T, H-y) });
+            }
+        }
+        auto dist = [&](const tile_t &t)
+        {
+            int dx = t.x + t.w/2 - W/2;
+            int dy = t.y + t.h/2 - H/2;
+            return dx*dx + dy*dy;
+        };
+        std::sort(tiles.begin(), tiles.end(),
+            [&](const tile_t &a, const tile_t &b){ return dist(a) < dist(b); });
+        job->remaining = tiles.size();
+
+        dispatch_format(frac_bits, [&](auto real)
+        {
+            using REAL_TYPE = decltype(real);
+            const segment_t<REAL_TYPE> seg{
+                { REAL_TYPE(center_re), REAL_TYPE(center_im) },
+                REAL_TYPE(view_w), REAL_TYPE(view_h)
+            };
+            const bool ss = supersample;
+            const int it = iterations;
+            for (const tile_t &tile : tiles)
+            {
+                pool.submit([this, seg, ss, it, tile, job = job]
+                {
+                    render_task(seg, ss, it, tile, *job);
+                });
+            }
+        });
+        update_caption();
+    }
+
+    /*
+     * Render a tile progressively into a tile-local buffer and publish every
+     * completed pass to the frame buffer, unless the frame has been cancelled.
+     */
+    template <typename REAL_TYPE>
+    void render_task(
+            const segment_t<REAL_TYPE> &seg, const bool SUPERSAMPLE,
+            const int ITERATIONS, const tile_t &tile, frame_job_t &frame_job)
+    {
+        std::vector<uint32_t> pixels(size_t(tile.w) * tile.h);
+        bool ok = render_tile_progressive(
+            seg, config.width, config.height, SUPERSAMPLE, ITERATIONS, tile,
+            screen->format, pixels.data(), tile.w, &frame_job.cancel, [&](int)
+            {
+                std::lock_guard<std::mutex> lock{ frame_mutex };
+                if (frame_job.cancel)
+                {
+                    return;
+                }
+                for (int y=0; y<tile.h; ++y)
+                {
+                    std::copy_n(&pixels[size_t(y)*tile.w], tile.w,
+                        &frame[size_t(tile.y + y)*config.width + tile.x]);
+                }
+                dirty.push_back(SDL_Rect{
+                    Sint16(tile.x), Sint16(tile.y),
+                    Uint16(tile.w), Uint16(tile.h) });
+            });
+        if (ok && --frame_job.remaining == 0)
+        {
+            frame_done = true;
+        }
+    }
+
+    /*
+     * Blit all dirty tiles to the screen.
+     */
+    void present()
+    {
+        std::vector<SDL_Rect> rects{};
+        if (SDL_LockSurface(screen) < 0)
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock{ frame_mutex };
+            rects.swap(dirty);
+            for (const SDL_Rect &r : rects)
+            {
+                for (int y=r.y; y<r.y+r.h; ++y)
+                {
+                    uint8_t *row = (uint8_t *)screen->pixels + y*screen->pitch;
+                    std::copy_n(&frame[size_t(y)*config.width + r.x], r.w,
+                        (uint32_t *)row + r.x);
+                }
+            }
+        }
+        SDL_UnlockSurface(screen);
+        if (!rects.empty())
+        {
+            SDL_UpdateRects(screen, rects.size(), rects.data());
+        }
+        if (frame_done.exchange(false))
+        {
+            update_caption();
+        }
+    }
+
+    /*
+     * Show the view settings, and the render time of a completed frame, in
+     * the window caption.
+     */
+    void update_caption()
+    {
+        using namespace std::chrono;
+        char format[48], status[48], caption[160];
+        if (frac_bits)
+        {
+            std::snprintf(format, sizeof(format), "SignedFixedPoint<%d,%d>",
+                FORMAT_INT_BITS, frac_bits);
+        }
+        else
+        {
+            std::snprintf(format, sizeof(format), "double");
+        }
+        if (job && job->remaining == 0)
+        {
+            long ms = duration_cast<milliseconds>(
+                    steady_clock::now() - frame_start).count();
+            std::snprintf(status, sizeof(status), "rendered in %ldms", ms);
+        }
+        else
+        {
+            std::snprintf(status, sizeof(status), "rendering...");
+        }
+        std::snprintf(caption, sizeof(caption),
+            "Mandelbrot %s | %d iterations%s | width %g | %s", format,
+            iterations, supersample ? " | 4x SS" : "", view_w, status);
+        SDL_WM_SetCaption(caption, nullptr);
+    }
+
+    explorer_config_t config;
+
+    // View and render settings.
+    double center_re{ -0.5 };
+    double center_im{ 0.0 };
+    double view_w{ 3.5 };
+    double view_h{ 2.0 };
+    int frac_bits;
+    int iterations;
+    bool supersample;
+    bool dragging{ false };
+    int shift_x{ 0 };
+    int shift_y{ 0 };
+
+    // Frame state shared with the render tasks.
+    std::vector<uint32_t> frame;
+    std::vector<SDL_Rect> dirty{};
+    std::mutex frame_mutex{};
+    std::shared_ptr<frame_job_t> job{};
+    std::atomic<bool> frame_done{ false };
+    std::chrono::steady_clock::time_point frame_start{};
+    SDL_Surface *screen{ nullptr };
+    thread_pool pool;
+};
+
+#endif
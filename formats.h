@@ -0,0 +1,100 @@
+#ifndef _FORMATS_H
+#define _FORMATS_H
+
+#include "FixedPoint.h"
+#include <string>
+#include <utility>
+
+
+/*
+ * Number formats selectable at run-time. The fixed point formats available are
+ * SignedFixedPoint<FORMAT_INT_BITS, FRAC> for FRAC in [1, FORMAT_MAX_FRAC_BITS],
+ * which are instantiated at compile time. A frac_bits of zero selects the
+ * double-precision floating-point reference.
+ */
+constexpr int FORMAT_INT_BITS = 29;
+constexpr int FORMAT_MAX_FRAC_BITS = 30;
+
+
+namespace detail
+{
+    template <typename F, int... FRAC>
+    bool dispatch_fixed(
+            int frac_bits, F &&f, std::integer_sequence<int, FRAC...>)
+    {
+        return ( (frac_bits == FRAC+1 ?
+            (f(SignedFixedPoint<FORMAT_INT_BITS,FRAC+1>{}), true) : false)
+            || ... );
+    }
+}
+
+
+/*
+ * The number format REAL_TYPE with the rounding policy ROUNDING, see
+ * FixedPoint.h. The double-precision reference is left unchanged.
+ */
+template <typename REAL_TYPE, typename ROUNDING>
+struct with_rounding
+{
+    using type = REAL_TYPE;
+};
+
+template <
+    int INT, int FRAC, typename POLICY, typename OLD_ROUNDING,
+    typename ROUNDING >
+struct with_rounding<SignedFixedPoint<INT,FRAC,POLICY,OLD_ROUNDING>, ROUNDING>
+{
+    using type = SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>;
+};
+
+
+/*
+ * Call f(ROUNDING{}) with the rounding policy named 'name': "truncate",
+ * "half-up", "convergent" or "stochastic". The function returns false if the
+ * name is unknown.
+ */
+template <typename F>
+bool dispatch_rounding(const std::string &name, F &&f)
+{
+    if (name == "truncate")
+    {
+        f(RoundTruncate{});
+    }
+    else if (name == "half-up")
+    {
+        f(RoundHalfUp{});
+    }
+    else if (name == "convergent")
+    {
+        f(RoundConvergent{});
+    }
+    else if (name == "stochastic")
+    {
+        f(RoundStochastic{});
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+
+/*
+ * Call f(REAL_TYPE{}) with the number format selected by 'frac_bits'. The
+ * function returns false if the format is not available.
+ */
+template <typename F>
+bool dispatch_format(int frac_bits, F &&f)
+{
+    if (frac_bits == 0)
+    {
+        f(double{});
+        return true;
+    }
+    return detail::dispatch_fixed(
+        frac_bits, std::forward<F>(f),
+        std::make_integer_sequence<int, FORMAT_MAX_FRAC_BITS>{});
+}
+
+#endif
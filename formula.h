@@ -0,0 +1,291 @@
+#ifndef _FORMULA_H
+#define _FORMULA_H
+
+#include <complex>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+
+/*
+ * Iteration formulas of the escape time fractals. A formula is a type with a
+ * static step() that advances z by one iteration, together with the squares of
+ * the parts of z that the bailout test |z|^2 > 4 uses, in the arithmetic of
+ * REAL_TYPE. The escape loops take the formula as a template parameter, so
+ * that every formula gets its own inlined inner loop instead of a run-time
+ * switch, and the raw fixed point step of every formula is a specialization of
+ * escape_kernel, see batch.h. The properties of a formula are:
+ *
+ *     DEGREE      Degree of the iteration, for the convergence value
+ *     SQUARE      The iteration is z = z^2 + c, whose convergence value
+ *                 uses the extra iterations of get_convergence_value()
+ *     INTERIOR    The main cardioid and period 2 bulb checks apply
+ *     JULIA       z starts at the point, and c is the constant of the formula
+ *
+ * formula_mandelbrot is the default of all render functions.
+ */
+struct formula_mandelbrot
+{
+    static constexpr int DEGREE = 2;
+    static constexpr bool SQUARE = true;
+    static constexpr bool INTERIOR = true;
+    static constexpr bool JULIA = false;
+
+    static const char *name() { return "mandelbrot"; }
+
+    /*
+     * Iteration constant c of the point 'p'.
+     */
+    template <typename REAL_TYPE>
+    std::complex<REAL_TYPE> constant(const std::complex<REAL_TYPE> &p) const
+    {
+        return p;
+    }
+
+    /*
+     * z = z^2 + c, where the square reuses the squares of the parts of z.
+     */
+    template <typename REAL_TYPE>
+    static void step(
+            REAL_TYPE &z_re, REAL_TYPE &z_im,
+            REAL_TYPE &z_re_sqr, REAL_TYPE &z_im_sqr,
+            const std::complex<REAL_TYPE> &c)
+    {
+        z_im = (z_re+z_im)*(z_re+z_im) - z_re_sqr - z_im_sqr + c.imag();
+        z_re = z_re_sqr - z_im_sqr + c.real();
+        z_re_sqr = z_re * z_re;
+        z_im_sqr = z_im * z_im;
+    }
+};
+
+
+/*
+ * Julia set of the constant (c_re, c_im): z = z^2 + c, starting at z equal to
+ * the point. The interior checks of the mandelbrot set do not apply.
+ */
+struct formula_julia
+{
+    static constexpr int DEGREE = 2;
+    static constexpr bool SQUARE = true;
+    static constexpr bool INTERIOR = false;
+    static constexpr bool JULIA = true;
+
+    double c_re, c_im;          // Julia constant
+
+    static const char *name() { return "julia"; }
+
+    template <typename REAL_TYPE>
+    std::complex<REAL_TYPE> constant(const std::complex<REAL_TYPE> &) const
+    {
+        return std::complex<REAL_TYPE>{ REAL_TYPE(c_re), REAL_TYPE(c_im) };
+    }
+
+    template <typename REAL_TYPE>
+    static void step(
+            REAL_TYPE &z_re, REAL_TYPE &z_im,
+            REAL_TYPE &z_re_sqr, REAL_TYPE &z_im_sqr,
+            const std::complex<REAL_TYPE> &c)
+    {
+        formula_mandelbrot::step(z_re, z_im, z_re_sqr, z_im_sqr, c);
+    }
+};
+
+
+/*
+ * Multibrot set of degree D: z = z^D + c. The power is formed by D-1 complex
+ * multiplications, each assigned to REAL_TYPE as in the std::complex
+ * multiplication.
+ */
+template <int D>
+struct formula_multibrot
+{
+    static_assert(D >= 3, "The multibrot of degree 2 is formula_mandelbrot.");
+    static constexpr int DEGREE = D;
+    static constexpr bool SQUARE = false;
+    static constexpr bool INTERIOR = false;
+    static constexpr bool JULIA = false;
+
+    static const char *name() { return "multibrot"; }
+
+    template <typename REAL_TYPE>
+    std::complex<REAL_TYPE> constant(const std::complex<REAL_TYPE> &p) const
+    {
+        return p;
+    }
+
+    template <typename REAL_TYPE>
+    static void step(
+            REAL_TYPE &z_re, REAL_TYPE &z_im,
+            REAL_TYPE &z_re_sqr, REAL_TYPE &z_im_sqr,
+            const std::complex<REAL_TYPE> &c)
+    {
+        REAL_TYPE w_re = z_re, w_im = z_im;
+        for (int k=1; k<D; ++k)
+        {
+            const REAL_TYPE re = w_re*z_re - w_im*z_im;
+            w_im = w_re*z_im + w_im*z_re;
+            w_re = re;
+        }
+        z_re = w_re + c.real();
+        z_im = w_im + c.imag();
+        z_re_sqr = z_re * z_re;
+        z_im_sqr = z_im * z_im;
+    }
+};
+
+
+namespace detail
+{
+    /*
+     * Absolute value, where the negation of the most negative fixed point
+     * number wraps around as the unary minus of FixedPoint.h does.
+     */
+    template <typename REAL_TYPE>
+    REAL_TYPE formula_abs(const REAL_TYPE &x)
+    {
+        return x < REAL_TYPE(0.0) ? REAL_TYPE(-x) : x;
+    }
+}
+
+
+/*
+ * Burning ship fractal: z = (|re(z)| + i*|im(z)|)^2 + c. The absolute values
+ * are taken before the square, which otherwise is that of formula_mandelbrot.
+ */
+struct formula_burning_ship
+{
+    static constexpr int DEGREE = 2;
+    static constexpr bool SQUARE = false;
+    static constexpr bool INTERIOR = false;
+    static constexpr bool JULIA = false;
+
+    static const char *name() { return "burning-ship"; }
+
+    template <typename REAL_TYPE>
+    std::complex<REAL_TYPE> constant(const std::complex<REAL_TYPE> &p) const
+    {
+        return p;
+    }
+
+    template <typename REAL_TYPE>
+    static void step(
+            REAL_TYPE &z_re, REAL_TYPE &z_im,
+            REAL_TYPE &z_re_sqr, REAL_TYPE &z_im_sqr,
+            const std::complex<REAL_TYPE> &c)
+    {
+        const REAL_TYPE a_re = detail::formula_abs(z_re);
+        const REAL_TYPE a_im = detail::formula_abs(z_im);
+        z_im = (a_re+a_im)*(a_re+a_im) - z_re_sqr - z_im_sqr + c.imag();
+        z_re = z_re_sqr - z_im_sqr + c.real();
+        z_re_sqr = z_re * z_re;
+        z_im_sqr = z_im * z_im;
+    }
+};
+
+
+/*
+ * Formulas selectable at run-time. Multibrot sets are available for the
+ * degrees [3, FORMULA_MAX_DEGREE], which are instantiated at compile time.
+ */
+constexpr int FORMULA_MAX_DEGREE = 6;
+
+enum formula_kind_t
+{
+    FORMULA_MANDELBROT,
+    FORMULA_JULIA,
+    FORMULA_MULTIBROT,
+    FORMULA_BURNING_SHIP
+};
+
+struct formula_spec_t
+{
+    formula_kind_t kind{ FORMULA_MANDELBROT };
+    int degree{ 2 };                // Degree of multibrot sets
+    double c_re{ 0.0 }, c_im{ 0.0 };    // Constant of julia sets
+    double center_re{ -0.5 };       // Center of the default segment
+    double center_im{ 0.0 };
+};
+
+
+/*
+ * Parse the formula 'str': "mandelbrot", "julia:<re>,<im>", "multibrot:<d>"
+ * or "burning-ship". Returns false if the formula is unknown or invalid.
+ */
+static bool parse_formula(const char *str, formula_spec_t &spec)
+{
+    spec = formula_spec_t{};
+    char *end = nullptr;
+    if (!std::strcmp(str, "mandelbrot"))
+    {
+        return true;
+    }
+    else if (!std::strncmp(str, "julia:", 6))
+    {
+        spec.kind = FORMULA_JULIA;
+        spec.c_re = std::strtod(str + 6, &end);
+        if (end == str + 6 || *end != ',')
+        {
+            return false;
+        }
+        const char *im = end + 1;
+        spec.c_im = std::strtod(im, &end);
+        spec.center_re = 0.0;
+        return end != im && *end == '\0';
+    }
+    else if (!std::strncmp(str, "multibrot:", 10))
+    {
+        spec.kind = FORMULA_MULTIBROT;
+        spec.degree = int(std::strtol(str + 10, &end, 10));
+        spec.center_re = 0.0;
+        return end != str + 10 && *end == '\0' &&
+               spec.degree >= 3 && spec.degree <= FORMULA_MAX_DEGREE;
+    }
+    else if (!std::strcmp(str, "burning-ship"))
+    {
+        spec.kind = FORMULA_BURNING_SHIP;
+        spec.center_im = -0.5;
+        return true;
+    }
+    return false;
+}
+
+
+namespace detail
+{
+    template <typename F, int... D>
+    void dispatch_multibrot(
+            int degree, F &&f, std::integer_sequence<int, D...>)
+    {
+        (void)( (degree == D+3 ? (f(formula_multibrot<D+3>{}), true) : false)
+                || ... );
+    }
+}
+
+
+/*
+ * Call f(FORMULA{}) with the formula of 'spec', which must have been parsed by
+ * parse_formula().
+ */
+template <typename F>
+void dispatch_formula(const formula_spec_t &spec, F &&f)
+{
+    switch (spec.kind)
+    {
+        case FORMULA_MANDELBROT:
+            f(formula_mandelbrot{});
+            break;
+        case FORMULA_JULIA:
+            f(formula_julia{ spec.c_re, spec.c_im });
+            break;
+        case FORMULA_MULTIBROT:
+            detail::dispatch_multibrot(
+                spec.degree, std::forward<F>(f),
+                std::make_integer_sequence<int, FORMULA_MAX_DEGREE-2>{});
+            break;
+        case FORMULA_BURNING_SHIP:
+            f(formula_burning_ship{});
+            break;
+    }
+}
+
+#endif
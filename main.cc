@@ -1,12 +1,550 @@
 #include "FixedPoint.h"
 #include "render.h"
+#include "distributed.h"
+#include "service.h"
+#include "explorer.h"
+#include "quantdiff.h"
+#include "equalize.h"
+#include "bench.h"
+#include "distance.h"
+#include "tiles.h"
+#include "numa.h"
+#include "estimate.h"
+#include "checkpoint.h"
+#include "adaptive.h"
+#include "orbit.h"
+#include "formula.h"
 #include <SDL/SDL.h>
 #include <complex>
 #include <iostream>
+#include <iomanip>
 #include <cstdlib>
 #include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
 
-int main()
+
+/*
+ * Print program usage.
+ */
+static void print_usage(const char *prog)
+{
+    std::cerr << "Usage: " << prog << " [options]\n"
+        << "  --archive <file>   Write iteration-count archive of render\n"
+        << "  --recolor <file>   Re-color archived render, no iterations\n"
+        << "  --equalize         Histogram-equalized coloring of the frame\n"
+        << "  --distance         Distance-estimated anti-aliasing, 1 sample\n"
+        << "  --adaptive         Super sample only pixels near the boundary\n"
+        << "  --auto-iterations  Raise iteration limits only at the boundary\n"
+        << "  --save-orbits <f>  Save the raw orbit state of every sample\n"
+        << "  --resume-orbits <f> Continue saved orbits with a higher limit\n"
+        << "  --formula <f>      mandelbrot, julia:<re>,<im>, multibrot:<d> or "
+        << "burning-ship\n"
+        << "  --tile-order <o>   Tile order: row, morton or hilbert\n"
+        << "  --numa <affinity>  NUMA bands: scatter, compact, none or CPU list\n"
+        << "  --checkpoint <f>   Periodically checkpoint completed tiles\n"
+        << "  --resume <f>       Resume a checkpointed render\n"
+        << "  --workers <n>      Render tiles in n local worker processes\n"
+        << "  --estimate         Estimate the render time from 1/64 of pixels\n"
+        << "  --balance          Issue worker tiles longest first, estimated\n"
+        << "  --preview          Show progressive passes while rendering\n"
+        << "  --explore          Interactive explorer window\n"
+        << "  --serve <socket>   Run render service on Unix domain socket\n"
+        << "  --client <socket>  Request the render from a render service\n"
+        << "  --quantdiff <f,..> Compare fractional bit formats to double\n"
+        << "  --verify-kernel    Check raw escape kernels against FixedPoint.h\n"
+        << "  --bench <name>     Micro-benchmark: convert, bailout or tiles\n"
+        << "  --overflow-map <f> Write first overflow iterations (counting build)\n"
+        << "  --overflow <p>     Overflow policy: wrap, saturate or trap\n"
+        << "  --rounding <r>     Rounding: truncate, half-up, convergent or "
+        << "stochastic\n";
+}
+
+
+/*
+ * Print a render estimate and, for worker renders, the estimated wall time
+ * with the tiles issued longest first and in row-major order.
+ */
+static void print_estimate(
+        const render_estimate_t &est, const int workers, const int tile_size)
+{
+    std::cout << "Estimated " << std::scientific << std::setprecision(2);
+    std::cout << est.iterations << " iterations and " << std::fixed;
+    std::cout << std::setprecision(0) << est.ms << "ms from ";
+    std::cout << std::setprecision(1) << 100.0*est.sampled();
+    std::cout << "% of the pixels, sampled in " << est.sample_ms << "ms.";
+    std::cout << std::endl;
+    if (workers > 0)
+    {
+        std::vector<tile_t> tiles =
+            make_tiles(est.width, est.height, tile_size);
+        const double row_ms = estimate_parallel_ms(est, tiles, workers);
+        order_tiles_by_cost(est, tiles);
+        const double lpt_ms = estimate_parallel_ms(est, tiles, workers);
+        std::cout << "On " << workers << " workers " << std::setprecision(0);
+        std::cout << lpt_ms << "ms longest tile first, " << row_ms;
+        std::cout << "ms in row order." << std::endl;
+    }
+}
+
+
+/*
+ * Re-color a frame from its iteration-count archive and save it to file.
+ */
+static int recolor_archive(
+        const char *archive_filename, const char *filename, bool equalize)
+{
+    archive_reader archive{};
+    if (!archive.open(archive_filename))
+    {
+        std::cerr << "Could not read archive '" << archive_filename << "'.";
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+    }
+    const archive_header_t &hdr = archive.header();
+    SDL_Surface *image = SDL_CreateRGBSurface(
+            0, hdr.width, hdr.height, 32, 0, 0, 0, 0
+    );
+    if (SDL_LockSurface(image) < 0)
+    {
+        std::cerr << "Could not lock image surface." << std::endl;
+        return EXIT_FAILURE;
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+    if (equalize)
+    {
+        thread_pool pool{};
+        recolor_equalized(archive, image, pool);
+    }
+    else
+    {
+        recolor(archive, image);
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    auto time = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1);
+    std::cout << "Re-coloring finished after " << time.count() << "ms. ";
+    std::cout << "Writing to file '" << filename << "'." << std::endl;
+    SDL_UnlockSurface(image);
+    if (SDL_SaveBMP(image, filename) < 0)
+    {
+        std::cerr << "Could not write image to file." << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/*
+ * Request a render from the render service listening on 'socket' and save the
+ * result to file.
+ */
+static int request_render(
+        const char *socket, const service_request_t &req, const char *filename)
+{
+    service_response_t res{};
+    std::vector<uint32_t> pixels{};
+    auto t1 = std::chrono::high_resolution_clock::now();
+    if (!service_call(socket, req, res, pixels) || res.status != 0)
+    {
+        std::cerr << "Render service request failed." << std::endl;
+        return EXIT_FAILURE;
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    auto time = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1);
+    const service_stats_t &stats = res.stats;
+    uint64_t lookups = stats.tile_hits + stats.tile_misses;
+    std::cout << "Request served after " << time.count() << "ms, ";
+    std::cout << res.tile_hits << "/" << res.tiles << " tiles cached. ";
+    std::cout << "Service hit rate: " << stats.tile_hits << "/" << lookups;
+    std::cout << " over " << stats.requests << " requests, ";
+    std::cout << stats.evictions << " evictions." << std::endl;
+
+    SDL_Surface *image = SDL_CreateRGBSurface(
+            0, res.width, res.height, 32, 0, 0, 0, 0
+    );
+    if (SDL_LockSurface(image) < 0)
+    {
+        std::cerr << "Could not lock image surface." << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::copy(pixels.begin(), pixels.end(), (uint32_t *)image->pixels);
+    SDL_UnlockSurface(image);
+    if (SDL_SaveBMP(image, filename) < 0)
+    {
+        std::cerr << "Could not write image to file." << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/*
+ * Compare the fixed point formats with the fractional bits in the comma
+ * separated list 'formats' against the double-precision reference. Writes the
+ * diff image diff_<frac>.bmp and the escape iteration deltas diff_<frac>.delta
+ * of every format and prints the aggregate statistics.
+ */
+static int quant_diff(
+        const char *formats, const std::string &rounding,
+        const segment_t<double> &seg,
+        const int WIDTH, const int HEIGHT, const int ITERATIONS,
+        const formula_spec_t &formula)
+{
+    std::vector<quant_output_t> outputs{};
+    for (const char *f = formats; *f; )
+    {
+        char *end = nullptr;
+        int frac_bits = std::strtol(f, &end, 10);
+        if (end == f || frac_bits < 1 || frac_bits > FORMAT_MAX_FRAC_BITS)
+        {
+            std::cerr << "Invalid format list '" << formats << "'." << std::endl;
+            return EXIT_FAILURE;
+        }
+        quant_output_t out{};
+        out.frac_bits = frac_bits;
+        out.diff = SDL_CreateRGBSurface(0, WIDTH, HEIGHT, 32, 0, 0, 0, 0);
+        std::string delta = "diff_" + std::to_string(frac_bits) + ".delta";
+        out.delta_fd = open(delta.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (!out.diff || SDL_LockSurface(out.diff) < 0 || out.delta_fd < 0)
+        {
+            std::cerr << "Could not create outputs of format ";
+            std::cerr << frac_bits << "." << std::endl;
+            return EXIT_FAILURE;
+        }
+        outputs.push_back(out);
+        f = *end == ',' ? end + 1 : end;
+    }
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    thread_pool pool{};
+    std::vector<quant_stats_t> stats{};
+    if (formula.kind != FORMULA_MANDELBROT)
+    {
+        // Other formulas are instantiated with truncation only.
+        dispatch_formula(formula, [&](auto f)
+        {
+            stats = render_quant_diff<RoundTruncate>(
+                seg, WIDTH, HEIGHT, ITERATIONS, outputs, pool, f);
+        });
+    }
+    else
+    {
+        dispatch_rounding(rounding, [&](auto policy)
+        {
+            stats = render_quant_diff<decltype(policy)>(
+                seg, WIDTH, HEIGHT, ITERATIONS, outputs, pool);
+        });
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    auto time = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1);
+    std::cout << "Comparison finished after " << time.count() << "ms.\n";
+    std::cout << "format      mismatch  in/out set  mean err  max err\n";
+
+    int status = EXIT_SUCCESS;
+    for (size_t i=0; i<outputs.size(); ++i)
+    {
+        const quant_stats_t &s = stats[i];
+        std::cout << "<" << FORMAT_INT_BITS << "," << std::setw(2);
+        std::cout << s.frac_bits << ">  " << std::fixed << std::setw(10);
+        std::cout << std::setprecision(4) << s.mismatch_percent() << "%  ";
+        std::cout << std::setw(10) << s.set_mismatches << "  ";
+        std::cout << std::setw(8) << std::setprecision(3) << s.mean_error();
+        std::cout << "  " << std::setw(7) << s.max_error << std::endl;
+
+        std::string diff = "diff_" + std::to_string(s.frac_bits) + ".bmp";
+        SDL_UnlockSurface(outputs[i].diff);
+        if (SDL_SaveBMP(outputs[i].diff, diff.c_str()) < 0)
+        {
+            std::cerr << "Could not write '" << diff << "'." << std::endl;
+            status = EXIT_FAILURE;
+        }
+        SDL_FreeSurface(outputs[i].diff);
+        if (close(outputs[i].delta_fd) < 0 || s.delta_failed)
+        {
+            std::cerr << "Could not write 'diff_" << s.frac_bits;
+            std::cerr << ".delta'." << std::endl;
+            status = EXIT_FAILURE;
+        }
+    }
+    return status;
+}
+
+
+/*
+ * Save the per-pixel first overflow iterations as an image, where pixels that
+ * overflow early are bright red and pixels that never overflow are black.
+ */
+static bool save_overflow_map(
+        const std::vector<uint32_t> &first_overflow,
+        const int WIDTH, const int HEIGHT, const int ITERATIONS,
+        const char *filename)
+{
+    SDL_Surface *image = SDL_CreateRGBSurface(
+            0, WIDTH, HEIGHT, 32, 0, 0, 0, 0
+    );
+    if (!image || SDL_LockSurface(image) < 0)
+    {
+        return false;
+    }
+    uint32_t *px = (uint32_t *)image->pixels;
+    for (int i=0; i<WIDTH*HEIGHT; ++i)
+    {
+        uint8_t r = 0;
+        if (first_overflow[i] != UINT32_MAX)
+        {
+            double t = std::log1p(first_overflow[i]) / std::log1p(ITERATIONS);
+            r = uint8_t(255 - 191*std::min(1.0, t));
+        }
+        px[i] = SDL_MapRGB(image->format, r, 0, 0);
+    }
+    SDL_UnlockSurface(image);
+    bool ok = SDL_SaveBMP(image, filename) >= 0;
+    SDL_FreeSurface(image);
+    return ok;
+}
+
+
+/*
+ * The segment 'seg' converted to the number type T, e.g., the same fixed point
+ * format with other overflow and rounding policies.
+ */
+template <typename T, typename REAL_TYPE>
+static segment_t<T> convert_segment(const segment_t<REAL_TYPE> &seg)
+{
+    return segment_t<T>{
+        { T(seg.c.real()), T(seg.c.imag()) }, T(seg.w), T(seg.h) };
+}
+
+
+/*
+ * Names of the overflow and rounding policies, as suffixes of format names.
+ */
+static const char *policy_name(OverflowWrap) { return ""; }
+static const char *policy_name(OverflowSaturate) { return ",saturate"; }
+static const char *policy_name(RoundTruncate) { return ""; }
+static const char *policy_name(RoundHalfUp) { return ",half-up"; }
+static const char *policy_name(RoundConvergent) { return ",convergent"; }
+static const char *policy_name(RoundStochastic) { return ",stochastic"; }
+
+
+/*
+ * Check the raw escape kernel of the format <INT,FRAC> and the formula
+ * 'formula' against the generic fixed point operators and print the result.
+ */
+template <
+    int INT, int FRAC, typename POLICY, typename ROUNDING,
+    typename FORMULA = formula_mandelbrot >
+static bool verify_kernel(
+        const SignedFixedPoint<INT,FRAC,POLICY,ROUNDING> &real,
+        const FORMULA &formula = FORMULA{})
+{
+    constexpr uint64_t SAMPLES = 1 << 20;
+    constexpr uint64_t SEED = 0x6d616e64;
+    uint64_t mismatches = verify_escape_kernel(real, SAMPLES, SEED, formula);
+    std::cout << "<" << INT << "," << FRAC << policy_name(POLICY{});
+    std::cout << policy_name(ROUNDING{}) << "> ";
+    if (!std::is_same<FORMULA, formula_mandelbrot>::value)
+    {
+        std::cout << formula.name();
+        if (FORMULA::DEGREE > 2)
+        {
+            std::cout << ":" << FORMULA::DEGREE;
+        }
+        std::cout << " ";
+    }
+    std::cout << (mismatches ? "FAILED " : "ok ") << mismatches << "/";
+    std::cout << SAMPLES << std::endl;
+    return mismatches == 0;
+}
+
+static bool verify_kernel(double)
+{
+    return true;
+}
+
+
+/*
+ * Check the divisors of the format <D_INT,D_FRAC> prepared by make_divisor()
+ * against operator/ for dividends of the format <INT,FRAC> and print the
+ * result.
+ */
+template <int INT, int FRAC, int D_INT, int D_FRAC>
+static bool verify_divisor()
+{
+    constexpr uint64_t SAMPLES = 1 << 20;
+    constexpr uint64_t SEED = 0x64697669;
+    uint64_t mismatches =
+        verify_prepared_divisor<INT,FRAC,D_INT,D_FRAC>(SAMPLES, SEED);
+    std::cout << "<" << INT << "," << FRAC << "> / <" << D_INT << ",";
+    std::cout << D_FRAC << "> divisor ";
+    std::cout << (mismatches ? "FAILED " : "ok ") << mismatches << "/";
+    std::cout << SAMPLES << std::endl;
+    return mismatches == 0;
+}
+
+
+/*
+ * Check the distance estimate of the format <INT,FRAC>, see distance.h, and
+ * print the result.
+ */
+template <int INT, int FRAC>
+static bool verify_distance()
+{
+    constexpr uint64_t SAMPLES = 1 << 16;
+    constexpr uint64_t SEED = 0x64697374;
+    uint64_t mismatches =
+        verify_distance_estimate<INT,FRAC>(SAMPLES, 1000, SEED);
+    std::cout << "<" << INT << "," << FRAC << "> distance ";
+    std::cout << (mismatches ? "FAILED " : "ok ") << mismatches << "/";
+    std::cout << SAMPLES << std::endl;
+    return mismatches == 0;
+}
+
+
+/*
+ * Check the raw escape kernels of all run-time selectable formats, and of a few
+ * formats with small integer parts that wrap around or saturate frequently,
+ * with all rounding policies and the other formulas, the prepared divisors of
+ * FixedPoint.h, and the distance estimate of formats with few fractional bits.
+ */
+static int verify_kernels()
+{
+    bool ok = true;
+    for (int frac_bits=1; frac_bits<=FORMAT_MAX_FRAC_BITS; ++frac_bits)
+    {
+        dispatch_format(frac_bits, [&](auto real)
+        {
+            ok = verify_kernel(real) && ok;
+        });
+    }
+    ok = verify_kernel(SignedFixedPoint<1,16>{}) && ok;
+    ok = verify_kernel(SignedFixedPoint<2,30>{}) && ok;
+    ok = verify_kernel(SignedFixedPoint<3,20>{}) && ok;
+    ok = verify_kernel(SignedFixedPoint<5,12>{}) && ok;
+    ok = verify_kernel(SignedFixedPoint<8,8>{}) && ok;
+    ok = verify_kernel(SignedFixedPoint<16,15>{}) && ok;
+    ok = verify_kernel(SignedFixedPoint<29,30,OverflowSaturate>{}) && ok;
+    ok = verify_kernel(SignedFixedPoint<2,30,OverflowSaturate>{}) && ok;
+    ok = verify_kernel(SignedFixedPoint<3,20,OverflowSaturate>{}) && ok;
+    ok = verify_kernel(SignedFixedPoint<5,12,OverflowSaturate>{}) && ok;
+    ok = verify_kernel(SignedFixedPoint<16,15,OverflowSaturate>{}) && ok;
+    using WRAP = OverflowWrap;
+    using SAT = OverflowSaturate;
+    ok = verify_kernel(SignedFixedPoint<29,30,WRAP,RoundHalfUp>{}) && ok;
+    ok = verify_kernel(SignedFixedPoint<5,12,WRAP,RoundHalfUp>{}) && ok;
+    ok = verify_kernel(SignedFixedPoint<3,20,SAT,RoundHalfUp>{}) && ok;
+    ok = verify_kernel(SignedFixedPoint<29,10,WRAP,RoundConvergent>{}) && ok;
+    ok = verify_kernel(SignedFixedPoint<5,12,WRAP,RoundConvergent>{}) && ok;
+    ok = verify_kernel(SignedFixedPoint<16,15,SAT,RoundConvergent>{}) && ok;
+    ok = verify_kernel(SignedFixedPoint<29,30,WRAP,RoundStochastic>{}) && ok;
+    ok = verify_kernel(SignedFixedPoint<2,30,WRAP,RoundStochastic>{}) && ok;
+    ok = verify_kernel(SignedFixedPoint<5,12,SAT,RoundStochastic>{}) && ok;
+    const formula_burning_ship SHIP{};
+    const formula_multibrot<3> CUBIC{};
+    const formula_multibrot<FORMULA_MAX_DEGREE> HIGHEST{};
+    ok = verify_kernel(SignedFixedPoint<29,30>{}, SHIP) && ok;
+    ok = verify_kernel(SignedFixedPoint<5,12>{}, SHIP) && ok;
+    ok = verify_kernel(SignedFixedPoint<3,20,SAT>{}, SHIP) && ok;
+    ok = verify_kernel(SignedFixedPoint<5,12,WRAP,RoundHalfUp>{}, SHIP) && ok;
+    ok = verify_kernel(SignedFixedPoint<29,30>{}, CUBIC) && ok;
+    ok = verify_kernel(SignedFixedPoint<5,12>{}, CUBIC) && ok;
+    ok = verify_kernel(SignedFixedPoint<3,20,SAT>{}, CUBIC) && ok;
+    ok = verify_kernel(SignedFixedPoint<29,10,WRAP,RoundConvergent>{}, CUBIC)
+         && ok;
+    ok = verify_kernel(SignedFixedPoint<29,30,WRAP,RoundStochastic>{}, CUBIC)
+         && ok;
+    ok = verify_kernel(SignedFixedPoint<29,30>{}, HIGHEST) && ok;
+    ok = verify_kernel(SignedFixedPoint<5,12,SAT>{}, HIGHEST) && ok;
+    ok = verify_divisor<29,10,5,4>() && ok;
+    ok = verify_divisor<16,15,16,15>() && ok;
+    ok = verify_divisor<5,12,5,12>() && ok;
+    ok = verify_divisor<16,15,29,10>() && ok;
+    ok = verify_divisor<29,30,4,0>() && ok;
+    ok = verify_distance<29,10>() && ok;
+    ok = verify_distance<16,4>() && ok;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/*
+ * Run the micro-benchmark 'name', see bench.h.
+ */
+static int run_bench(const char *name)
+{
+    bool ok = false;
+    if (!std::strcmp(name, "convert"))
+    {
+        ok = bench_convert(std::cout);
+    }
+    else if (!std::strcmp(name, "bailout"))
+    {
+        ok = bench_bailout(std::cout);
+    }
+    else if (!std::strcmp(name, "tiles"))
+    {
+        ok = bench_tiles(std::cout);
+    }
+    else
+    {
+        std::cerr << "Unknown benchmark '" << name << "'." << std::endl;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/*
+ * Progressively render to 'image' while displaying every completed pass in a
+ * window. Closing the window or pressing escape cancels the rendering after
+ * the current pass. Returns false if the rendering was cancelled.
+ */
+template <typename REAL_TYPE>
+static bool render_preview(
+        const segment_t<REAL_TYPE> &seg,
+        const int WIDTH, const int HEIGHT, const bool SUPERSAMPLE,
+        const int ITERATIONS, SDL_Surface *image)
+{
+    if (SDL_Init(SDL_INIT_VIDEO) < 0)
+    {
+        return false;
+    }
+    SDL_Surface *screen = SDL_SetVideoMode(WIDTH, HEIGHT, 32, SDL_SWSURFACE);
+    if (!screen)
+    {
+        SDL_Quit();
+        return false;
+    }
+    SDL_WM_SetCaption("Mandelbrot fixed point", nullptr);
+    std::atomic<bool> cancel{ false };
+    bool ok = render_progressive(
+        seg, WIDTH, HEIGHT, SUPERSAMPLE, ITERATIONS, image, &cancel,
+        [&](int)
+        {
+            // Display the pass.
+            SDL_UnlockSurface(image);
+            SDL_BlitSurface(image, nullptr, screen, nullptr);
+            SDL_Flip(screen);
+            SDL_LockSurface(image);
+
+            // Cancel on window close or escape.
+            SDL_Event event{};
+            while (SDL_PollEvent(&event))
+            {
+                if (event.type == SDL_QUIT || (event.type == SDL_KEYDOWN &&
+                    event.key.keysym.sym == SDLK_ESCAPE))
+                {
+                    cancel = true;
+                }
+            }
+        });
+    SDL_Quit();
+    return ok && !cancel;
+}
+
+
+int main(int argc, char *argv[])
 {
     /*
      * Image settings. The supersample setting enables 4x supersampling for the
@@ -32,13 +570,373 @@ int main()
     REAL_TYPE height{ 2.5 };
     segment_t<REAL_TYPE> fractal_segment{ center, width, height };
 
+    /*
+     * Command line options.
+     */
+    const char *archive_filename = nullptr;
+    const char *overflow_map_filename = nullptr;
+    const char *overflow_policy = "wrap";
+    const char *rounding = "truncate";
+    const char *quantdiff_formats = nullptr;
+    const char *recolor_filename = nullptr;
+    int workers = 0;
+    bool preview = false;
+    bool equalize = false;
+    bool distance = false;
+    distance_mode_t distance_mode = DISTANCE_SHADE;
+    bool tiled = false;
+    tile_order_t tile_order = TILE_ROW_MAJOR;
+    const char *numa_affinity = nullptr;
+    bool estimate = false;
+    const char *checkpoint_filename = nullptr;
+    bool resume = false;
+    bool auto_iterations = false;
+    const char *save_orbits = nullptr;
+    const char *resume_orbits = nullptr;
+    bool balance = false;
+    formula_spec_t formula{};
+    for (int i=1; i<argc; ++i)
+    {
+        if (!std::strcmp(argv[i], "--archive") && i+1 < argc)
+        {
+            archive_filename = argv[++i];
+        }
+        else if (!std::strcmp(argv[i], "--recolor") && i+1 < argc)
+        {
+            recolor_filename = argv[++i];
+        }
+        else if (!std::strcmp(argv[i], "--equalize"))
+        {
+            equalize = true;
+        }
+        else if (!std::strcmp(argv[i], "--distance"))
+        {
+            distance = true;
+            distance_mode = DISTANCE_SHADE;
+        }
+        else if (!std::strcmp(argv[i], "--adaptive"))
+        {
+            distance = true;
+            distance_mode = DISTANCE_ADAPTIVE;
+        }
+        else if (!std::strcmp(argv[i], "--auto-iterations"))
+        {
+            auto_iterations = true;
+        }
+        else if (!std::strcmp(argv[i], "--save-orbits") && i+1 < argc)
+        {
+            save_orbits = argv[++i];
+        }
+        else if (!std::strcmp(argv[i], "--resume-orbits") && i+1 < argc)
+        {
+            resume_orbits = argv[++i];
+        }
+        else if (!std::strcmp(argv[i], "--formula") && i+1 < argc)
+        {
+            if (!parse_formula(argv[++i], formula))
+            {
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            center = { REAL_TYPE{ formula.center_re },
+                       REAL_TYPE{ formula.center_im } };
+            fractal_segment.c = center;
+        }
+        else if (!std::strcmp(argv[i], "--tile-order") && i+1 < argc)
+        {
+            tiled = true;
+            if (!parse_tile_order(argv[++i], tile_order))
+            {
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (!std::strcmp(argv[i], "--numa") && i+1 < argc)
+        {
+            numa_affinity = argv[++i];
+        }
+        else if (!std::strcmp(argv[i], "--checkpoint") && i+1 < argc)
+        {
+            checkpoint_filename = argv[++i];
+            resume = false;
+        }
+        else if (!std::strcmp(argv[i], "--resume") && i+1 < argc)
+        {
+            checkpoint_filename = argv[++i];
+            resume = true;
+        }
+        else if (!std::strcmp(argv[i], "--workers") && i+1 < argc)
+        {
+            workers = std::atoi(argv[++i]);
+        }
+        else if (!std::strcmp(argv[i], "--estimate"))
+        {
+            estimate = true;
+        }
+        else if (!std::strcmp(argv[i], "--balance"))
+        {
+            balance = true;
+        }
+        else if (!std::strcmp(argv[i], "--preview"))
+        {
+            preview = true;
+        }
+        else if (!std::strcmp(argv[i], "--explore"))
+        {
+            explorer_config_t config{};
+            config.iterations = ITERATIONS;
+            config.supersample = SUPERSAMPLE;
+            config.frac_bits = FRAC_BITS;
+            explorer ui{ config };
+            if (!ui.run())
+            {
+                std::cerr << "Could not open explorer window." << std::endl;
+                return EXIT_FAILURE;
+            }
+            return EXIT_SUCCESS;
+        }
+        else if (!std::strcmp(argv[i], "--serve") && i+1 < argc)
+        {
+            render_service service{};
+            if (!service.run(argv[++i]))
+            {
+                std::cerr << "Render service failed." << std::endl;
+                return EXIT_FAILURE;
+            }
+            return EXIT_SUCCESS;
+        }
+        else if (!std::strcmp(argv[i], "--quantdiff") && i+1 < argc)
+        {
+            quantdiff_formats = argv[++i];
+        }
+        else if (!std::strcmp(argv[i], "--overflow-map") && i+1 < argc)
+        {
+            if (!COUNT_OVERFLOW)
+            {
+                std::cerr << "Overflow maps need a build with -D_COUNT_OVERFLOW.";
+                std::cerr << std::endl;
+                return EXIT_FAILURE;
+            }
+            overflow_map_filename = argv[++i];
+        }
+        else if (!std::strcmp(argv[i], "--overflow") && i+1 < argc)
+        {
+            overflow_policy = argv[++i];
+            if (std::strcmp(overflow_policy, "wrap") &&
+                std::strcmp(overflow_policy, "saturate") &&
+                std::strcmp(overflow_policy, "trap"))
+            {
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (!std::strcmp(argv[i], "--rounding") && i+1 < argc)
+        {
+            rounding = argv[++i];
+            if (!dispatch_rounding(rounding, [](auto) {}))
+            {
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (!std::strcmp(argv[i], "--verify-kernel"))
+        {
+            return verify_kernels();
+        }
+        else if (!std::strcmp(argv[i], "--bench") && i+1 < argc)
+        {
+            return run_bench(argv[++i]);
+        }
+        else if (!std::strcmp(argv[i], "--client") && i+1 < argc)
+        {
+            static_assert(INT_BITS == FORMAT_INT_BITS,
+                    "Render service format differs from the configured one.");
+            if (formula.kind != FORMULA_MANDELBROT)
+            {
+                std::cerr << "The render service only renders the ";
+                std::cerr << "mandelbrot set." << std::endl;
+                return EXIT_FAILURE;
+            }
+            service_request_t req{};
+            req.magic = SERVICE_MAGIC;
+            req.command = SERVICE_RENDER;
+            req.frac_bits = FRAC_BITS;
+            req.width = IMAGE_WIDTH;
+            req.height = IMAGE_HEIGHT;
+            req.supersample = SUPERSAMPLE;
+            req.iterations = ITERATIONS;
+            req.center_re = double(center.real());
+            req.center_im = double(center.imag());
+            req.w = double(width);
+            req.h = double(height);
+            return request_render(argv[++i], req, filename);
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (recolor_filename)
+    {
+        return recolor_archive(recolor_filename, filename, equalize);
+    }
+    if ((workers > 0 || preview) && (archive_filename || overflow_map_filename))
+    {
+        std::cerr << "Archives and overflow maps can only be written by plain ";
+        std::cerr << "renders." << std::endl;
+        return EXIT_FAILURE;
+    }
+    if ((workers > 0 || preview) && equalize)
+    {
+        std::cerr << "Equalized coloring only applies to plain renders and ";
+        std::cerr << "re-coloring." << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (distance && (workers > 0 || preview || equalize ||
+                     archive_filename || overflow_map_filename))
+    {
+        std::cerr << "Distance estimation only applies to plain renders ";
+        std::cerr << "without archive or overflow map." << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (tiled && (preview || distance || equalize || archive_filename ||
+                  overflow_map_filename))
+    {
+        std::cerr << "Tile orders only apply to plain and worker renders ";
+        std::cerr << "without archive or overflow map." << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (numa_affinity && (workers > 0 || preview || distance || tiled ||
+                          equalize || archive_filename ||
+                          overflow_map_filename))
+    {
+        std::cerr << "NUMA-aware rendering only applies to plain renders ";
+        std::cerr << "without archive or overflow map." << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (checkpoint_filename && (workers > 0 || preview || distance ||
+                                tiled || numa_affinity || equalize ||
+                                archive_filename || overflow_map_filename))
+    {
+        std::cerr << "Checkpoints only apply to plain renders without ";
+        std::cerr << "archive or overflow map." << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (auto_iterations && (workers > 0 || preview || distance || tiled ||
+                            numa_affinity || checkpoint_filename ||
+                            equalize || archive_filename ||
+                            overflow_map_filename))
+    {
+        std::cerr << "Adaptive iteration limits only apply to plain renders ";
+        std::cerr << "without archive or overflow map." << std::endl;
+        return EXIT_FAILURE;
+    }
+    const bool orbits = save_orbits || resume_orbits;
+    if (orbits && (workers > 0 || preview || distance || tiled ||
+                   numa_affinity || checkpoint_filename || auto_iterations ||
+                   equalize || archive_filename || overflow_map_filename))
+    {
+        std::cerr << "Orbit files only apply to plain renders without ";
+        std::cerr << "archive or overflow map." << std::endl;
+        return EXIT_FAILURE;
+    }
+    const bool mandelbrot = formula.kind == FORMULA_MANDELBROT;
+    if (!mandelbrot && (workers > 0 || preview || distance ||
+                        checkpoint_filename || auto_iterations || orbits ||
+                        estimate || balance))
+    {
+        std::cerr << "Other formulas only apply to plain, tiled and NUMA ";
+        std::cerr << "renders and format comparisons." << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (balance && (workers == 0 || tiled))
+    {
+        std::cerr << "Balancing only applies to worker renders without tile ";
+        std::cerr << "order." << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<int> numa_cpus{}, numa_nodes{};
+    if (numa_affinity && !get_thread_placement(
+            read_numa_topology(), numa_affinity, numa_cpus, numa_nodes))
+    {
+        std::cerr << "Invalid affinity '" << numa_affinity << "'." << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (quantdiff_formats)
+    {
+        segment_t<double> seg{
+            { double(center.real()), double(center.imag()) },
+            double(width), double(height) };
+        return quant_diff(
+            quantdiff_formats, rounding, seg,
+            IMAGE_WIDTH, IMAGE_HEIGHT, ITERATIONS, formula);
+    }
+    if ((workers > 0 || preview || checkpoint_filename || orbits ||
+         !mandelbrot) &&
+        (std::strcmp(overflow_policy, "wrap") ||
+         std::strcmp(rounding, "truncate")))
+    {
+        std::cerr << "Overflow and rounding policies only apply to plain ";
+        std::cerr << "renders of the mandelbrot set." << std::endl;
+        return EXIT_FAILURE;
+    }
+    const int tile_size = distributed_config_t{}.tile_size;
+    render_estimate_t render_estimate{};
+    if (estimate || balance)
+    {
+        render_estimate = estimate_render(
+            fractal_segment, IMAGE_WIDTH, IMAGE_HEIGHT, SUPERSAMPLE,
+            ITERATIONS);
+        print_estimate(render_estimate, workers, tile_size);
+        if (!balance)
+        {
+            return EXIT_SUCCESS;
+        }
+    }
+    archive_writer archive{};
+    const archive_header_t header = get_archive_header(
+            fractal_segment, IMAGE_WIDTH, IMAGE_HEIGHT, SUPERSAMPLE,
+            ITERATIONS);
+    if (archive_filename)
+    {
+        if (!archive.open(archive_filename, header))
+        {
+            std::cerr << "Could not open archive '" << archive_filename;
+            std::cerr << "'." << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    else if (equalize)
+    {
+        // The equalized coloring needs the escape results of the whole frame.
+        archive.open(header);
+    }
+    orbit_reader orbit_resume{};
+    orbit_writer orbit_save{};
+    if (resume_orbits && !(orbit_resume.open(resume_orbits) &&
+                           orbit_resume.continues(header)))
+    {
+        std::cerr << "Could not continue orbits '" << resume_orbits << "'.";
+        std::cerr << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    if (save_orbits && !orbit_save.open(save_orbits, header))
+    {
+        std::cerr << "Could not open orbit file '" << save_orbits << "'.";
+        std::cerr << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
     /*
      * Render fractal to SDL_Surface and save to file.
      */
-    SDL_Surface *image = SDL_CreateRGBSurface(
+    SDL_Surface *image = numa_affinity ?
+        create_first_touch_surface(IMAGE_WIDTH, IMAGE_HEIGHT) :
+        SDL_CreateRGBSurface(
             0, IMAGE_WIDTH, IMAGE_HEIGHT, IMAGE_COLOR, 0, 0, 0, 0
     );
-    if (SDL_LockSurface(image) < 0)
+    if (!image || SDL_LockSurface(image) < 0)
     {
         std::cerr << "Could not lock image surface." << std::endl;
         std::exit(EXIT_FAILURE);
@@ -46,24 +944,270 @@ int main()
     std::cout << "Rendering started... ";
     std::cout.flush();
     auto t1 = std::chrono::high_resolution_clock::now();
-    render(   // Actual rendering
-        fractal_segment,
-        IMAGE_WIDTH,
-        IMAGE_HEIGHT,
-        SUPERSAMPLE,
-        ITERATIONS,
-        image
-    );
+    lane_stats_t lane_stats{};
+    uint64_t supersampled = 0;
+    std::vector<numa_node_stats_t> numa_stats{};
+    checkpoint_stats_t checkpoint_stats{};
+    adaptive_stats_t adaptive_stats{};
+    orbit_stats_t orbit_stats{};
+    std::vector<uint32_t> first_overflow{};
+    if (overflow_map_filename)
+    {
+        first_overflow.resize(IMAGE_WIDTH*IMAGE_HEIGHT);
+    }
+    if (workers > 0)
+    {
+        distributed_config_t config{};
+        config.workers = workers;
+        config.tile_size = tile_size;
+        config.tile_order = tile_order;
+        config.estimate = balance ? &render_estimate : nullptr;
+        bool ok = render_distributed(
+            fractal_segment,
+            IMAGE_WIDTH,
+            IMAGE_HEIGHT,
+            SUPERSAMPLE,
+            ITERATIONS,
+            image,
+            config
+        );
+        if (!ok)
+        {
+            std::cerr << "Distributed rendering failed." << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    else if (checkpoint_filename)
+    {
+        bool ok = render_checkpointed(
+            fractal_segment,
+            IMAGE_WIDTH,
+            IMAGE_HEIGHT,
+            SUPERSAMPLE,
+            ITERATIONS,
+            image,
+            checkpoint_filename,
+            resume,
+            checkpoint_config_t{},
+            checkpoint_stats
+        );
+        if (!ok)
+        {
+            std::cerr << "Could not " << (resume ? "resume" : "write");
+            std::cerr << " checkpoint '" << checkpoint_filename << "'.";
+            std::cerr << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    else if (preview)
+    {
+        bool ok = render_preview(
+            fractal_segment,
+            IMAGE_WIDTH,
+            IMAGE_HEIGHT,
+            SUPERSAMPLE,
+            ITERATIONS,
+            image
+        );
+        if (!ok)
+        {
+            std::cerr << "Rendering cancelled." << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    else
+    {
+        auto render_plain = [&](const auto &seg, const auto &formula)
+        {
+            if (distance)
+            {
+                thread_pool pool{};
+                supersampled = render_distance(
+                    seg, IMAGE_WIDTH, IMAGE_HEIGHT, ITERATIONS, image,
+                    distance_mode, pool);
+                return;
+            }
+            if (numa_affinity)
+            {
+                numa_config_t config{};
+                config.affinity = numa_affinity;
+                if (!render_numa(
+                        seg, IMAGE_WIDTH, IMAGE_HEIGHT, SUPERSAMPLE,
+                        ITERATIONS, image, config, numa_stats, formula))
+                {
+                    std::cerr << "Invalid affinity '" << numa_affinity;
+                    std::cerr << "'." << std::endl;
+                    std::exit(EXIT_FAILURE);
+                }
+                return;
+            }
+            if (auto_iterations)
+            {
+                render_adaptive(
+                    seg, IMAGE_WIDTH, IMAGE_HEIGHT, SUPERSAMPLE, ITERATIONS,
+                    image, adaptive_config_t{}, adaptive_stats, &lane_stats);
+                return;
+            }
+            if (orbits)
+            {
+                render_orbits(
+                    seg, IMAGE_WIDTH, IMAGE_HEIGHT, SUPERSAMPLE, ITERATIONS,
+                    image, resume_orbits ? &orbit_resume : nullptr,
+                    save_orbits ? &orbit_save : nullptr, orbit_stats,
+                    &lane_stats);
+                return;
+            }
+            if (tiled)
+            {
+                render_tiled(
+                    seg, IMAGE_WIDTH, IMAGE_HEIGHT, SUPERSAMPLE, ITERATIONS,
+                    image, tile_order, formula);
+                return;
+            }
+            render(   // Actual rendering
+                seg,
+                IMAGE_WIDTH,
+                IMAGE_HEIGHT,
+                SUPERSAMPLE,
+                ITERATIONS,
+                image,
+                archive_filename || equalize ? &archive : nullptr,
+                formula,
+                &lane_stats,
+                overflow_map_filename ? first_overflow.data() : nullptr
+            );
+        };
+        auto render_policies = [&](auto overflow)
+        {
+            dispatch_rounding(rounding, [&](auto rounding_policy)
+            {
+                using T = SignedFixedPoint<INT_BITS, FRAC_BITS,
+                    decltype(overflow), decltype(rounding_policy)>;
+                render_plain(
+                    convert_segment<T>(fractal_segment), formula_mandelbrot{});
+            });
+        };
+        if (!mandelbrot)
+        {
+            dispatch_formula(formula, [&](auto f)
+            {
+                render_plain(fractal_segment, f);
+            });
+        }
+        else if (!std::strcmp(overflow_policy, "saturate"))
+        {
+            render_policies(OverflowSaturate{});
+        }
+        else if (!std::strcmp(overflow_policy, "trap"))
+        {
+            render_policies(OverflowTrap{});
+        }
+        else
+        {
+            render_policies(OverflowWrap{});
+        }
+    }
     auto t2 = std::chrono::high_resolution_clock::now();
     auto time = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1);
     std::cout << "Rendering finished after " << time.count() << "ms. ";
+    if (lane_stats.lane_steps > 0)
+    {
+        std::cout << "Lane utilization " << std::fixed << std::setprecision(1);
+        std::cout << 100.0*lane_stats.utilization() << "%. ";
+    }
+    if (distance && distance_mode == DISTANCE_ADAPTIVE)
+    {
+        std::cout << "Super sampled " << std::fixed << std::setprecision(1);
+        std::cout << 100.0*supersampled / (IMAGE_WIDTH*IMAGE_HEIGHT);
+        std::cout << "% of the pixels. ";
+    }
+    if (auto_iterations)
+    {
+        std::cout << "Iteration limit " << adaptive_stats.iterations;
+        std::cout << " after " << adaptive_stats.rounds << " rounds, ";
+        std::cout << std::setprecision(1) << double(adaptive_stats.steps) /
+            std::max<uint64_t>(1, adaptive_stats.samples);
+        std::cout << " iterations per sample. ";
+    }
+    if (resume_orbits)
+    {
+        std::cout << "Reused " << orbit_stats.reused << " and continued ";
+        std::cout << orbit_stats.continued << " samples. ";
+    }
+    if (checkpoint_filename)
+    {
+        std::cout << "Resumed " << checkpoint_stats.resumed << " of ";
+        std::cout << checkpoint_stats.tiles << " tiles. ";
+    }
     std::cout << "Writing to file '" << filename << "'." << std::endl;
+    for (size_t node=0; node<numa_stats.size(); ++node)
+    {
+        const numa_node_stats_t &s = numa_stats[node];
+        std::cout << "Node " << node << ": " << s.threads << " threads, ";
+        std::cout << s.bands << " bands, " << std::fixed;
+        std::cout << std::setprecision(1) << s.mpixels_per_s() << " Mpx/s, ";
+        std::cout << s.remote_pixels << " of " << s.pixels;
+        std::cout << " pixels in bands of other nodes." << std::endl;
+    }
+    if (!orbit_save.close())
+    {
+        std::cerr << "Could not write orbit file." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    if (!archive.close())
+    {
+        std::cerr << "Could not write archive to file." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    if (equalize)
+    {
+        auto t3 = std::chrono::high_resolution_clock::now();
+        thread_pool pool{};
+        archive_reader reader{};
+        if (!archive_filename)
+        {
+            recolor_equalized(header, archive.samples().data(), image, pool);
+        }
+        else if (reader.open(archive_filename))
+        {
+            recolor_equalized(reader, image, pool);
+        }
+        else
+        {
+            std::cerr << "Could not read archive '" << archive_filename;
+            std::cerr << "'." << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        auto t4 = std::chrono::high_resolution_clock::now();
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t4-t3);
+        std::cout << "Equalized coloring finished after " << ms.count();
+        std::cout << "ms." << std::endl;
+    }
     SDL_UnlockSurface(image);
     if (SDL_SaveBMP(image, filename) < 0)
     {
         std::cerr << "Could not write image to file." << std::endl;
         std::exit(EXIT_FAILURE);
     }
+    if (COUNT_OVERFLOW && workers == 0)
+    {
+        print_overflow_report(std::cout, collect_overflow_counters());
+    }
+    if (overflow_map_filename && !save_overflow_map(
+            first_overflow, IMAGE_WIDTH, IMAGE_HEIGHT, ITERATIONS,
+            overflow_map_filename))
+    {
+        std::cerr << "Could not write overflow map to file." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    if (numa_affinity)
+    {
+        free_first_touch_surface(image);
+    }
+    else
+    {
+        SDL_FreeSurface(image);
+    }
 
     return 0;
 }
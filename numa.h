@@ -0,0 +1,449 @@
+#ifndef _NUMA_H
+#define _NUMA_H
+
+#include "render.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <SDL/SDL.h>
+
+
+/*
+ * NUMA-aware rendering. On machines with several memory nodes (sockets) a page
+ * is placed on the node of the thread that first writes to it, so an image
+ * allocated and cleared by the main thread ends up on a single node and every
+ * other node renders into remote memory. Here the image is split into bands of
+ * rows, the bands are distributed over the nodes in proportion to their
+ * threads, and each band is first touched by a thread pinned to the node that
+ * owns it. The threads of a node render the bands of their node first and only
+ * then help out with the bands of other nodes.
+ */
+struct numa_topology_t
+{
+    std::vector<std::vector<int>> node_cpus;    // CPUs of each memory node
+};
+
+
+/*
+ * Configuration of a NUMA-aware render. The affinity is one of "scatter"
+ * (threads alternate between the nodes), "compact" (the CPUs of one node
+ * before those of the next), "none" (threads are not pinned) or an explicit
+ * list of CPUs such as "0-7,16-23" with one thread per CPU.
+ */
+struct numa_config_t
+{
+    std::string affinity{ "scatter" };
+    int band_rows{ 16 };        // Rows per band
+    uint64_t rounding_seed{ 0 };    // Seed of the stochastic rounding
+};
+
+
+/*
+ * Per-node statistics of a NUMA-aware render.
+ */
+struct numa_node_stats_t
+{
+    unsigned threads;           // Threads pinned to the node
+    uint64_t bands;             // Bands owned by the node
+    uint64_t pixels;            // Pixels rendered by the threads of the node
+    uint64_t remote_pixels;     // Of which in bands owned by other nodes
+    double busy_ms;             // Render time summed over the threads
+
+    double mpixels_per_s() const
+    {
+        return busy_ms > 0.0 ? threads * pixels / (busy_ms * 1000.0) : 0.0;
+    }
+};
+
+
+namespace detail
+{
+    /*
+     * Parse a list of CPUs in the format of the kernel, e.g. "0-3,8,10-11".
+     * Returns false on malformed lists.
+     */
+    static bool parse_cpu_list(const std::string &list, std::vector<int> &cpus)
+    {
+        const char *s = list.c_str();
+        while (*s && *s != '\n')
+        {
+            char *end = nullptr;
+            const long first = std::strtol(s, &end, 10);
+            long last = first;
+            if (end == s || first < 0)
+            {
+                return false;
+            }
+            if (*end == '-')
+            {
+                s = end + 1;
+                last = std::strtol(s, &end, 10);
+                if (end == s || last < first)
+                {
+                    return false;
+                }
+            }
+            for (long cpu=first; cpu<=last; ++cpu)
+            {
+                cpus.push_back(int(cpu));
+            }
+            s = *end == ',' ? end + 1 : end;
+        }
+        return true;
+    }
+
+    /*
+     * CPUs the process may run on.
+     */
+    static std::vector<int> allowed_cpus()
+    {
+        std::vector<int> cpus{};
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        {
+            for (int cpu=0; cpu<CPU_SETSIZE; ++cpu)
+            {
+                if (CPU_ISSET(cpu, &set))
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+        if (cpus.empty())
+        {
+            for (unsigned cpu=0; cpu<std::thread::hardware_concurrency(); ++cpu)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    /*
+     * Pin the calling thread to 'cpu'. Returns false if not permitted.
+     */
+    static bool pin_current_thread(int cpu)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return sched_setaffinity(0, sizeof(set), &set) == 0;
+    }
+}
+
+
+/*
+ * Read the memory nodes and their CPUs from sysfs, below 'root', restricted to
+ * the CPUs the process may run on. Without NUMA information all CPUs form a
+ * single node.
+ */
+static numa_topology_t read_numa_topology(
+        const std::string &root = "/sys/devices/system/node")
+{
+    const std::vector<int> allowed = detail::allowed_cpus();
+    numa_topology_t topo{};
+    std::vector<std::pair<int, std::string>> nodes{};
+    if (DIR *dir = opendir(root.c_str()))
+    {
+        while (dirent *entry = readdir(dir))
+        {
+            int node = 0;
+            char tail = 0;
+            if (std::sscanf(entry->d_name, "node%d%c", &node, &tail) == 1)
+            {
+                nodes.emplace_back(node, root + "/" + entry->d_name);
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(nodes.begin(), nodes.end());
+    for (const auto &node : nodes)
+    {
+        std::vector<int> cpus{}, usable{};
+        char buf[4096] = {};
+        FILE *f = std::fopen((node.second + "/cpulist").c_str(), "r");
+        if (!f)
+        {
+            continue;
+        }
+        if (!std::fgets(buf, sizeof(buf), f) ||
+            !detail::parse_cpu_list(buf, cpus))
+        {
+            cpus.clear();
+        }
+        std::fclose(f);
+        for (int cpu : cpus)
+        {
+            if (std::find(allowed.begin(), allowed.end(), cpu) !=
+                allowed.end())
+            {
+                usable.push_back(cpu);
+            }
+        }
+        if (!usable.empty())
+        {
+            topo.node_cpus.push_back(usable);
+        }
+    }
+    if (topo.node_cpus.empty())
+    {
+        topo.node_cpus.push_back(allowed);
+    }
+    return topo;
+}
+
+
+/*
+ * The CPU and node of every render thread for the affinity 'affinity', see
+ * numa_config_t. CPU -1 leaves the thread unpinned. Returns false if the
+ * affinity is invalid.
+ */
+static bool get_thread_placement(
+        const numa_topology_t &topo, const std::string &affinity,
+        std::vector<int> &cpus, std::vector<int> &nodes)
+{
+    const int N = topo.node_cpus.size();
+    cpus.clear();
+    nodes.clear();
+    if (affinity == "scatter" || affinity == "none")
+    {
+        for (size_t i=0; ; ++i)
+        {
+            bool any = false;
+            for (int node=0; node<N; ++node)
+            {
+                if (i < topo.node_cpus[node].size())
+                {
+                    cpus.push_back(affinity == "none" ?
+                        -1 : topo.node_cpus[node][i]);
+                    nodes.push_back(node);
+                    any = true;
+                }
+            }
+            if (!any)
+            {
+                break;
+            }
+        }
+    }
+    else if (affinity == "compact")
+    {
+        for (int node=0; node<N; ++node)
+        {
+            for (int cpu : topo.node_cpus[node])
+            {
+                cpus.push_back(cpu);
+                nodes.push_back(node);
+            }
+        }
+    }
+    else
+    {
+        std::vector<int> list{};
+        if (!detail::parse_cpu_list(affinity, list) || list.empty())
+        {
+            return false;
+        }
+        for (int cpu : list)
+        {
+            int node = -1;
+            for (int n=0; n<N && node < 0; ++n)
+            {
+                const std::vector<int> &c = topo.node_cpus[n];
+                node = std::find(c.begin(), c.end(), cpu) != c.end() ? n : -1;
+            }
+            if (node < 0)
+            {
+                return false;
+            }
+            cpus.push_back(cpu);
+            nodes.push_back(node);
+        }
+    }
+    return !cpus.empty();
+}
+
+
+/*
+ * Create a 32-bit SDL_Surface of WIDTH x HEIGHT pixels whose pixels are not
+ * yet backed by memory, so that every page is placed by the thread that first
+ * writes to it. Free with free_first_touch_surface().
+ */
+static SDL_Surface *create_first_touch_surface(
+        const int WIDTH, const int HEIGHT)
+{
+    const size_t bytes = size_t(WIDTH) * HEIGHT * 4;
+    void *pixels = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pixels == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    SDL_Surface *surf = SDL_CreateRGBSurfaceFrom(
+            pixels, WIDTH, HEIGHT, 32, WIDTH*4, 0, 0, 0, 0);
+    if (!surf)
+    {
+        munmap(pixels, bytes);
+    }
+    return surf;
+}
+
+static void free_first_touch_surface(SDL_Surface *surf)
+{
+    if (surf)
+    {
+        void *pixels = surf->pixels;
+        const size_t bytes = size_t(surf->pitch) * surf->h;
+        SDL_FreeSurface(surf);
+        munmap(pixels, bytes);
+    }
+}
+
+
+/*
+ * Render a segment of the madelbrot set to the SDL_Surface pointed to by surf,
+ * which should be created by create_first_touch_surface() and locked with
+ * SDL_LockSurface. The threads are placed according to 'config', each node
+ * first touches and renders the bands of rows it owns, and the statistics of
+ * every node are returned in 'stats'. The image is identical to that of
+ * render() with the formula 'formula'. With stochastic rounding every band
+ * draws from its own stream, so the image does not depend on the thread that
+ * renders it. Returns false if the affinity is invalid.
+ */
+template <typename REAL_TYPE, typename FORMULA = formula_mandelbrot>
+bool render_numa(
+        const segment_t<REAL_TYPE> &seg,
+        const int WIDTH, const int HEIGHT, const bool SUPERSAMPLE,
+        const int ITERATIONS, SDL_Surface *surf, const numa_config_t &config,
+        std::vector<numa_node_stats_t> &stats,
+        const FORMULA &formula = FORMULA{})
+{
+    using clock = std::chrono::steady_clock;
+    const numa_topology_t topo = read_numa_topology();
+    std::vector<int> cpus{}, thread_node{};
+    if (!get_thread_placement(topo, config.affinity, cpus, thread_node))
+    {
+        return false;
+    }
+    const int N = topo.node_cpus.size();
+    const int THREADS = cpus.size();
+    const int R = std::max(1, config.band_rows);
+    const int BANDS = (HEIGHT + R - 1) / R;
+
+    // Distribute contiguous ranges of bands over the nodes in proportion to
+    // the number of threads of each node.
+    stats.assign(N, numa_node_stats_t{});
+    for (int node : thread_node)
+    {
+        ++stats[node].threads;
+    }
+    std::vector<int> first_band(N + 1, 0);
+    for (int node=0, threads=0; node<N; ++node)
+    {
+        threads += stats[node].threads;
+        first_band[node + 1] = int(int64_t(BANDS) * threads / THREADS);
+        stats[node].bands = first_band[node + 1] - first_band[node];
+    }
+    std::vector<std::atomic<int>> next_band(N);
+    for (int node=0; node<N; ++node)
+    {
+        next_band[node] = first_band[node];
+    }
+
+    // Barrier between the first touch and the rendering, so that no band is
+    // touched by a thread of another node first.
+    std::mutex mutex{};
+    std::condition_variable touched_cv{};
+    int touched = 0;
+
+    const int stride = surf->pitch / 4;
+    uint32_t *pixels = (uint32_t *)surf->pixels;
+    std::vector<uint64_t> thread_pixels(THREADS, 0), thread_remote(THREADS, 0);
+    std::vector<double> thread_ms(THREADS, 0.0);
+    auto worker = [&](int t)
+    {
+        if (cpus[t] >= 0)
+        {
+            detail::pin_current_thread(cpus[t]);
+        }
+        const int node = thread_node[t];
+
+        // First touch the bands of the node, shared among its threads.
+        int local = 0, local_threads = 0;
+        for (int i=0; i<THREADS; ++i)
+        {
+            local += i < t && thread_node[i] == node;
+            local_threads += thread_node[i] == node;
+        }
+        for (int b=first_band[node]+local; b<first_band[node+1];
+             b+=local_threads)
+        {
+            const int rows = std::min(R, HEIGHT - b*R);
+            std::fill_n(pixels + size_t(b)*R*stride, size_t(rows)*stride, 0);
+        }
+        {
+            std::unique_lock<std::mutex> lock{ mutex };
+            if (++touched == THREADS)
+            {
+                touched_cv.notify_all();
+            }
+            touched_cv.wait(lock, [&]{ return touched == THREADS; });
+        }
+
+        // Render the bands of the node, then those of the other nodes.
+        const auto start = clock::now();
+        for (int k=0; k<N; ++k)
+        {
+            const int owner = (node + k) % N;
+            for (int b; (b = next_band[owner]++) < first_band[owner+1]; )
+            {
+                const tile_t band{
+                    0, b*R, WIDTH, std::min(R, HEIGHT - b*R) };
+                seed_stochastic_rounding(
+                    stochastic_rounding_seed(config.rounding_seed, b));
+                render_tile(
+                    seg, WIDTH, HEIGHT, SUPERSAMPLE, ITERATIONS, band,
+                    surf->format, pixels + size_t(band.y)*stride, stride,
+                    nullptr, formula);
+                thread_pixels[t] += uint64_t(band.w) * band.h;
+                thread_remote[t] += owner != node ?
+                    uint64_t(band.w) * band.h : 0;
+            }
+        }
+        const std::chrono::duration<double, std::milli> busy =
+            clock::now() - start;
+        thread_ms[t] = busy.count();
+    };
+
+    std::vector<std::thread> threads{};
+    for (int t=0; t<THREADS; ++t)
+    {
+        threads.emplace_back(worker, t);
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    for (int t=0; t<THREADS; ++t)
+    {
+        numa_node_stats_t &s = stats[thread_node[t]];
+        s.pixels += thread_pixels[t];
+        s.remote_pixels += thread_remote[t];
+        s.busy_ms += thread_ms[t];
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,330 @@
+#ifndef _ORBIT_H
+#define _ORBIT_H
+
+#include "render.h"
+#include "archive.h"
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <SDL/SDL.h>
+
+
+/*
+ * Orbit state files. A render normally discards z when a sample reaches the
+ * iteration limit, so a render of the same frame with a higher limit has to
+ * repeat all iterations below the old limit. An orbit file keeps the raw
+ * escape state of every iterated sample of a fixed point render: the escape
+ * iteration and raw z of the samples that escaped, and the iteration limit and
+ * raw z of those that did not. The file consists of an orbit_header_t and one
+ * orbit_record_t per iterated sample, ordered by sample index in archive
+ * order; samples within the main cardioid and the period 2 bulb are not
+ * iterated and have no record. A later render of the same frame with a higher
+ * limit reuses the escaped samples and continues the others from their z,
+ * with results identical to a render from z = 0, see escape_lanes().
+ */
+constexpr char ORBIT_MAGIC[8] = { 'M', 'F', 'P', 'O', 'R', 'B', 'I', 'T' };
+constexpr uint32_t ORBIT_VERSION = 1;
+
+
+/*
+ * Orbit file header. The iterations of the frame are the limit the states were
+ * computed with.
+ */
+struct orbit_header_t
+{
+    char magic[8];              // ORBIT_MAGIC
+    uint32_t version;           // ORBIT_VERSION
+    uint32_t reserved;
+    archive_header_t frame;     // Frame of the render
+    uint64_t records;           // Number of orbit records
+};
+
+
+struct orbit_record_t
+{
+    uint32_t sample;            // Sample index in archive order
+    uint32_t iteration;         // Escape iteration, or the iteration limit
+    int64_t z_re, z_im;         // Raw z at that iteration
+};
+
+
+/*
+ * Sequential orbit file writer. Records must be written in sample order.
+ */
+class orbit_writer
+{
+public:
+    orbit_writer() = default;
+    orbit_writer(const orbit_writer &) = delete;
+    orbit_writer &operator=(const orbit_writer &) = delete;
+    ~orbit_writer() { close(); }
+
+    /*
+     * Open the orbit file 'filename' for writing. The function returns false
+     * on failure or if the frame has too many samples for orbit_record_t.
+     */
+    bool open(const char *filename, const archive_header_t &frame)
+    {
+        close();
+        if (uint64_t(frame.width) * frame.height * frame.samples > UINT32_MAX)
+        {
+            return false;
+        }
+        file = std::fopen(filename, "wb");
+        if (!file)
+        {
+            return false;
+        }
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, ORBIT_MAGIC, sizeof(ORBIT_MAGIC));
+        header.version = ORBIT_VERSION;
+        header.frame = frame;
+        return std::fwrite(&header, sizeof(header), 1, file) == 1;
+    }
+
+    void write(const orbit_record_t &record)
+    {
+        ++header.records;
+        std::fwrite(&record, sizeof(record), 1, file);
+    }
+
+    /*
+     * Write the record count to the header and close the file. The function
+     * returns false if the file could not be written completely.
+     */
+    bool close()
+    {
+        if (!file)
+        {
+            return true;
+        }
+        bool ok = !std::ferror(file) && std::fseek(file, 0, SEEK_SET) == 0 &&
+                  std::fwrite(&header, sizeof(header), 1, file) == 1;
+        ok = (std::fclose(file) == 0) && ok;
+        file = nullptr;
+        return ok;
+    }
+
+private:
+    std::FILE *file{ nullptr };
+    orbit_header_t header{};
+};
+
+
+/*
+ * Memory-mapped orbit file reader.
+ */
+class orbit_reader
+{
+public:
+    orbit_reader() = default;
+    orbit_reader(const orbit_reader &) = delete;
+    orbit_reader &operator=(const orbit_reader &) = delete;
+    ~orbit_reader() { close(); }
+
+    /*
+     * Map the orbit file 'filename' into memory and validate its header. The
+     * function returns false on failure.
+     */
+    bool open(const char *filename)
+    {
+        close();
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat st{};
+        if (fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(orbit_header_t))
+        {
+            ::close(fd);
+            return false;
+        }
+        size = st.st_size;
+        void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED)
+        {
+            return false;
+        }
+        data = static_cast<const uint8_t *>(map);
+        madvise(map, size, MADV_SEQUENTIAL);
+
+        const orbit_header_t &hdr = header();
+        if (std::memcmp(hdr.magic, ORBIT_MAGIC, sizeof(ORBIT_MAGIC)) ||
+            hdr.version != ORBIT_VERSION ||
+            hdr.records >
+                (size - sizeof(orbit_header_t)) / sizeof(orbit_record_t) ||
+            size != sizeof(orbit_header_t) +
+                    hdr.records*sizeof(orbit_record_t))
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (data)
+        {
+            munmap(const_cast<uint8_t *>(data), size);
+            data = nullptr;
+            size = 0;
+        }
+    }
+
+    /*
+     * Test if the orbits were computed for the frame 'frame' with the same or
+     * a lower iteration limit.
+     */
+    bool continues(const archive_header_t &frame) const
+    {
+        archive_header_t hdr = header().frame;
+        const bool lower = hdr.iterations <= frame.iterations;
+        hdr.iterations = frame.iterations;
+        return lower && !std::memcmp(&hdr, &frame, sizeof(frame));
+    }
+
+    const orbit_header_t &header() const
+    {
+        return *reinterpret_cast<const orbit_header_t *>(data);
+    }
+
+    const orbit_record_t *records() const
+    {
+        return reinterpret_cast<const orbit_record_t *>(
+                data + sizeof(orbit_header_t));
+    }
+
+private:
+    const uint8_t *data{ nullptr };
+    size_t size{ 0 };
+};
+
+
+struct orbit_stats_t
+{
+    uint64_t reused;            // Escaped samples taken from the orbit file
+    uint64_t continued;         // Samples continued from their saved z
+    uint64_t steps;             // Escape iterations performed
+};
+
+
+/*
+ * Render a segment of the madelbrot set to the SDL_Surface pointed to by surf,
+ * continuing the orbits of 'resume' if given, which must continue the frame
+ * (see orbit_reader::continues()), and writing the orbit state of every
+ * iterated sample to 'save' if given. The SDL_Surface object should have its
+ * surface locked with SDL_LockSurface before calling this function. The image
+ * is identical to that of render().
+ */
+template <int INT, int FRAC, typename POLICY, typename ROUNDING>
+void render_orbits(
+        const segment_t<SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>> &seg,
+        const int WIDTH, const int HEIGHT, const bool SUPERSAMPLE,
+        const unsigned ITERATIONS, SDL_Surface *surf,
+        const orbit_reader *resume, orbit_writer *save, orbit_stats_t &stats,
+        lane_stats_t *lane_stats = nullptr)
+{
+    using REAL_TYPE = SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>;
+    const escape_t IN_SET{ ITERATIONS, 0.0 };
+    const pixel_grid<REAL_TYPE> grid{ seg, WIDTH, HEIGHT };
+    raw_sample_points<INT,FRAC,POLICY,ROUNDING> points{
+        grid, WIDTH, SUPERSAMPLE };
+    const int S = SUPERSAMPLE ? 4 : 1;
+    const int n = WIDTH * S;
+    std::vector<int64_t> re(n), im(n);
+    std::vector<uint8_t> interior(n);
+    std::vector<int> queue(n);
+    std::vector<raw_escape_t> state(n);
+    std::vector<escape_t> res(n);
+
+    const orbit_record_t *record = resume ? resume->records() : nullptr;
+    const orbit_record_t *end =
+        resume ? record + resume->header().records : nullptr;
+    const unsigned limit = resume ? resume->header().frame.iterations : 0;
+    stats = orbit_stats_t{};
+    for (int y=0; y<HEIGHT; ++y)
+    {
+        points(0, WIDTH, y, re.data(), im.data());
+        filter_interior<INT,FRAC,POLICY,ROUNDING>(
+            re.data(), im.data(), n, interior.data(), FILTER_EXTRA_BULBS);
+
+        // Start state of the samples, and the queue of those that have not
+        // escaped yet.
+        int count = 0;
+        uint64_t start_steps = 0;
+        for (int i=0; i<n; ++i)
+        {
+            const uint64_t sample = uint64_t(y)*n + i;
+            state[i] = raw_escape_t{ 0, UINT_MAX, 0, 0 };
+            while (record != end && record->sample < sample)
+            {
+                ++record;
+            }
+            if (interior[i])
+                continue;
+            if (record != end && record->sample == sample)
+            {
+                state[i] = raw_escape_t{
+                    record->iteration, UINT_MAX, record->z_re, record->z_im };
+                if (record->iteration < limit)
+                {
+                    ++stats.reused;
+                    continue;
+                }
+                ++stats.continued;
+                start_steps += record->iteration;
+            }
+            queue[count++] = i;
+        }
+        escape_lanes<INT,FRAC,POLICY,ROUNDING>(
+            re.data(), im.data(), queue.data(), count, ITERATIONS,
+            state.data(), lane_stats, state.data());
+        for (int k=0; k<count; ++k)
+        {
+            stats.steps += state[queue[k]].iteration;
+        }
+        stats.steps -= start_steps;
+
+        // Escape results and orbit records of the row.
+        for (int i=0; i<n; ++i)
+        {
+            const raw_escape_t &r = state[i];
+            res[i] = IN_SET;
+            if (interior[i])
+                continue;
+            if (r.iteration < ITERATIONS)
+            {
+                res[i].iteration = r.iteration;
+                res[i].conv = get_convergence_value_raw<
+                    INT,FRAC,POLICY,ROUNDING>(
+                    r.iteration, r.z_re, r.z_im, re[i], im[i]);
+            }
+            if (save)
+            {
+                save->write(orbit_record_t{
+                    uint32_t(uint64_t(y)*n + i), r.iteration, r.z_re, r.z_im });
+            }
+        }
+
+        // Color the pixels of the row.
+        uint32_t *px = (uint32_t *)((uint8_t *)surf->pixels + y*surf->pitch);
+        for (int x=0; x<WIDTH; ++x)
+        {
+            const escape_t *e = &res[x*S];
+            SDL_Color c = SUPERSAMPLE ?
+                get_average_color(e, ITERATIONS) :
+                get_escape_color(e[0], ITERATIONS);
+            px[x] = SDL_MapRGB(surf->format, c.r, c.g, c.b);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef _OVERFLOW_H
+#define _OVERFLOW_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <list>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+
+/*
+ * Overflow event counting. Compiling with the pre-processor macro
+ * '_COUNT_OVERFLOW' defined (command-line option '-D_COUNT_OVERFLOW') makes the
+ * raw escape kernels count every assignment that wraps around, per thread, per
+ * number format and per call site, and record the first overflow iteration of
+ * every sample. Unlike _DEBUG_SHOW_OVERFLOW_INFO of FixedPoint.h nothing is
+ * printed while rendering; the counters are collected into a report once the
+ * frame is done.
+ */
+#ifdef _COUNT_OVERFLOW
+    constexpr bool COUNT_OVERFLOW = true;
+#else
+    constexpr bool COUNT_OVERFLOW = false;
+#endif
+
+
+/*
+ * Call sites of the raw kernels where a value is assigned to the number format.
+ */
+enum overflow_site_t
+{
+    OVERFLOW_Z_RE,
+    OVERFLOW_Z_IM,
+    OVERFLOW_Z_RE_SQR,
+    OVERFLOW_Z_IM_SQR,
+    OVERFLOW_FILTER_Q,
+    OVERFLOW_FILTER_Y_SQR,
+    OVERFLOW_SITES
+};
+
+static const char *const OVERFLOW_SITE_NAMES[OVERFLOW_SITES] = {
+    "z_re", "z_im", "z_re_sqr", "z_im_sqr", "filter q", "filter y*y"
+};
+
+
+/*
+ * Number of assignments and of overflowing assignments per call site, for the
+ * format SignedFixedPoint<int_bits,frac_bits>.
+ */
+struct overflow_counters_t
+{
+    int int_bits, frac_bits;
+    uint64_t assignments[OVERFLOW_SITES];
+    uint64_t overflows[OVERFLOW_SITES];
+};
+
+
+namespace detail
+{
+    /*
+     * Registry of the counter blocks of all threads. The blocks are owned by
+     * the registry, so the counts of a thread outlive the thread itself.
+     */
+    class overflow_registry
+    {
+    public:
+        static overflow_registry &instance()
+        {
+            static overflow_registry registry{};
+            return registry;
+        }
+
+        overflow_counters_t *add(int int_bits, int frac_bits)
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            blocks.push_back(overflow_counters_t{ int_bits, frac_bits, {}, {} });
+            return &blocks.back();
+        }
+
+        /*
+         * Sum up the blocks per format, and reset them if 'reset' is set. The
+         * threads owning the blocks must not be counting concurrently.
+         */
+        std::vector<overflow_counters_t> collect(bool reset)
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            std::vector<overflow_counters_t> res{};
+            for (overflow_counters_t &block : blocks)
+            {
+                auto it = std::find_if(res.begin(), res.end(),
+                    [&](const overflow_counters_t &c)
+                    {
+                        return c.int_bits == block.int_bits &&
+                               c.frac_bits == block.frac_bits;
+                    });
+                if (it == res.end())
+                {
+                    res.push_back(overflow_counters_t{
+                        block.int_bits, block.frac_bits, {}, {} });
+                    it = res.end() - 1;
+                }
+                for (int s=0; s<OVERFLOW_SITES; ++s)
+                {
+                    it->assignments[s] += block.assignments[s];
+                    it->overflows[s] += block.overflows[s];
+                    if (reset)
+                    {
+                        block.assignments[s] = block.overflows[s] = 0;
+                    }
+                }
+            }
+            return res;
+        }
+
+    private:
+        overflow_registry() = default;
+
+        std::mutex mutex{};
+        std::list<overflow_counters_t> blocks{};
+    };
+}
+
+
+/*
+ * Counters of the calling thread for the format <INT,FRAC>.
+ */
+template <int INT, int FRAC>
+overflow_counters_t &thread_overflow_counters()
+{
+    thread_local overflow_counters_t *counters =
+        detail::overflow_registry::instance().add(INT, FRAC);
+    return *counters;
+}
+
+
+/*
+ * Aggregate the counters of all threads per format, typically at the end of a
+ * frame. The counters are reset if 'reset' is set.
+ */
+inline std::vector<overflow_counters_t> collect_overflow_counters(
+        bool reset = true)
+{
+    return detail::overflow_registry::instance().collect(reset);
+}
+
+
+/*
+ * Print a compact report of the call sites with assignments.
+ */
+inline void print_overflow_report(
+        std::ostream &os, const std::vector<overflow_counters_t> &counters)
+{
+    os << "Overflow report:" << std::endl;
+    for (const overflow_counters_t &c : counters)
+    {
+        for (int s=0; s<OVERFLOW_SITES; ++s)
+        {
+            if (c.assignments[s] == 0)
+            {
+                continue;
+            }
+            os << "  <" << c.int_bits << "," << c.frac_bits << "> ";
+            os << std::left << std::setw(11) << OVERFLOW_SITE_NAMES[s];
+            os << std::right << std::setw(12) << c.overflows[s] << " / ";
+            os << std::setw(14) << c.assignments[s] << " (";
+            os << std::fixed << std::setprecision(4);
+            os << 100.0 * c.overflows[s] / c.assignments[s] << "%)";
+            os << std::endl;
+        }
+    }
+}
+
+#endif
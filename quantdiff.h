@@ -0,0 +1,288 @@
+#ifndef _QUANTDIFF_H
+#define _QUANTDIFF_H
+
+#include "render.h"
+#include "formats.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+/*
+ * Quantization difference engine. Renders the double-precision reference and a
+ * list of fixed point formats in a single pass over the pixel grid. Each row of
+ * reference escape iterations is computed once and compared against the same
+ * row of every format, so no full image is ever stored for a format. For each
+ * format the engine accumulates aggregate statistics and optionally produces a
+ * diff image and a per-pixel escape iteration delta file.
+ */
+struct quant_stats_t
+{
+    int frac_bits;              // Format, see formats.h
+    uint64_t pixels;            // Pixels compared
+    uint64_t mismatches;        // Pixels with a different escape iteration
+    uint64_t set_mismatches;    // Pixels escaping in only one of the renders
+    uint64_t escaped;           // Pixels escaping in both renders
+    uint64_t error_sum;         // Sum of |delta| over pixels escaping in both
+    unsigned max_error;         // Max |delta| over pixels escaping in both
+    bool delta_failed;          // Writing the delta file failed
+
+    double mismatch_percent() const
+    {
+        return pixels ? 100.0 * mismatches / pixels : 0.0;
+    }
+
+    double mean_error() const
+    {
+        return escaped ? double(error_sum) / escaped : 0.0;
+    }
+};
+
+
+/*
+ * Per format outputs. 'diff' is an optional SDL_Surface of the image size,
+ * locked with SDL_LockSurface, that receives the diff image. 'delta_fd' is an
+ * optional file descriptor receiving a quant_delta_header_t followed by the
+ * int32_t escape iteration delta (format - reference) of every pixel in
+ * row-major order. Pixels where only one render escaped have the delta
+ * INT32_MAX (only the reference escaped) or INT32_MIN (only the format did).
+ */
+struct quant_output_t
+{
+    int frac_bits;
+    SDL_Surface *diff{ nullptr };
+    int delta_fd{ -1 };
+};
+
+struct quant_delta_header_t
+{
+    char magic[8];              // "MFPDELTA"
+    int32_t int_bits;
+    int32_t frac_bits;
+    uint32_t width;
+    uint32_t height;
+    uint32_t iterations;
+    uint32_t reserved;
+};
+
+
+namespace detail
+{
+    /*
+     * Color of an escape iteration delta in the diff image. Equal iterations
+     * are black, pixels escaping in only one render are white, later escapes
+     * are red and earlier escapes blue with log-scaled intensity.
+     */
+    static inline SDL_Color quant_diff_color(int32_t delta, unsigned iterations)
+    {
+        if (delta == 0)
+        {
+            return SDL_Color{ 0, 0, 0, 0 };
+        }
+        if (delta == INT32_MAX || delta == INT32_MIN)
+        {
+            return SDL_Color{ 255, 255, 255, 0 };
+        }
+        double scale = std::log2(1.0 + std::abs(double(delta))) /
+                       std::log2(1.0 + iterations);
+        uint8_t v = uint8_t(64 + 191*std::min(1.0, scale));
+        return delta > 0 ? SDL_Color{ v, 0, 0, 0 } : SDL_Color{ 0, 0, v, 0 };
+    }
+
+
+    /*
+     * Write 'size' bytes of 'buf' at 'offset' of the file 'fd', continuing
+     * after partial writes. The function returns false if the write failed.
+     */
+    static inline bool quant_pwrite(
+            int fd, const void *buf, size_t size, off_t offset)
+    {
+        const char *p = static_cast<const char *>(buf);
+        while (size > 0)
+        {
+            ssize_t n = pwrite(fd, p, size, offset);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return false;
+            }
+            p += n;
+            size -= size_t(n);
+            offset += n;
+        }
+        return true;
+    }
+
+
+    /*
+     * Escape iterations of the pixels of row 'px_y' on the pixel grid of the
+     * format REAL_TYPE, with the formula 'formula'.
+     */
+    template <typename REAL_TYPE, typename FORMULA>
+    static void quant_escape_row(
+            const pixel_grid<REAL_TYPE> &grid, const int WIDTH,
+            const int px_y, const unsigned ITERATIONS, unsigned *res,
+            const FORMULA &formula)
+    {
+        for (int px_x=0; px_x<WIDTH; ++px_x)
+        {
+            res[px_x] = get_escape(
+                grid(px_x, px_y).c, ITERATIONS, formula).iteration;
+        }
+    }
+}
+
+
+/*
+ * Compare renders of the segment 'seg' in the formats of 'outputs' against the
+ * double-precision reference, without super sampling. The fixed point formats
+ * use the rounding policy ROUNDING, see FixedPoint.h. The statistics of each
+ * format are returned in the order of 'outputs', with 'delta_failed' set when a
+ * write to its delta file failed. Rows are distributed over the
+ * thread pool 'pool'. All renders iterate the formula 'formula', see
+ * formula.h. With stochastic rounding, every row of every format draws from
+ * its own stream of the seed 'rounding_seed', so the comparison is
+ * reproducible.
+ */
+template <
+    typename ROUNDING = RoundTruncate, typename FORMULA = formula_mandelbrot >
+static std::vector<quant_stats_t> render_quant_diff(
+        const segment_t<double> &seg,
+        const int WIDTH, const int HEIGHT, const int ITERATIONS,
+        const std::vector<quant_output_t> &outputs, thread_pool &pool,
+        const FORMULA &formula = FORMULA{}, const uint64_t rounding_seed = 0)
+{
+    const size_t N = outputs.size();
+    std::vector<quant_stats_t> stats(N, quant_stats_t{});
+    for (size_t f=0; f<N; ++f)
+    {
+        stats[f].frac_bits = outputs[f].frac_bits;
+    }
+
+    // Write the headers of the delta files. Rows are written concurrently, so
+    // their failures are collected in atomic flags.
+    std::vector<std::atomic<bool>> delta_failed(N);
+    for (size_t f=0; f<N; ++f)
+    {
+        const quant_output_t &out = outputs[f];
+        delta_failed[f] = false;
+        if (out.delta_fd >= 0)
+        {
+            quant_delta_header_t hdr{
+                { 'M', 'F', 'P', 'D', 'E', 'L', 'T', 'A' },
+                out.frac_bits ? FORMAT_INT_BITS : 0, out.frac_bits,
+                uint32_t(WIDTH), uint32_t(HEIGHT), uint32_t(ITERATIONS), 0 };
+            if (!detail::quant_pwrite(out.delta_fd, &hdr, sizeof(hdr), 0))
+            {
+                delta_failed[f] = true;
+            }
+        }
+    }
+
+    const pixel_grid<double> ref_grid{ seg, WIDTH, HEIGHT };
+    std::mutex stats_mutex{};
+    parallel_for(pool, HEIGHT, [&](int px_y)
+    {
+        // Reference row, computed once for all formats.
+        std::vector<unsigned> ref(WIDTH), row(WIDTH);
+        std::vector<int32_t> delta(WIDTH);
+        detail::quant_escape_row(
+            ref_grid, WIDTH, px_y, ITERATIONS, ref.data(), formula);
+
+        std::vector<quant_stats_t> row_stats(N, quant_stats_t{});
+        for (size_t f=0; f<N; ++f)
+        {
+            const quant_output_t &out = outputs[f];
+            dispatch_format(out.frac_bits, [&](auto real)
+            {
+                using REAL_TYPE =
+                    typename with_rounding<decltype(real), ROUNDING>::type;
+                const segment_t<REAL_TYPE> fseg{
+                    { REAL_TYPE(seg.c.real()), REAL_TYPE(seg.c.imag()) },
+                    REAL_TYPE(seg.w), REAL_TYPE(seg.h) };
+                const pixel_grid<REAL_TYPE> grid{ fseg, WIDTH, HEIGHT };
+                seed_stochastic_rounding(stochastic_rounding_seed(
+                    stochastic_rounding_seed(rounding_seed, out.frac_bits),
+                    px_y));
+                detail::quant_escape_row(
+                    grid, WIDTH, px_y, ITERATIONS, row.data(), formula);
+            });
+
+            // Compare against the reference.
+            quant_stats_t &s = row_stats[f];
+            const unsigned IT = ITERATIONS;
+            for (int px_x=0; px_x<WIDTH; ++px_x)
+            {
+                bool ref_escaped = ref[px_x] < IT;
+                bool escaped = row[px_x] < IT;
+                int32_t d = int32_t(row[px_x]) - int32_t(ref[px_x]);
+                if (ref_escaped != escaped)
+                {
+                    d = ref_escaped ? INT32_MAX : INT32_MIN;
+                    ++s.set_mismatches;
+                }
+                else if (escaped)
+                {
+                    unsigned e = std::abs(d);
+                    ++s.escaped;
+                    s.error_sum += e;
+                    s.max_error = std::max(s.max_error, e);
+                }
+                s.mismatches += d != 0;
+                delta[px_x] = d;
+            }
+            s.pixels += WIDTH;
+
+            // Outputs of the row.
+            if (out.diff)
+            {
+                uint32_t *px = (uint32_t *)
+                    ((uint8_t *)out.diff->pixels + size_t(px_y)*out.diff->pitch);
+                for (int px_x=0; px_x<WIDTH; ++px_x)
+                {
+                    SDL_Color c = detail::quant_diff_color(delta[px_x], IT);
+                    px[px_x] = SDL_MapRGB(out.diff->format, c.r, c.g, c.b);
+                }
+            }
+            if (out.delta_fd >= 0)
+            {
+                off_t offset = sizeof(quant_delta_header_t) +
+                    off_t(px_y) * WIDTH * sizeof(int32_t);
+                if (!detail::quant_pwrite(out.delta_fd, delta.data(),
+                        WIDTH*sizeof(int32_t), offset))
+                {
+                    delta_failed[f] = true;
+                }
+            }
+        }
+
+        // Merge the row statistics.
+        std::lock_guard<std::mutex> lock{ stats_mutex };
+        for (size_t f=0; f<N; ++f)
+        {
+            stats[f].pixels += row_stats[f].pixels;
+            stats[f].mismatches += row_stats[f].mismatches;
+            stats[f].set_mismatches += row_stats[f].set_mismatches;
+            stats[f].escaped += row_stats[f].escaped;
+            stats[f].error_sum += row_stats[f].error_sum;
+            stats[f].max_error =
+                std::max(stats[f].max_error, row_stats[f].max_error);
+        }
+    });
+    for (size_t f=0; f<N; ++f)
+    {
+        stats[f].delta_failed = delta_failed[f];
+    }
+    return stats;
+}
+
+#endif
@@ -2,11 +2,30 @@
 #define _RENDER_H
 
 #include "FixedPoint.h"
+#include "archive.h"
+#include "batch.h"
+#include "formula.h"
+#include <algorithm>
+#include <atomic>
 #include <complex>
+#include <climits>
 #include <cmath>
+#include <vector>
 #include <SDL/SDL.h>
 
 
+/*
+ * Compiling with pre-processor macro '_FILTER_EXTRA_BULBS' defined makes the
+ * batched fixed point renders classify points within the period 3 and 4 bulbs
+ * as interior points without iterating them, see filter_interior().
+ */
+#ifdef _FILTER_EXTRA_BULBS
+    constexpr bool FILTER_EXTRA_BULBS = true;
+#else
+    constexpr bool FILTER_EXTRA_BULBS = false;
+#endif
+
+
 /*
  * Segment of the fractal in the complex plane. A segment of the fractal is a
  * complex center point some width and height.
@@ -54,75 +73,319 @@ static SDL_Color hsl_to_rgb(double hue, double sat, double light)
 
 
 /*
- * Get a continues coloring value from a point 'c' on the complex plane that has
- * escaped to ('z_re' + i*'z_im') in 'iteration' iterations.
+ * Result of an escape test of a single point on the complex plane. A point that
+ * has not escaped within the iteration limit has 'iteration' equal to the limit
+ * and should be colored black. For escaped points 'conv' holds the continuous
+ * convergence value used for coloring.
+ */
+struct escape_t
+{
+    unsigned iteration;     // Escape iteration
+    double conv;            // Continuous convergence value
+};
+
+
+/*
+ * Bailout test of the escape loop, |z|^2 > 4, given the squares 'z_re_sqr' and
+ * 'z_im_sqr' of the parts of z.
  */
 template <typename REAL_TYPE>
-static SDL_Color get_convergence_color(
+static bool has_escaped(const REAL_TYPE &z_re_sqr, const REAL_TYPE &z_im_sqr)
+{
+    return z_re_sqr+z_im_sqr > REAL_TYPE(4.0);
+}
+
+
+/*
+ * Fixed point variant of the bailout test. Instead of building the widened sum
+ * and comparing it to REAL_TYPE(4.0), which is constructed from a double, the
+ * integer words of the sum are compared to the constant 4: the high words
+ * decide unless they sum to exactly 4, in which case any fractional bit
+ * escapes. The result is identical to that of the generic test, which for
+ * formats with less than four integer bits compares against the wrapped
+ * constant and is used as is.
+ */
+template <int INT, int FRAC, typename POLICY, typename ROUNDING>
+static bool has_escaped(
+        const SignedFixedPoint<INT,FRAC,POLICY,ROUNDING> &z_re_sqr,
+        const SignedFixedPoint<INT,FRAC,POLICY,ROUNDING> &z_im_sqr)
+{
+    using REAL_TYPE = SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>;
+    if CONSTEXPR (INT < 4 || INT > 62)
+    {
+        return z_re_sqr+z_im_sqr > REAL_TYPE(4.0);
+    }
+    else
+    {
+        constexpr int64_t BAILOUT = 4;
+        const auto a = z_re_sqr.get_num(), b = z_im_sqr.get_num();
+        const uint64_t lo = uint64_t(a.table[0]) + uint64_t(b.table[0]);
+        const int64_t hi =
+            a.table[1] + b.table[1] + (lo < uint64_t(a.table[0]));
+        return hi > BAILOUT || (hi == BAILOUT && lo != 0);
+    }
+}
+
+
+/*
+ * Continuous iteration count of a point that has escaped to |z| = 'z_abs' in
+ * 'iteration' iterations of a formula of degree 'degree'.
+ */
+static double get_smooth_iteration(int iteration, double z_abs, int degree)
+{
+    if (degree == 2)
+    {
+        return double(iteration) - std::log2( std::log(z_abs)/std::log(2) );
+    }
+    return double(iteration) -
+        std::log( std::log(z_abs)/std::log(2) )/std::log(double(degree));
+}
+
+
+/*
+ * Get a continues convergence value from a point on the complex plane that
+ * has escaped to ('z_re' + i*'z_im') in 'iteration' iterations of the formula
+ * FORMULA with the constant 'c'. Formulas of a higher degree than two get no
+ * extra iterations, which would overflow fixed point formats.
+ */
+template <typename REAL_TYPE, typename FORMULA = formula_mandelbrot>
+static double get_convergence_value(
         int iteration, REAL_TYPE z_re, REAL_TYPE z_im,
-        const std::complex<REAL_TYPE> &c)
+        const std::complex<REAL_TYPE> &c, const FORMULA & = FORMULA{})
 {
     // Get the convergence value of the point z by performing some extra
     // iterations after the point has escaped the escape radius.
-    for (int i=0; i<3; ++i)
+    if CONSTEXPR (FORMULA::SQUARE)
     {
-        // z = z*z + c
-        REAL_TYPE z_re_old = z_re;
-        z_re = z_re*z_re - z_im*z_im + c.real();
-        z_im = REAL_TYPE(2.0) * REAL_TYPE(z_re_old*z_im) + c.imag();
-        iteration++;
+        for (int i=0; i<3; ++i)
+        {
+            // z = z*z + c
+            REAL_TYPE z_re_old = z_re;
+            z_re = z_re*z_re - z_im*z_im + c.real();
+            z_im = REAL_TYPE(2.0) * REAL_TYPE(z_re_old*z_im) + c.imag();
+            iteration++;
+        }
+    }
+    else if CONSTEXPR (FORMULA::DEGREE == 2)
+    {
+        REAL_TYPE z_re_sqr = z_re*z_re, z_im_sqr = z_im*z_im;
+        for (int i=0; i<3; ++i)
+        {
+            FORMULA::step(z_re, z_im, z_re_sqr, z_im_sqr, c);
+            iteration++;
+        }
     }
 
-    // Generate a convergence value and return a color from it.
+    // Generate a convergence value.
     double z_abs = std::sqrt(double(z_re*z_re + z_im*z_im));
-    double conv = double(iteration) - std::log2( std::log(z_abs)/std::log(2) );
+    return get_smooth_iteration(iteration, z_abs, FORMULA::DEGREE);
+}
+
+
+/*
+ * Convergence value of a point escaped in a fixed point format, given by the
+ * raw numbers of z and of the constant c of the formula FORMULA, see
+ * raw_format. The extra iterations of get_convergence_value() are performed
+ * on raw numbers, rounded and fit the same way as the fixed point
+ * assignments, so the result is identical.
+ */
+template <
+    int INT, int FRAC, typename POLICY, typename ROUNDING,
+    typename FORMULA = formula_mandelbrot >
+static double get_convergence_value_raw(
+        int iteration, int64_t z_re, int64_t z_im, int64_t c_re, int64_t c_im)
+{
+    using raw = raw_format<INT,FRAC,POLICY,ROUNDING>;
+    using wide_type = typename raw::wide_type;
+    constexpr int64_t TWO = raw::constant(2, 0);
+    if CONSTEXPR (FORMULA::SQUARE)
+    {
+        for (int i=0; i<3; ++i)
+        {
+            // z = z*z + c
+            const int64_t z_re_old = z_re;
+            z_re = raw::narrow_sum(
+                wide_type(z_re)*z_re - wide_type(z_im)*z_im, c_re);
+            const int64_t z_re_im = raw::narrow(wide_type(z_re_old)*z_im);
+            z_im = raw::narrow_sum(wide_type(TWO)*z_re_im, c_im);
+            iteration++;
+        }
+    }
+    else if CONSTEXPR (FORMULA::DEGREE == 2)
+    {
+        using kernel = escape_kernel<INT,FRAC,POLICY,ROUNDING,FORMULA>;
+        int64_t z_re_sqr = raw::narrow(wide_type(z_re) * z_re);
+        int64_t z_im_sqr = raw::narrow(wide_type(z_im) * z_im);
+        for (int i=0; i<3; ++i)
+        {
+            kernel::step(z_re, z_im, z_re_sqr, z_im_sqr, c_re, c_im);
+            iteration++;
+        }
+    }
+
+    // Generate a convergence value.
+    const auto re = raw::from_raw(z_re), im = raw::from_raw(z_im);
+    double z_abs = std::sqrt(double(re*re + im*im));
+    return get_smooth_iteration(iteration, z_abs, FORMULA::DEGREE);
+}
+
+
+/*
+ * Fixed point variant of get_convergence_value(), see
+ * get_convergence_value_raw().
+ */
+template <
+    int INT, int FRAC, typename POLICY, typename ROUNDING,
+    typename FORMULA = formula_mandelbrot >
+static double get_convergence_value(
+        int iteration,
+        SignedFixedPoint<INT,FRAC,POLICY,ROUNDING> z_re,
+        SignedFixedPoint<INT,FRAC,POLICY,ROUNDING> z_im,
+        const std::complex<SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>> &c,
+        const FORMULA &formula = FORMULA{})
+{
+    using REAL_TYPE = SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>;
+    if CONSTEXPR (INT + FRAC > 62)
+    {
+        return get_convergence_value<REAL_TYPE>(
+            iteration, z_re, z_im, c, formula);
+    }
+    else
+    {
+        using raw = raw_format<INT,FRAC,POLICY,ROUNDING>;
+        return get_convergence_value_raw<INT,FRAC,POLICY,ROUNDING,FORMULA>(
+            iteration, raw::to_raw(z_re), raw::to_raw(z_im),
+            raw::to_raw(c.real()), raw::to_raw(c.imag()));
+    }
+}
+
+
+/*
+ * Default color palette. Maps a continuous convergence value to a color.
+ */
+static SDL_Color palette_default(double conv)
+{
     return hsl_to_rgb(std::log(10.0*conv), 1.0, 0.7);
 }
 
 
 /*
- * Test if a point on the complex plane will escape from the mandelbrot set. The
- * result is a SDL_Color pixel where a black pixel indicates that the point is
- * withing the set, and any other color is outside of the set.
+ * Get the color of an escape test result using the color palette 'palette',
+ * callable as SDL_Color palette(double conv). Points that did not escape within
+ * 'iterations' iterations are colored black.
  */
-template <typename REAL_TYPE>
-static SDL_Color test_escape(
-        const std::complex<REAL_TYPE> &c, unsigned iterations)
+template <typename PALETTE = SDL_Color (*)(double)>
+static SDL_Color get_escape_color(
+        const escape_t &e, unsigned iterations,
+        PALETTE palette = palette_default)
 {
     constexpr SDL_Color COLOR_BLACK{ 0, 0, 0, 0 };
+    if (e.iteration >= iterations)
+    {
+        return COLOR_BLACK;
+    }
+    return palette(e.conv);
+}
+
+
+/*
+ * Get a continues coloring value from a point 'c' on the complex plane that has
+ * escaped to ('z_re' + i*'z_im') in 'iteration' iterations.
+ */
+template <typename REAL_TYPE>
+static SDL_Color get_convergence_color(
+        int iteration, REAL_TYPE z_re, REAL_TYPE z_im,
+        const std::complex<REAL_TYPE> &c)
+{
+    return palette_default(get_convergence_value(iteration, z_re, z_im, c));
+}
+
+
+/*
+ * Escape iteration loop of a point on the complex plane, without any interior
+ * checks. The result is the escape iteration and convergence value of the
+ * point, where an escape iteration equal to 'iterations' indicates that the
+ * point did not escape. The point is iterated with the formula 'formula', see
+ * formula.h.
+ */
+template <typename REAL_TYPE, typename FORMULA = formula_mandelbrot>
+static escape_t get_escape_unfiltered(
+        const std::complex<REAL_TYPE> &c, unsigned iterations,
+        const FORMULA &formula = FORMULA{})
+{
+    const std::complex<REAL_TYPE> k = formula.constant(c);
+    REAL_TYPE z_re{ 0.0 }, z_im{ 0.0 }, z_re_sqr{ 0.0 }, z_im_sqr{ 0.0 };
+    if CONSTEXPR (FORMULA::JULIA)
+    {
+        // Julia sets start at z equal to the point.
+        z_re = c.real();
+        z_im = c.imag();
+        z_re_sqr = z_re * z_re;
+        z_im_sqr = z_im * z_im;
+    }
+    for (unsigned i=0; i<iterations; ++i)
+    {
+        // Z has escaped the escape radius, get convergence and return.
+        if (has_escaped(z_re_sqr, z_im_sqr))
+        {
+            return { i, get_convergence_value(i, z_re, z_im, k, formula) };
+        }
+        FORMULA::step(z_re, z_im, z_re_sqr, z_im_sqr, k);
+    }
+
+    // Escape didn't happen.
+    return { iterations, 0.0 };
+}
+
+
+/*
+ * Test if a point on the complex plane will escape from the mandelbrot set. The
+ * result is the escape iteration and convergence value of the point, where an
+ * escape iteration equal to 'iterations' indicates that the point is withing
+ * the set. For other formulas than the mandelbrot set, the point is iterated
+ * without the interior checks.
+ */
+template <typename REAL_TYPE, typename FORMULA = formula_mandelbrot>
+static escape_t get_escape(
+        const std::complex<REAL_TYPE> &c, unsigned iterations,
+        const FORMULA &formula = FORMULA{})
+{
+    if CONSTEXPR (!FORMULA::INTERIOR)
+    {
+        return get_escape_unfiltered(c, iterations, formula);
+    }
+    const escape_t IN_SET{ iterations, 0.0 };
     REAL_TYPE x = c.real();
     REAL_TYPE y = c.imag();
     REAL_TYPE q = (x - REAL_TYPE(0.25))*(x - REAL_TYPE(0.25)) + y*y;
     if ( q*(q+x-REAL_TYPE(0.25)) < REAL_TYPE(0.25)*REAL_TYPE(y*y) )
     {
         // Inside main cardioid.
-        return COLOR_BLACK;
+        return IN_SET;
     }
     else if ( (x+REAL_TYPE(1))*(x+REAL_TYPE(1)) + y*y < REAL_TYPE(0.0625) )
     {
         // Inside period one bulb.
-        return COLOR_BLACK;
+        return IN_SET;
     }
     else
     {
         // Test requiered.
-        REAL_TYPE z_re{ 0.0 }, z_im{ 0.0 }, z_re_sqr{ 0.0 }, z_im_sqr{ 0.0 };
-        for (unsigned i=0; i<iterations; ++i)
-        {
-            // Z has escaped the escape radius, get color and return.
-            if (z_re_sqr+z_im_sqr > REAL_TYPE(4.0))
-            {
-                return get_convergence_color(i, z_re, z_im, c);
-            }
-            z_im = (z_re+z_im)*(z_re+z_im) - z_re_sqr - z_im_sqr + c.imag();
-            z_re = z_re_sqr - z_im_sqr + c.real();
-            z_re_sqr = z_re * z_re;
-            z_im_sqr = z_im * z_im;
-        }
+        return get_escape_unfiltered(c, iterations, formula);
     }
+}
 
-    // Escape didn't happen.
-    return COLOR_BLACK;
+
+/*
+ * Test if a point on the complex plane will escape from the mandelbrot set. The
+ * result is a SDL_Color pixel where a black pixel indicates that the point is
+ * withing the set, and any other color is outside of the set.
+ */
+template <typename REAL_TYPE>
+static SDL_Color test_escape(
+        const std::complex<REAL_TYPE> &c, unsigned iterations)
+{
+    return get_escape_color(get_escape(c, iterations), iterations);
 }
 
 
@@ -134,26 +397,17 @@ static uint8_t get_average(uint8_t c1, uint8_t c2, uint8_t c3, uint8_t c4)
 
 
 /*
- * Test if a segment of the complex plane will escape from the mandelbrot set.
- * Using an entire segment, instead of a signle point, allows for super sampling
- * an image of the mandelbrot set. The function will return a 4x super sampled
- * color of the segment.
+ * Get the color of four escape test results as their average color.
  */
-template <int INT, int FRAC>
-static SDL_Color test_escape(const segment_t<SignedFixedPoint<INT,FRAC>> &seg, unsigned iterations)
+template <typename PALETTE = SDL_Color (*)(double)>
+static SDL_Color get_average_color(
+        const escape_t e[4], unsigned iterations,
+        PALETTE palette = palette_default)
 {
-    using REAL_TYPE = SignedFixedPoint<INT,FRAC>;
     SDL_Color res[4]{};
-    for (int y=0; y<2; ++y)
+    for (int i=0; i<4; ++i)
     {
-        for (int x=0; x<2; ++x)
-        {
-            //res[2*y + 1*x] = test_escape(seg.c, iterations);
-            REAL_TYPE real{ seg.c.real() + REAL_TYPE(x)*seg.w/SignedFixedPoint<4,0>(2.0) };
-            REAL_TYPE imag{ seg.c.imag() + REAL_TYPE(y)*seg.h/SignedFixedPoint<4,0>(2.0) };
-            std::complex<REAL_TYPE> c{ real, imag };
-            res[2*y + x] = test_escape(c, iterations);
-        }
+        res[i] = get_escape_color(e[i], iterations, palette);
     }
     SDL_Color _res{};
     _res.r = get_average(res[0].r, res[1].r, res[2].r, res[3].r);
@@ -163,63 +417,411 @@ static SDL_Color test_escape(const segment_t<SignedFixedPoint<INT,FRAC>> &seg, u
 }
 
 
+/*
+ * Get the four super sampling points of a segment of the complex plane. Using
+ * an entire segment, instead of a signle point, allows for super sampling an
+ * image of the mandelbrot set. The divisor of the offsets is prepared once for
+ * the four points, see make_divisor().
+ */
+template <int INT, int FRAC, typename POLICY, typename ROUNDING>
+static void get_sample_points(
+        const segment_t<SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>> &seg,
+        std::complex<SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>> c[4])
+{
+    using REAL_TYPE = SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>;
+    const auto half = make_divisor(SignedFixedPoint<4,0>(2.0));
+    for (int y=0; y<2; ++y)
+    {
+        for (int x=0; x<2; ++x)
+        {
+            REAL_TYPE real{ seg.c.real() + REAL_TYPE(x)*seg.w/half };
+            REAL_TYPE imag{ seg.c.imag() + REAL_TYPE(y)*seg.h/half };
+            c[2*y + x] = std::complex<REAL_TYPE>{ real, imag };
+        }
+    }
+}
+
+
 /*
  * Same function but for double precision floatin point segments.
  */
-static SDL_Color test_escape(const segment_t<double> &seg, unsigned iterations)
+static void get_sample_points(
+        const segment_t<double> &seg, std::complex<double> c[4])
 {
     using REAL_TYPE = double;
-    SDL_Color res[4]{};
     for (int y=0; y<2; ++y)
     {
         for (int x=0; x<2; ++x)
         {
-            //res[2*y + 1*x] = test_escape(seg.c, iterations);
             REAL_TYPE real{ seg.c.real() + REAL_TYPE(x)*seg.w/2.0 };
             REAL_TYPE imag{ seg.c.imag() + REAL_TYPE(y)*seg.h/2.0 };
-            std::complex<REAL_TYPE> c{ real, imag };
-            res[2*y + x] = test_escape(c, iterations);
+            c[2*y + x] = std::complex<REAL_TYPE>{ real, imag };
         }
     }
-    SDL_Color _res{};
-    _res.r = get_average(res[0].r, res[1].r, res[2].r, res[3].r);
-    _res.g = get_average(res[0].g, res[1].g, res[2].g, res[3].g);
-    _res.b = get_average(res[0].b, res[1].b, res[2].b, res[3].b);
-    return _res;
 }
 
 
 /*
- * Render a segment of the madelbrot set to the SDL_Surface pointed to by surf.
- * The SDL_Surface object should have its surface locked with SDL_LockSurface
- * before calling this function. Double-precision floating-point variant.
+ * Test if a segment of the complex plane will escape from the mandelbrot set,
+ * or the fractal of the formula 'formula', using four super sampling points.
+ * The escape results of the four samples are written to 'res'.
  */
-void render(
-        const segment_t<double> &seg,
+template <typename REAL_TYPE, typename FORMULA = formula_mandelbrot>
+static void get_escape(
+        const segment_t<REAL_TYPE> &seg, unsigned iterations, escape_t res[4],
+        const FORMULA &formula = FORMULA{})
+{
+    std::complex<REAL_TYPE> c[4]{};
+    get_sample_points(seg, c);
+    for (int i=0; i<4; ++i)
+    {
+        res[i] = get_escape(c[i], iterations, formula);
+    }
+}
+
+
+/*
+ * Test if a segment of the complex plane will escape from the mandelbrot set.
+ * The function will return a 4x super sampled color of the segment.
+ */
+template <typename REAL_TYPE>
+static SDL_Color test_escape(const segment_t<REAL_TYPE> &seg, unsigned iterations)
+{
+    escape_t res[4]{};
+    get_escape(seg, iterations, res);
+    return get_average_color(res, iterations);
+}
+
+
+/*
+ * Compute the color of a pixel from either a single point or a 4x super sampled
+ * segment, and append the escape results to the archive if one is given.
+ */
+template <typename REAL_TYPE, typename FORMULA = formula_mandelbrot>
+static SDL_Color get_pixel_color(
+        const segment_t<REAL_TYPE> &seg, const bool SUPERSAMPLE,
+        const int ITERATIONS, archive_writer *archive,
+        const FORMULA &formula = FORMULA{})
+{
+    escape_t res[4]{};
+    SDL_Color c{};
+    int samples{};
+    if (SUPERSAMPLE)
+    {
+        get_escape(seg, ITERATIONS, res, formula);
+        c = get_average_color(res, ITERATIONS);
+        samples = 4;
+    }
+    else
+    {
+        res[0] = get_escape(seg.c, ITERATIONS, formula);
+        c = get_escape_color(res[0], ITERATIONS);
+        samples = 1;
+    }
+    if (archive)
+    {
+        for (int i=0; i<samples; ++i)
+        {
+            archive->write(res[i].iteration, res[i].conv);
+        }
+    }
+    return c;
+}
+
+
+/*
+ * Rectangular tile of pixels within an image.
+ */
+struct tile_t
+{
+    int x, y;       // Upper left pixel of the tile
+    int w, h;       // Tile width and height in pixels
+};
+
+
+/*
+ * Mapping from pixel coordinates of a WIDTH x HEIGHT image to segments of the
+ * complex plane. The segment of a pixel only depends on the pixel coordinates,
+ * so any subset of the image can be rendered to the same result as the whole.
+ */
+template <typename REAL_TYPE>
+struct pixel_grid;
+
+template <>
+struct pixel_grid<double>
+{
+    pixel_grid(const segment_t<double> &seg, const int WIDTH, const int HEIGHT)
+        : seg{ seg },
+          px_width{ seg.w / double(WIDTH) },
+          px_height{ seg.h / double(HEIGHT) }
+    {
+    }
+
+    segment_t<double> operator()(int px_x, int px_y) const
+    {
+        double real = seg.c.real() - seg.w/2.0 + px_width*px_x;
+        double imag = seg.c.imag() - seg.h/2.0 + px_height*px_y;
+        std::complex<double> point{ real, imag };
+        return segment_t<double>{ point, px_width, px_height };
+    }
+
+    segment_t<double> seg;
+    double px_width;
+    double px_height;
+};
+
+template <int INT, int FRAC, typename POLICY, typename ROUNDING>
+struct pixel_grid<SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>>
+{
+    using T = SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>;
+
+    // Calculate the px width and height in floating point.
+    pixel_grid(const segment_t<T> &seg, const int WIDTH, const int HEIGHT)
+        : re{ double(seg.c.real()) - double(seg.w)/2.0 },
+          im{ double(seg.c.imag()) - double(seg.h)/2.0 },
+          px_width{ double(seg.w) / double(WIDTH) },
+          px_height{ double(seg.h) / double(HEIGHT) }
+    {
+    }
+
+    segment_t<T> operator()(int px_x, int px_y) const
+    {
+        T real{ re + px_width*px_x };
+        T imag{ im + px_height*px_y };
+        std::complex<T> point{ real, imag };
+        return segment_t<T>{ point, T(px_width), T(px_height) };
+    }
+
+    double re, im;
+    double px_width;
+    double px_height;
+};
+
+
+/*
+ * Sample points of the pixels of rows of a fixed point pixel grid in raw
+ * representation, one per pixel or the four of get_sample_points(). The pixel
+ * centers of a row are converted from double in bulk exactly as by pixel_grid.
+ * Rows are at most MAX_WIDTH pixels wide.
+ */
+template <int INT, int FRAC, typename POLICY, typename ROUNDING>
+class raw_sample_points
+{
+public:
+    using REAL_TYPE = SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>;
+    using raw = raw_format<INT,FRAC,POLICY,ROUNDING>;
+
+    raw_sample_points(
+            const pixel_grid<REAL_TYPE> &grid, const int MAX_WIDTH,
+            const bool SUPERSAMPLE)
+        : grid{ grid },
+          supersample{ SUPERSAMPLE },
+          px_width{ grid.px_width },
+          px_height{ grid.px_height },
+          px_re_d( MAX_WIDTH ),
+          px_re( MAX_WIDTH ),
+          c( SUPERSAMPLE ? 4*MAX_WIDTH : 0 )
+    {
+    }
+
+    /*
+     * Write the sample points of the pixels [x, x+w) of row y to 're' and
+     * 'im', with the samples of a pixel stored consecutively.
+     */
+    void operator()(int x, int w, int y, int64_t *re, int64_t *im)
+    {
+        for (int i=0; i<w; ++i)
+        {
+            px_re_d[i] = grid.re + grid.px_width*(x + i);
+        }
+        raw::to_raw(px_re_d.data(), px_re.data(), w);
+        const int64_t px_im = raw::to_raw(grid.im + grid.px_height*y);
+        if (!supersample)
+        {
+            std::copy(px_re.begin(), px_re.begin() + w, re);
+            std::fill(im, im + w, px_im);
+            return;
+        }
+        for (int i=0; i<w; ++i)
+        {
+            const std::complex<REAL_TYPE> px_c{
+                raw::from_raw(px_re[i]), raw::from_raw(px_im) };
+            const segment_t<REAL_TYPE> px_seg{ px_c, px_width, px_height };
+            get_sample_points(px_seg, &c[4*i]);
+        }
+        for (int i=0; i<4*w; ++i)
+        {
+            re[i] = raw::to_raw(c[i].real());
+            im[i] = raw::to_raw(c[i].imag());
+        }
+    }
+
+private:
+    const pixel_grid<REAL_TYPE> &grid;
+    const bool supersample;
+    const REAL_TYPE px_width, px_height;
+    std::vector<double> px_re_d;
+    std::vector<int64_t> px_re;
+    std::vector<std::complex<REAL_TYPE>> c;
+};
+
+
+/*
+ * Per-pixel rendering of a tile, see render_tile().
+ */
+template <typename REAL_TYPE, typename FORMULA>
+static void render_tile_pixels(
+        const segment_t<REAL_TYPE> &seg,
         const int WIDTH, const int HEIGHT, const bool SUPERSAMPLE,
-        const int ITERATIONS, SDL_Surface *surf)
+        const int ITERATIONS, const tile_t &tile,
+        const SDL_PixelFormat *fmt, uint32_t *pixels, const int stride,
+        archive_writer *archive, const FORMULA &formula)
 {
-    const double px_width = seg.w / double(WIDTH);
-    const double px_height = seg.h / double(HEIGHT);
-    for (int px_y=0; px_y<HEIGHT; ++px_y)
+    // Iterate over each pixel in the tile, calculate the pixels complex
+    // value and generate it's color thereof.
+    const pixel_grid<REAL_TYPE> grid{ seg, WIDTH, HEIGHT };
+    for (int y=0; y<tile.h; ++y)
+    {
+        for (int x=0; x<tile.w; ++x)
+        {
+            segment_t<REAL_TYPE> px_seg = grid(tile.x + x, tile.y + y);
+            SDL_Color c = get_pixel_color(
+                    px_seg, SUPERSAMPLE, ITERATIONS, archive, formula);
+            pixels[y*stride + x] = SDL_MapRGB(fmt, c.r, c.g, c.b);
+        }
+    }
+}
+
+
+/*
+ * Render a tile of a WIDTH x HEIGHT image of the segment 'seg' to the pixel
+ * buffer 'pixels', with 'stride' pixels per row, using the pixel format 'fmt'.
+ * The first pixel of the buffer corresponds to the upper left pixel of the
+ * tile. If 'archive' is given, the escape results of every sample are written
+ * to it in archive order of the tile. The fractal is that of the formula
+ * 'formula', the mandelbrot set by default, see formula.h.
+ */
+template <typename REAL_TYPE, typename FORMULA = formula_mandelbrot>
+void render_tile(
+        const segment_t<REAL_TYPE> &seg,
+        const int WIDTH, const int HEIGHT, const bool SUPERSAMPLE,
+        const int ITERATIONS, const tile_t &tile,
+        const SDL_PixelFormat *fmt, uint32_t *pixels, const int stride,
+        archive_writer *archive = nullptr, const FORMULA &formula = FORMULA{})
+{
+    render_tile_pixels(
+        seg, WIDTH, HEIGHT, SUPERSAMPLE, ITERATIONS, tile,
+        fmt, pixels, stride, archive, formula);
+}
+
+
+/*
+ * Fixed point variant of render_tile(). The samples of each row of the tile are
+ * classified by the batched interior pre-filter, see filter_interior(), and
+ * only the surviving samples, compacted into dense lanes, run the escape loop
+ * with dynamic lane refill, see escape_lanes(). The result is identical to
+ * that of the per-pixel path. If 'lane_stats' is given, the lane utilization
+ * of the tile is added to it. If 'first_overflow' is given, the first overflow
+ * iteration among the samples of each pixel is written to it, with 'stride'
+ * entries per row (UINT32_MAX for none, and always unless compiled with
+ * _COUNT_OVERFLOW). With _DEBUG_SHOW_OVERFLOW_INFO the per-pixel path is used,
+ * since only the FixedPoint.h operators report overflows. With stochastic
+ * rounding the lanes draw their random bits in a different order than the
+ * per-pixel path, so the images agree only statistically. The pre-filter only
+ * applies to the mandelbrot set, and the lanes iterate the formula 'formula'.
+ */
+template <
+    int INT, int FRAC, typename POLICY, typename ROUNDING,
+    typename FORMULA = formula_mandelbrot >
+void render_tile(
+        const segment_t<SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>> &seg,
+        const int WIDTH, const int HEIGHT, const bool SUPERSAMPLE,
+        const int ITERATIONS, const tile_t &tile,
+        const SDL_PixelFormat *fmt, uint32_t *pixels, const int stride,
+        archive_writer *archive = nullptr, const FORMULA &formula = FORMULA{},
+        lane_stats_t *lane_stats = nullptr, uint32_t *first_overflow = nullptr)
+{
+    #ifdef _DEBUG_SHOW_OVERFLOW_INFO
+    {
+        render_tile_pixels(
+            seg, WIDTH, HEIGHT, SUPERSAMPLE, ITERATIONS, tile,
+            fmt, pixels, stride, archive, formula);
+        return;
+    }
+    #endif
+
+    using REAL_TYPE = SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>;
+    using raw = raw_format<INT,FRAC,POLICY,ROUNDING>;
+    const escape_t IN_SET{ unsigned(ITERATIONS), 0.0 };
+    const std::complex<REAL_TYPE> julia =
+        formula.constant(std::complex<REAL_TYPE>{});
+    const int64_t julia_re = raw::to_raw(julia.real());
+    const int64_t julia_im = raw::to_raw(julia.imag());
+    const pixel_grid<REAL_TYPE> grid{ seg, WIDTH, HEIGHT };
+    raw_sample_points<INT,FRAC,POLICY,ROUNDING> points{
+        grid, tile.w, SUPERSAMPLE };
+    const int samples = SUPERSAMPLE ? 4 : 1;
+    const int n = tile.w * samples;
+    std::vector<int64_t> re(n), im(n);
+    std::vector<uint8_t> interior(n);
+    std::vector<int> lanes(n);
+    std::vector<raw_escape_t> raw_res(n);
+    std::vector<escape_t> res(n);
+    for (int y=0; y<tile.h; ++y)
     {
-        for (int px_x=0; px_x<WIDTH; ++px_x)
+        points(tile.x, tile.w, tile.y + y, re.data(), im.data());
+
+        // Pre-filter interior points and iterate the survivors.
+        if CONSTEXPR (FORMULA::INTERIOR)
         {
-            uint32_t *px = (uint32_t *)surf->pixels;
-            double real = seg.c.real() - seg.w/2.0 + px_width*px_x;
-            double imag = seg.c.imag() - seg.h/2.0 + px_height*px_y;
-            std::complex<double> point{ real, imag };
-            segment_t<double> seg{ point, px_width, px_height };
-            SDL_Color c{};
-            if (SUPERSAMPLE)
+            filter_interior<INT,FRAC,POLICY,ROUNDING>(
+                re.data(), im.data(), n, interior.data(), FILTER_EXTRA_BULBS);
+        }
+        const int survivors = compact_lanes(interior.data(), n, lanes.data());
+        escape_lanes<INT,FRAC,POLICY,ROUNDING>(
+            re.data(), im.data(), lanes.data(), survivors, ITERATIONS,
+            raw_res.data(), lane_stats, nullptr, formula);
+        std::fill(res.begin(), res.end(), IN_SET);
+        for (int k=0; k<survivors; ++k)
+        {
+            const int i = lanes[k];
+            const raw_escape_t &r = raw_res[i];
+            if (r.iteration < unsigned(ITERATIONS))
             {
-                c = test_escape(seg, ITERATIONS);
+                res[i].iteration = r.iteration;
+                res[i].conv = get_convergence_value_raw<
+                    INT,FRAC,POLICY,ROUNDING,FORMULA>(
+                    r.iteration, r.z_re, r.z_im,
+                    FORMULA::JULIA ? julia_re : re[i],
+                    FORMULA::JULIA ? julia_im : im[i]);
             }
-            else
+        }
+
+        // Color the pixels of the row.
+        for (int x=0; x<tile.w; ++x)
+        {
+            const escape_t *e = &res[x*samples];
+            SDL_Color color = SUPERSAMPLE ?
+                get_average_color(e, ITERATIONS) :
+                get_escape_color(e[0], ITERATIONS);
+            pixels[y*stride + x] = SDL_MapRGB(fmt, color.r, color.g, color.b);
+            if (first_overflow)
             {
-                c = test_escape(point, ITERATIONS);
+                unsigned first = UINT_MAX;
+                for (int i=x*samples; i<(x+1)*samples; ++i)
+                {
+                    first = std::min(first, interior[i] ?
+                        UINT_MAX : raw_res[i].first_overflow);
+                }
+                first_overflow[y*stride + x] = first;
+            }
+            if (archive)
+            {
+                for (int i=0; i<samples; ++i)
+                {
+                    archive->write(e[i].iteration, e[i].conv);
+                }
             }
-            px[px_y*WIDTH + px_x] = SDL_MapRGB(surf->format, c.r, c.g, c.b);
         }
     }
 }
@@ -228,42 +830,208 @@ void render(
 /*
  * Render a segment of the madelbrot set to the SDL_Surface pointed to by surf.
  * The SDL_Surface object should have its surface locked with SDL_LockSurface
- * before calling this function. Fixed-point variant.
+ * before calling this function. Double-precision floating-point variant. If
+ * 'archive' is given, the escape results of every sample are written to it in
+ * archive order. The fractal is that of the formula 'formula', see formula.h.
+ */
+template <typename FORMULA = formula_mandelbrot>
+void render(
+        const segment_t<double> &seg,
+        const int WIDTH, const int HEIGHT, const bool SUPERSAMPLE,
+        const int ITERATIONS, SDL_Surface *surf,
+        archive_writer *archive = nullptr, const FORMULA &formula = FORMULA{})
+{
+    const tile_t image{ 0, 0, WIDTH, HEIGHT };
+    uint32_t *px = (uint32_t *)surf->pixels;
+    render_tile(
+        seg, WIDTH, HEIGHT, SUPERSAMPLE, ITERATIONS, image,
+        surf->format, px, WIDTH, archive, formula);
+}
+
+
+/*
+ * Render a segment of the madelbrot set to the SDL_Surface pointed to by surf.
+ * The SDL_Surface object should have its surface locked with SDL_LockSurface
+ * before calling this function. Fixed-point variant. If 'archive' is given, the
+ * escape results of every sample are written to it in archive order. If
+ * 'lane_stats' is given, the lane utilization of the render is added to it.
+ * For 'first_overflow' see render_tile(). The overflow policy of the format is
+ * honored by both the batched and the per-pixel path, so rendering the same
+ * segment with OverflowWrap and OverflowSaturate compares the two images.
  */
-template <int INT, int FRAC>
+template <
+    int INT, int FRAC, typename POLICY, typename ROUNDING,
+    typename FORMULA = formula_mandelbrot >
 void render(
-        const segment_t<SignedFixedPoint<INT,FRAC>> &seg,
+        const segment_t<SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>> &seg,
         const int WIDTH, const int HEIGHT, const bool SUPERSAMPLING,
-        const int ITERATIONS, SDL_Surface *surf)
+        const int ITERATIONS, SDL_Surface *surf,
+        archive_writer *archive = nullptr, const FORMULA &formula = FORMULA{},
+        lane_stats_t *lane_stats = nullptr, uint32_t *first_overflow = nullptr)
 {
-    // Calculate the px width and height in floating point.
-    const double px_width = double(seg.w) / double(WIDTH);
-    const double px_height = double(seg.h) / double(HEIGHT);
+    const tile_t image{ 0, 0, WIDTH, HEIGHT };
+    uint32_t *px = (uint32_t *)surf->pixels;
+    render_tile(
+        seg, WIDTH, HEIGHT, SUPERSAMPLING, ITERATIONS, image,
+        surf->format, px, WIDTH, archive, formula, lane_stats,
+        first_overflow);
+}
 
-    // Iterate over each pixel in the surface, calculate the pixels complex
-    // value and generate it's color thereof.
-    for (int px_y=0; px_y<HEIGHT; ++px_y)
+
+/*
+ * Progressive coarse-to-fine rendering of a tile. The tile is rendered in three
+ * passes: first every pixel on a 4x4 grid, displayed as 4x4 blocks, then the
+ * remaining pixels on a 2x2 grid, displayed as 2x2 blocks, and last all other
+ * pixels. Every pixel is computed exactly once and the final image equals that
+ * of render_tile(). The function 'on_pass(int pass)' is called after each
+ * completed pass, so that the result can be displayed. If 'cancel' is given it
+ * is polled between rows and passes and the function returns false as soon as
+ * it is set.
+ */
+template <typename REAL_TYPE, typename PASS_CALLBACK>
+bool render_tile_progressive(
+        const segment_t<REAL_TYPE> &seg,
+        const int WIDTH, const int HEIGHT, const bool SUPERSAMPLE,
+        const int ITERATIONS, const tile_t &tile,
+        const SDL_PixelFormat *fmt, uint32_t *pixels, const int stride,
+        const std::atomic<bool> *cancel, PASS_CALLBACK on_pass)
+{
+    const pixel_grid<REAL_TYPE> grid{ seg, WIDTH, HEIGHT };
+    constexpr int PASS_STEP[3] = { 4, 2, 1 };
+    for (int pass=0; pass<3; ++pass)
     {
-        for (int px_x=0; px_x<WIDTH; ++px_x)
+        const int step = PASS_STEP[pass];
+        for (int y=0; y<tile.h; y+=step)
         {
-            using T = SignedFixedPoint<INT,FRAC>;
-            uint32_t *px = (uint32_t *)surf->pixels;
-            T real{ double(seg.c.real()) - double(seg.w)/2.0 + px_width*px_x };
-            T imag{ double(seg.c.imag()) - double(seg.h)/2.0 + px_height*px_y };
-            std::complex<T> point{ real, imag };
-            segment_t<T> seg{ point, T(px_width), T(px_height) };
-            SDL_Color c{};
-            if (SUPERSAMPLING)
+            if (cancel && cancel->load(std::memory_order_relaxed))
             {
-                c = test_escape(seg, ITERATIONS);
+                return false;
             }
-            else
+            for (int x=0; x<tile.w; x+=step)
             {
-                c = test_escape(point, ITERATIONS);
+                // Skip pixels computed in a previous pass.
+                if (pass > 0 && x % (2*step) == 0 && y % (2*step) == 0)
+                {
+                    continue;
+                }
+                segment_t<REAL_TYPE> px_seg = grid(tile.x + x, tile.y + y);
+                SDL_Color c = get_pixel_color(
+                        px_seg, SUPERSAMPLE, ITERATIONS, nullptr);
+                uint32_t color = SDL_MapRGB(fmt, c.r, c.g, c.b);
+
+                // Fill the block of pixels not yet computed.
+                const int block_w = std::min(step, tile.w - x);
+                const int block_h = std::min(step, tile.h - y);
+                for (int by=0; by<block_h; ++by)
+                {
+                    std::fill_n(&pixels[(y+by)*stride + x], block_w, color);
+                }
             }
-            px[px_y*WIDTH + px_x] = SDL_MapRGB(surf->format, c.r, c.g, c.b);
         }
+        on_pass(pass);
     }
+    return true;
+}
+
+
+/*
+ * Progressive rendering of a segment of the madelbrot set to the SDL_Surface
+ * pointed to by surf, see render_tile_progressive(). The SDL_Surface object
+ * should have its surface locked with SDL_LockSurface before calling this
+ * function. Returns false if the rendering was cancelled.
+ */
+template <typename REAL_TYPE, typename PASS_CALLBACK>
+bool render_progressive(
+        const segment_t<REAL_TYPE> &seg,
+        const int WIDTH, const int HEIGHT, const bool SUPERSAMPLE,
+        const int ITERATIONS, SDL_Surface *surf,
+        const std::atomic<bool> *cancel, PASS_CALLBACK on_pass)
+{
+    const tile_t image{ 0, 0, WIDTH, HEIGHT };
+    uint32_t *px = (uint32_t *)surf->pixels;
+    return render_tile_progressive(
+        seg, WIDTH, HEIGHT, SUPERSAMPLE, ITERATIONS, image,
+        surf->format, px, WIDTH, cancel, on_pass);
+}
+
+
+/*
+ * Get the archive header describing a render of the segment 'seg'.
+ */
+static archive_header_t get_archive_header(
+        const segment_t<double> &seg,
+        const int WIDTH, const int HEIGHT, const bool SUPERSAMPLE,
+        const int ITERATIONS)
+{
+    archive_header_t hdr{};
+    std::memcpy(hdr.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    hdr.version = ARCHIVE_VERSION;
+    hdr.format = ARCHIVE_FORMAT_DOUBLE;
+    hdr.width = WIDTH;
+    hdr.height = HEIGHT;
+    hdr.samples = SUPERSAMPLE ? 4 : 1;
+    hdr.iterations = ITERATIONS;
+    hdr.center_re = seg.c.real();
+    hdr.center_im = seg.c.imag();
+    hdr.w = seg.w;
+    hdr.h = seg.h;
+    return hdr;
+}
+
+template <int INT, int FRAC, typename POLICY, typename ROUNDING>
+static archive_header_t get_archive_header(
+        const segment_t<SignedFixedPoint<INT,FRAC,POLICY,ROUNDING>> &seg,
+        const int WIDTH, const int HEIGHT, const bool SUPERSAMPLE,
+        const int ITERATIONS)
+{
+    segment_t<double> seg_double{
+        { double(seg.c.real()), double(seg.c.imag()) },
+        double(seg.w), double(seg.h)
+    };
+    archive_header_t hdr = get_archive_header(
+            seg_double, WIDTH, HEIGHT, SUPERSAMPLE, ITERATIONS);
+    hdr.format = ARCHIVE_FORMAT_FIXED;
+    hdr.int_bits = INT;
+    hdr.frac_bits = FRAC;
+    return hdr;
+}
+
+
+/*
+ * Re-color a previously rendered frame from its iteration-count archive using
+ * the color palette 'palette'. No escape iterations are performed. The surface
+ * must have the same dimensions as the archived frame and it should be locked
+ * with SDL_LockSurface before calling this function.
+ */
+template <typename PALETTE = SDL_Color (*)(double)>
+void recolor(
+        const archive_header_t &hdr, const archive_sample_t *sample,
+        SDL_Surface *surf, PALETTE palette = palette_default)
+{
+    const unsigned samples = hdr.samples;
+    const size_t pixels = size_t(hdr.width) * hdr.height;
+    uint32_t *px = (uint32_t *)surf->pixels;
+    for (size_t i=0; i<pixels; ++i, sample += samples)
+    {
+        escape_t res[4]{};
+        for (unsigned s=0; s<samples; ++s)
+        {
+            res[s].iteration = sample[s].iteration;
+            res[s].conv = double(sample[s].iteration) + sample[s].smooth;
+        }
+        SDL_Color c = samples == 4 ?
+            get_average_color(res, hdr.iterations, palette) :
+            get_escape_color(res[0], hdr.iterations, palette);
+        px[i] = SDL_MapRGB(surf->format, c.r, c.g, c.b);
+    }
+}
+
+template <typename PALETTE = SDL_Color (*)(double)>
+void recolor(
+        const archive_reader &archive, SDL_Surface *surf,
+        PALETTE palette = palette_default)
+{
+    recolor(archive.header(), archive.samples(), surf, palette);
 }
 
 #endif
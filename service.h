@@ -0,0 +1,457 @@
+#ifndef _SERVICE_H
+#define _SERVICE_H
+
+#include "render.h"
+#include "tiles.h"
+#include "formats.h"
+#include "thread_pool.h"
+#include "socket_io.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+/*
+ * Render service. A long-running daemon listening on a Unix domain socket that
+ * renders requested segments on a warm thread pool. Rendered tiles are kept in
+ * an LRU cache keyed by the exact (fixed point) coordinates of the tile, so a
+ * repeated request, or a request overlapping a previous one on the same pixel
+ * grid, is served from the cache.
+ */
+constexpr uint32_t SERVICE_MAGIC = 0x5350464d;     // "MFPS"
+
+enum service_command_t : uint32_t
+{
+    SERVICE_RENDER = 0,     // Render a segment
+    SERVICE_STATS = 1,      // Get the service statistics only
+    SERVICE_SHUTDOWN = 2,   // Stop the service
+};
+
+
+/*
+ * Service request. The number format is selected by 'frac_bits' as described
+ * in formats.h.
+ */
+struct service_request_t
+{
+    uint32_t magic;         // SERVICE_MAGIC
+    uint32_t command;       // service_command_t
+    int32_t frac_bits;      // Number format, 0 for double precision
+    uint32_t width;         // Image width in pixels
+    uint32_t height;        // Image height in pixels
+    uint32_t supersample;   // Non-zero for 4x super sampling
+    uint32_t iterations;    // Iteration limit
+    uint32_t reserved;
+    double center_re;       // Segment center, real part
+    double center_im;       // Segment center, imaginary part
+    double w;               // Segment width
+    double h;               // Segment height
+};
+
+
+/*
+ * Cumulative service statistics.
+ */
+struct service_stats_t
+{
+    uint64_t requests;      // Render requests served
+    uint64_t tile_hits;     // Tiles served from the cache
+    uint64_t tile_misses;   // Tiles rendered
+    uint64_t evictions;     // Tiles evicted from the cache
+    uint64_t cached_tiles;  // Tiles currently in the cache
+};
+
+
+/*
+ * Service response. A successful render response is followed by width*height
+ * 32-bit pixels in the default SDL 32-bit RGB pixel format.
+ */
+struct service_response_t
+{
+    uint32_t status;        // Zero on success
+    uint32_t width;         // Image width in pixels
+    uint32_t height;        // Image height in pixels
+    uint32_t tiles;         // Tiles of this request
+    uint32_t tile_hits;     // Tiles of this request served from the cache
+    uint32_t reserved;
+    service_stats_t stats;  // Cumulative statistics
+};
+
+
+/*
+ * Service configuration.
+ */
+struct service_config_t
+{
+    unsigned threads{ std::thread::hardware_concurrency() };
+    int tile_size{ 64 };            // Tile width and height in pixels
+    tile_order_t tile_order{ TILE_ROW_MAJOR };  // Order tiles are queued in
+    size_t cache_tiles{ 4096 };     // Cache capacity in tiles
+    uint32_t max_pixels{ 1u << 26 };// Largest image accepted
+};
+
+
+/*
+ * Thread-safe LRU cache of rendered tiles. The pixel buffers of evicted tiles
+ * are reused for new tiles.
+ */
+class tile_cache
+{
+public:
+    using key_type = std::vector<uint64_t>;
+
+    explicit tile_cache(size_t capacity) : capacity{ capacity } {}
+
+    /*
+     * Look up a tile and copy its pixels to 'dst', with 'stride' pixels per
+     * row, on a hit. The function returns false on a miss.
+     */
+    bool lookup(const key_type &key, uint32_t *dst, int stride, int w, int h)
+    {
+        std::lock_guard<std::mutex> lock{ mutex };
+        auto it = index.find(key);
+        if (it == index.end())
+        {
+            ++stats.tile_misses;
+            return false;
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        const uint32_t *src = it->second->pixels.data();
+        for (int y=0; y<h; ++y)
+        {
+            std::memcpy(dst + size_t(y)*stride, src + size_t(y)*w, w*4);
+        }
+        ++stats.tile_hits;
+        return true;
+    }
+
+    /*
+     * Insert a tile, copying w*h pixels from 'src' with 'stride' pixels per
+     * row, evicting the least recently used tile if the cache is full.
+     */
+    void insert(key_type key, const uint32_t *src, int stride, int w, int h)
+    {
+        std::lock_guard<std::mutex> lock{ mutex };
+        if (capacity == 0 || index.count(key))
+        {
+            return;
+        }
+        std::vector<uint32_t> pixels{};
+        if (entries.size() >= capacity)
+        {
+            index.erase(entries.back().key);
+            pixels = std::move(entries.back().pixels);
+            entries.pop_back();
+            ++stats.evictions;
+        }
+        pixels.resize(size_t(w) * h);
+        for (int y=0; y<h; ++y)
+        {
+            std::memcpy(&pixels[size_t(y)*w], src + size_t(y)*stride, w*4);
+        }
+        entries.push_front(entry_t{ std::move(key), std::move(pixels) });
+        index.emplace(entries.front().key, entries.begin());
+    }
+
+    service_stats_t get_stats()
+    {
+        std::lock_guard<std::mutex> lock{ mutex };
+        service_stats_t res = stats;
+        res.cached_tiles = entries.size();
+        return res;
+    }
+
+private:
+    struct entry_t
+    {
+        key_type key;
+        std::vector<uint32_t> pixels;
+    };
+
+    struct key_hash
+    {
+        size_t operator()(const key_type &key) const
+        {
+            uint64_t h = 0xcbf29ce484222325ull;
+            for (uint64_t w : key)
+            {
+                h = (h ^ w) * 0x100000001b3ull;
+                h ^= h >> 29;
+            }
+            return h;
+        }
+    };
+
+    size_t capacity;
+    std::list<entry_t> entries{};
+    std::unordered_map<
+        key_type, std::list<entry_t>::iterator, key_hash> index{};
+    std::mutex mutex{};
+    service_stats_t stats{};
+};
+
+
+namespace detail
+{
+    /*
+     * Exact representation of a coordinate as cache key words.
+     */
+    static inline void append_key(std::vector<uint64_t> &key, double a)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &a, sizeof(bits));
+        key.push_back(bits);
+    }
+
+    template <int INT, int FRAC>
+    static void append_key(
+            std::vector<uint64_t> &key, const SignedFixedPoint<INT,FRAC> &a)
+    {
+        key.push_back(uint64_t(a.get_num().table[0]));
+        key.push_back(uint64_t(a.get_num().table[1]));
+    }
+
+
+    /*
+     * Cache key of a tile. The pixels of a tile are fully determined by the
+     * number format, the render settings, the real coordinate of each tile
+     * column, the imaginary coordinate of each tile row and the pixel size.
+     */
+    template <typename REAL_TYPE>
+    static std::vector<uint64_t> get_tile_key(
+            const pixel_grid<REAL_TYPE> &grid, const service_request_t &req,
+            const tile_t &tile)
+    {
+        std::vector<uint64_t> key{};
+        key.reserve(8 + 2*(tile.w + tile.h));
+        key.push_back(uint64_t(req.frac_bits));
+        key.push_back(req.iterations);
+        key.push_back(req.supersample != 0);
+        key.push_back(uint64_t(tile.w) << 32 | uint32_t(tile.h));
+        segment_t<REAL_TYPE> px_seg = grid(tile.x, tile.y);
+        append_key(key, px_seg.w);
+        append_key(key, px_seg.h);
+        for (int x=0; x<tile.w; ++x)
+        {
+            append_key(key, grid(tile.x + x, tile.y).c.real());
+        }
+        for (int y=0; y<tile.h; ++y)
+        {
+            append_key(key, grid(tile.x, tile.y + y).c.imag());
+        }
+        return key;
+    }
+}
+
+
+/*
+ * The render service.
+ */
+class render_service
+{
+public:
+    explicit render_service(const service_config_t &config = {})
+        : config{ config },
+          pool{ config.threads },
+          cache{ config.cache_tiles },
+          surface{ SDL_CreateRGBSurface(0, 1, 1, 32, 0, 0, 0, 0) }
+    {
+    }
+
+    render_service(const render_service &) = delete;
+    render_service &operator=(const render_service &) = delete;
+    ~render_service() { SDL_FreeSurface(surface); }
+
+    /*
+     * Listen on the Unix domain socket 'path' and serve requests until a
+     * shutdown request is received. A socket left at 'path' by a previous run
+     * is replaced. The function returns false on failure to set up the
+     * socket, if 'path' exists and is not a socket, or if accepting
+     * connections fails for another reason than an interrupt or a connection
+     * aborted by the client.
+     */
+    bool run(const char *path)
+    {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (std::strlen(path) >= sizeof(addr.sun_path))
+        {
+            return false;
+        }
+        std::strcpy(addr.sun_path, path);
+
+        // Replace a stale socket of a previous run, but nothing else.
+        struct stat st{};
+        if (lstat(path, &st) == 0 && (!S_ISSOCK(st.st_mode) ||
+                                      ::unlink(path) < 0))
+        {
+            return false;
+        }
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+        {
+            return false;
+        }
+        if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        bool running = true, ok = true;
+        while (running)
+        {
+            int client = accept(fd, nullptr, nullptr);
+            if (client < 0)
+            {
+                if (errno == EINTR || errno == ECONNABORTED)
+                {
+                    continue;
+                }
+                // Errors such as EMFILE or ENOMEM persist, don't spin on them.
+                ok = false;
+                break;
+            }
+            running = serve(client);
+            ::close(client);
+        }
+        ::close(fd);
+        ::unlink(path);
+        return ok;
+    }
+
+private:
+    /*
+     * Serve the requests of a connection. Returns false on shutdown.
+     */
+    bool serve(int fd)
+    {
+        service_request_t req{};
+        while (detail::read_full(fd, &req, sizeof(req)))
+        {
+            service_response_t res{};
+            bool valid = req.magic == SERVICE_MAGIC;
+            if (valid && req.command == SERVICE_SHUTDOWN)
+            {
+                res.stats = cache.get_stats();
+                res.stats.requests = requests;
+                detail::write_full(fd, &res, sizeof(res));
+                return false;
+            }
+            if (valid && req.command == SERVICE_RENDER)
+            {
+                valid = req.width > 0 && req.height > 0 && req.iterations > 0
+                    && uint64_t(req.width)*req.height <= config.max_pixels
+                    && dispatch_format(req.frac_bits, [&](auto real)
+                       {
+                           render_request(req, res, real);
+                       });
+            }
+            res.status = valid ? 0 : 1;
+            res.stats = cache.get_stats();
+            res.stats.requests = requests;
+            bool has_pixels = valid && req.command == SERVICE_RENDER;
+            if (!detail::write_full(fd, &res, sizeof(res)) || (has_pixels &&
+                !detail::write_full(fd, frame.data(), frame.size()*4)))
+            {
+                break;
+            }
+        }
+        return true;
+    }
+
+    /*
+     * Render a request into the frame buffer, serving tiles from the cache
+     * when possible.
+     */
+    template <typename REAL_TYPE>
+    void render_request(
+            const service_request_t &req, service_response_t &res, REAL_TYPE)
+    {
+        const int W = req.width;
+        const int H = req.height;
+        const segment_t<REAL_TYPE> seg{
+            { REAL_TYPE(req.center_re), REAL_TYPE(req.center_im) },
+            REAL_TYPE(req.w), REAL_TYPE(req.h)
+        };
+        const pixel_grid<REAL_TYPE> grid{ seg, W, H };
+
+        // Tiles are aligned to the image.
+        const std::vector<tile_t> tiles =
+            make_tiles(W, H, config.tile_size, config.tile_order);
+
+        // The frame buffer is kept between requests and only ever grows.
+        frame.resize(size_t(W) * H);
+        std::atomic<uint32_t> hits{ 0 };
+        parallel_for(pool, tiles.size(), [&](int i)
+        {
+            const tile_t &t = tiles[i];
+            uint32_t *dst = frame.data() + size_t(t.y)*W + t.x;
+            auto key = detail::get_tile_key(grid, req, t);
+            if (cache.lookup(key, dst, W, t.w, t.h))
+            {
+                ++hits;
+                return;
+            }
+            render_tile(
+                seg, W, H, req.supersample != 0, req.iterations, t,
+                surface->format, dst, W);
+            cache.insert(std::move(key), dst, W, t.w, t.h);
+        });
+        ++requests;
+        res.width = W;
+        res.height = H;
+        res.tiles = tiles.size();
+        res.tile_hits = hits;
+    }
+
+    service_config_t config;
+    thread_pool pool;
+    tile_cache cache;
+    SDL_Surface *surface;
+    std::vector<uint32_t> frame{};
+    uint64_t requests{ 0 };
+};
+
+
+/*
+ * Send a request to the render service listening on the Unix domain socket
+ * 'path'. For render requests the pixels are returned in 'pixels'. The
+ * function returns false on communication failure.
+ */
+static bool service_call(
+        const char *path, const service_request_t &req,
+        service_response_t &res, std::vector<uint32_t> &pixels)
+{
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (std::strlen(path) >= sizeof(addr.sun_path))
+    {
+        return false;
+    }
+    std::strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool ok = connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0 &&
+        detail::write_full(fd, &req, sizeof(req)) &&
+        detail::read_full(fd, &res, sizeof(res));
+    if (ok && res.status == 0 && req.command == SERVICE_RENDER)
+    {
+        pixels.resize(size_t(res.width) * res.height);
+        ok = detail::read_full(fd, pixels.data(), pixels.size()*4);
+    }
+    ::close(fd);
+    return ok;
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef _SOCKET_IO_H
+#define _SOCKET_IO_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+namespace detail
+{
+    /*
+     * Read or write exactly 'n' bytes from/to a socket. Returns false on error
+     * or end of file.
+     */
+    static inline bool read_full(int fd, void *buf, size_t n)
+    {
+        uint8_t *p = static_cast<uint8_t *>(buf);
+        while (n > 0)
+        {
+            ssize_t res = ::read(fd, p, n);
+            if (res < 0 && errno == EINTR)
+                continue;
+            if (res <= 0)
+                return false;
+            p += res;
+            n -= res;
+        }
+        return true;
+    }
+
+    static inline bool write_full(int fd, const void *buf, size_t n)
+    {
+        const uint8_t *p = static_cast<const uint8_t *>(buf);
+        while (n > 0)
+        {
+            ssize_t res = ::send(fd, p, n, MSG_NOSIGNAL);
+            if (res < 0 && errno == EINTR)
+                continue;
+            if (res <= 0)
+                return false;
+            p += res;
+            n -= res;
+        }
+        return true;
+    }
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/*
+ * Fixed size pool of worker threads executing tasks from a shared FIFO queue.
+ * The threads are started on construction and kept warm until the pool is
+ * destroyed.
+ */
+class thread_pool
+{
+public:
+    explicit thread_pool(unsigned threads = std::thread::hardware_concurrency())
+    {
+        threads = threads > 0 ? threads : 1;
+        for (unsigned i=0; i<threads; ++i)
+        {
+            workers.emplace_back([this]{ worker_loop(); });
+        }
+    }
+
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            stop = true;
+        }
+        task_cv.notify_all();
+        for (std::thread &t : workers)
+        {
+            t.join();
+        }
+    }
+
+    /*
+     * Add a task to the queue.
+     */
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            tasks.push_back(std::move(task));
+        }
+        task_cv.notify_one();
+    }
+
+    /*
+     * Remove all tasks that have not yet started from the queue.
+     */
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock{ mutex };
+        tasks.clear();
+        if (active == 0)
+        {
+            done_cv.notify_all();
+        }
+    }
+
+    /*
+     * Block until the queue is empty and all tasks have finished.
+     */
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock{ mutex };
+        done_cv.wait(lock, [this]{ return tasks.empty() && active == 0; });
+    }
+
+    unsigned size() const { return workers.size(); }
+
+private:
+    void worker_loop()
+    {
+        std::unique_lock<std::mutex> lock{ mutex };
+        while (true)
+        {
+            task_cv.wait(lock, [this]{ return stop || !tasks.empty(); });
+            if (tasks.empty())
+            {
+                return;
+            }
+            std::function<void()> task = std::move(tasks.front());
+            tasks.pop_front();
+            ++active;
+            lock.unlock();
+            task();
+            lock.lock();
+            --active;
+            if (tasks.empty() && active == 0)
+            {
+                done_cv.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers{};
+    std::deque<std::function<void()>> tasks{};
+    std::mutex mutex{};
+    std::condition_variable task_cv{};
+    std::condition_variable done_cv{};
+    unsigned active{ 0 };
+    bool stop{ false };
+};
+
+
+/*
+ * Execute f(i) for every i in [0, n) on the thread pool and block until all
+ * calls have finished.
+ */
+template <typename F>
+void parallel_for(thread_pool &pool, int n, F f)
+{
+    for (int i=0; i<n; ++i)
+    {
+        pool.submit([&f, i]{ f(i); });
+    }
+    pool.wait();
+}
+
+#endif
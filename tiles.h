@@ -0,0 +1,188 @@
+#ifndef _TILES_H
+#define _TILES_H
+
+#include "render.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <SDL/SDL.h>
+
+
+/*
+ * Traversal orders of the tiles of an image. TILE_ROW_MAJOR visits the tiles
+ * row by row. TILE_MORTON (Z-order) and TILE_HILBERT visit them along a space
+ * filling curve, so consecutive tiles are neighbors and the pixel rows and
+ * tile buffers touched in a stretch of time stay within a small region of the
+ * image. The Hilbert curve only ever steps to an adjacent tile, while the
+ * Z-order curve jumps at the corners of its quadrants but is cheaper to index.
+ */
+enum tile_order_t
+{
+    TILE_ROW_MAJOR,
+    TILE_MORTON,
+    TILE_HILBERT
+};
+
+
+namespace detail
+{
+    /*
+     * Spread the low 16 bits of 'v' to the even bits of the result.
+     */
+    static inline uint32_t spread_bits(uint32_t v)
+    {
+        v &= 0x0000ffff;
+        v = (v | (v << 8)) & 0x00ff00ff;
+        v = (v | (v << 4)) & 0x0f0f0f0f;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    }
+
+    /*
+     * Position of the tile (x, y) on the Z-order curve.
+     */
+    static inline uint32_t morton_index(uint32_t x, uint32_t y)
+    {
+        return spread_bits(x) | (spread_bits(y) << 1);
+    }
+
+    /*
+     * Position of the tile (x, y) on the Hilbert curve filling the n x n grid,
+     * where n is a power of two.
+     */
+    static inline uint64_t hilbert_index(uint32_t n, uint32_t x, uint32_t y)
+    {
+        uint64_t d = 0;
+        for (uint32_t s=n/2; s>0; s/=2)
+        {
+            const uint32_t rx = (x & s) > 0;
+            const uint32_t ry = (y & s) > 0;
+            d += uint64_t(s) * s * ((3 * rx) ^ ry);
+
+            // Rotate the quadrant, so the curve within it starts and ends at
+            // the corners adjacent to the neighboring quadrants.
+            if (ry == 0)
+            {
+                if (rx == 1)
+                {
+                    x = s-1 - (x & (s-1));
+                    y = s-1 - (y & (s-1));
+                }
+                std::swap(x, y);
+            }
+            x &= s-1;
+            y &= s-1;
+        }
+        return d;
+    }
+}
+
+
+/*
+ * Parse the tile order named 'name': "row", "morton" or "hilbert". Returns
+ * false if the name is unknown.
+ */
+static bool parse_tile_order(const char *name, tile_order_t &order)
+{
+    if (!std::strcmp(name, "row"))
+    {
+        order = TILE_ROW_MAJOR;
+    }
+    else if (!std::strcmp(name, "morton"))
+    {
+        order = TILE_MORTON;
+    }
+    else if (!std::strcmp(name, "hilbert"))
+    {
+        order = TILE_HILBERT;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+
+/*
+ * Split a WIDTH x HEIGHT image into tiles of TILE x TILE pixels, with smaller
+ * tiles at the right and bottom edges, in the traversal order 'order'.
+ */
+static std::vector<tile_t> make_tiles(
+        const int WIDTH, const int HEIGHT, const int TILE,
+        tile_order_t order = TILE_ROW_MAJOR)
+{
+    const int tiles_x = (WIDTH + TILE - 1) / TILE;
+    const int tiles_y = (HEIGHT + TILE - 1) / TILE;
+    uint32_t n = 1;
+    while (n < uint32_t(std::max(tiles_x, tiles_y)))
+    {
+        n *= 2;
+    }
+    std::vector<std::pair<uint64_t, tile_t>> keyed{};
+    keyed.reserve(size_t(tiles_x) * tiles_y);
+    for (int ty=0; ty<tiles_y; ++ty)
+    {
+        for (int tx=0; tx<tiles_x; ++tx)
+        {
+            const int x = tx*TILE, y = ty*TILE;
+            const tile_t tile{
+                x, y, std::min(TILE, WIDTH-x), std::min(TILE, HEIGHT-y) };
+            uint64_t key = keyed.size();
+            if (order == TILE_MORTON)
+            {
+                key = detail::morton_index(tx, ty);
+            }
+            else if (order == TILE_HILBERT)
+            {
+                key = detail::hilbert_index(n, tx, ty);
+            }
+            keyed.emplace_back(key, tile);
+        }
+    }
+    std::sort(keyed.begin(), keyed.end(),
+        [](const std::pair<uint64_t, tile_t> &a,
+           const std::pair<uint64_t, tile_t> &b) { return a.first < b.first; });
+    std::vector<tile_t> tiles(keyed.size());
+    for (size_t i=0; i<keyed.size(); ++i)
+    {
+        tiles[i] = keyed[i].second;
+    }
+    return tiles;
+}
+
+
+/*
+ * Render a segment of the madelbrot set to the SDL_Surface pointed to by surf
+ * tile by tile, in the traversal order 'order'. The SDL_Surface object should
+ * have its surface locked with SDL_LockSurface before calling this function.
+ * Each tile is rendered into a tile-local scratch buffer, which stays in cache
+ * while the tile is rendered, and written back to the surface in bulk, one
+ * row of the tile at a time. The image is identical to that of render() with
+ * the formula 'formula'.
+ */
+template <typename REAL_TYPE, typename FORMULA = formula_mandelbrot>
+void render_tiled(
+        const segment_t<REAL_TYPE> &seg,
+        const int WIDTH, const int HEIGHT, const bool SUPERSAMPLE,
+        const int ITERATIONS, SDL_Surface *surf, tile_order_t order,
+        const FORMULA &formula = FORMULA{}, const int TILE = 64)
+{
+    std::vector<uint32_t> scratch(size_t(TILE) * TILE);
+    for (const tile_t &tile : make_tiles(WIDTH, HEIGHT, TILE, order))
+    {
+        render_tile(
+            seg, WIDTH, HEIGHT, SUPERSAMPLE, ITERATIONS, tile,
+            surf->format, scratch.data(), tile.w, nullptr, formula);
+        for (int y=0; y<tile.h; ++y)
+        {
+            uint8_t *row = (uint8_t *)surf->pixels +
+                size_t(tile.y + y)*surf->pitch + size_t(tile.x)*4;
+            std::memcpy(row, &scratch[size_t(y)*tile.w], tile.w*4);
+        }
+    }
+}
+
+#endif